@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "autobaud.h"
+
+#ifdef AUTOBAUD_ARBITRARY_RATES
+/*
+ The kernel's termios2, which the C library does not declare. The speed
+ fields are used when the speed bits of c_cflag are BOTHER.
+ */
+struct termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+#endif
+
+/*
+ * Shared state for a batch of ports being detected by detectBaudRates.
+ * results holds the rate and score of each port.
+ */
+struct autobaud_batch {
+    struct serial_port **ports;
+    int candidates[AUTOBAUD_MAX_CANDIDATES];
+    int candidate_count;
+    int dwell_millis;
+    int flags;
+    jint *results;
+};
+
+/*
+ * Sets the rate of a port, keeping every other setting of base.
+ */
+static int set_rate(struct serial_port *port, const struct termios *base, int baud){
+    struct termios termios = *base;
+    speed_t speed = speed_from_baud(baud);
+#ifdef AUTOBAUD_ARBITRARY_RATES
+    struct termios2 termios2;
+#endif
+    if (speed != B0){
+        cfsetispeed(&termios, speed);
+        cfsetospeed(&termios, speed);
+        return port_set_termios(port, TCSANOW, &termios);
+    }
+#ifdef AUTOBAUD_ARBITRARY_RATES
+    // The change bypasses the attribute cache, so the cache is dropped.
+    port_invalidate_termios(port);
+    if (ioctl(port->fd, TCGETS2, &termios2) == -1)
+        return -1;
+    termios2.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    termios2.c_cflag |= BOTHER;
+    termios2.c_ispeed = termios2.c_ospeed = baud;
+    return ioctl(port->fd, TCSETS2, &termios2);
+#else
+    errno = EINVAL;
+    return -1;
+#endif
+}
+
+/*
+ * Whether a byte is likely to have been received at the right rate. At the
+ * wrong rate the line mostly reads as runs of zeros or ones, which arrive
+ * as bytes such as 0x00, 0xF0 or 0xFF.
+ */
+static int plausible(unsigned char c, int text){
+    if (text)
+        return (c >= 0x20 && c < 0x7F) || c == '\r' || c == '\n' || c == '\t';
+    switch (c){
+        case 0x00: case 0x80: case 0xC0: case 0xE0:
+        case 0xF0: case 0xF8: case 0xFC: case 0xFE: case 0xFF:
+            return 0;
+    }
+    return 1;
+}
+
+static long remaining_millis(const struct timespec *deadline){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (deadline->tv_sec - now.tv_sec) * 1000L
+            + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+}
+
+/*
+ * Listens to a port for the dwell time and scores what it hears. The port
+ * is read directly, bypassing any read-ahead buffer. Returns -1 with errno
+ * set if the port fails or waits on it are cancelled.
+ */
+static int measure(struct serial_port *port, int dwell_millis, int text,
+                    int *score, uint64_t *bytes_heard){
+    unsigned char buffer[AUTOBAUD_BUFFER_SIZE];
+    struct serial_icounter_struct before, after;
+    struct timespec deadline;
+    uint64_t bytes = 0, good = 0, errors = 0;
+    int counted, available, result, i;
+    long wait;
+
+    // Anything already queued arrived at the previous rate.
+    tcflush(port->fd, TCIFLUSH);
+    counted = ioctl(port->fd, TIOCGICOUNT, &before) == 0;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += dwell_millis / 1000;
+    deadline.tv_nsec += (dwell_millis % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while ((wait = remaining_millis(&deadline)) > 0){
+        result = port_wait(port, POLLIN, (int) wait);
+        if (result == -1)
+            return -1;
+        if (result == 0)
+            break;
+        if (ioctl(port->fd, FIONREAD, &available) == -1 || available < 1)
+            available = 1;
+        if (available > (int) sizeof(buffer))
+            available = sizeof(buffer);
+        result = read(port->fd, buffer, available);
+        if (result == -1){
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        if (result == 0)
+            break;
+        for (i = 0; i < result; i++)
+            good += plausible(buffer[i], text);
+        bytes += result;
+    }
+    if (counted && ioctl(port->fd, TIOCGICOUNT, &after) == 0){
+        errors = (uint64_t) (after.frame - before.frame) + (after.parity - before.parity)
+                + (after.overrun - before.overrun) + (after.brk - before.brk);
+    }
+    if (bytes < AUTOBAUD_MIN_BYTES)
+        *score = 0;
+    else
+        *score = (int) (AUTOBAUD_MAX_SCORE * good / (bytes + AUTOBAUD_ERROR_WEIGHT * errors));
+    *bytes_heard = errors == 0 ? bytes : 0;
+    return 0;
+}
+
+/*
+ * Detects the rate of a single port of an autobaud_batch. The port is left
+ * at the best rate or, if nothing plausible was heard, as it was.
+ */
+static void detect_port(int index, void *context){
+    struct autobaud_batch *batch = (struct autobaud_batch*) context;
+    struct serial_port *port = batch->ports[index];
+    struct termios base;
+    uint64_t bytes;
+    int i, score, best = -1, best_score = 0, error = 0;
+
+    if (port_get_termios(port, &base) == -1){
+        batch->results[2 * index] = -errno;
+        batch->results[2 * index + 1] = 0;
+        return;
+    }
+    for (i = 0; i < batch->candidate_count; i++){
+        if (set_rate(port, &base, batch->candidates[i]) == -1){
+            // A rate the driver refuses is skipped rather than fatal.
+            if (errno == EINVAL)
+                continue;
+            error = errno;
+            break;
+        }
+        if (measure(port, batch->dwell_millis, batch->flags & AUTOBAUD_TEXT,
+                    &score, &bytes) == -1){
+            error = errno;
+            break;
+        }
+        if (score > best_score){
+            best = i;
+            best_score = score;
+        }
+        if (score >= AUTOBAUD_LOCK_SCORE && bytes >= AUTOBAUD_LOCK_BYTES)
+            break;
+    }
+    if (error == 0 && best == -1)
+        error = ENODATA;
+    if (error == 0 && set_rate(port, &base, batch->candidates[best]) == -1)
+        error = errno;
+    if (error != 0){
+        port_set_termios(port, TCSANOW, &base);
+        batch->results[2 * index] = -error;
+        batch->results[2 * index + 1] = 0;
+        return;
+    }
+    syslog(LOG_USER | LOG_DEBUG, "Detected %d baud with score %d.", batch->candidates[best], best_score);
+    batch->results[2 * index] = batch->candidates[best];
+    batch->results[2 * index + 1] = best_score;
+}
+
+/**
+ * Detects the baud rate of a number of ports in parallel. Each port tries
+ * every candidate rate in turn, listening for the dwell time, and is left
+ * at the rate that scored best. A score is the share, in thousandths, of
+ * the bytes heard that look plausible, discounted by the framing, parity,
+ * overrun and break errors counted by the driver (TIOCGICOUNT) where it
+ * counts them. With AUTOBAUD_TEXT only printable ASCII is plausible;
+ * otherwise only the bytes a line read at the wrong rate typically produces
+ * are not. Detection stops early on a rate that scores near perfectly.
+ * Rates without a termios speed value are set with termios2 where
+ * supported and skipped elsewhere, as are rates the driver refuses.
+ * Detection is woken by cancelPort.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handles the handles of the ports, which must be receiving.
+ * @param candidates the rates to try in order, or null for the standard
+ * rates from AUTOBAUD_DEFAULT_MIN_BAUD to AUTOBAUD_DEFAULT_MAX_BAUD.
+ * @param dwell_millis how long to listen at each rate.
+ * @param flags AUTOBAUD_TEXT or 0.
+ * @return an array with two entries per port: the rate detected or the
+ * negated errno value, ENODATA if nothing plausible was heard, and the
+ * score of that rate.
+ * @throws IOException if the arguments are invalid or a handle is not that
+ * of an open port.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_javatechnics_rs232_Serial_detectBaudRates (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlongArray handles,
+                                                    jintArray candidates,
+                                                    jint dwell_millis,
+                                                    jint flags){
+    struct autobaud_batch batch;
+    jintArray return_array = NULL;
+    jlong *values = NULL;
+    jsize count, acquired = 0, i;
+    int rate, error = 0;
+
+    if (handles == NULL || dwell_millis < 1){
+        throw_ioexception(env, EINVAL);
+        return NULL;
+    }
+    bzero(&batch, sizeof(batch));
+    if (candidates != NULL){
+        batch.candidate_count = (*env)->GetArrayLength(env, candidates);
+        if (batch.candidate_count < 1 || batch.candidate_count > AUTOBAUD_MAX_CANDIDATES){
+            throw_ioexception(env, EINVAL);
+            return NULL;
+        }
+        (*env)->GetIntArrayRegion(env, candidates, 0, batch.candidate_count, (jint*) batch.candidates);
+        for (i = 0; i < batch.candidate_count; i++){
+            if (batch.candidates[i] < 1){
+                throw_ioexception(env, EINVAL);
+                return NULL;
+            }
+        }
+    } else {
+        for (i = 0; (rate = baud_standard_rate(i)) != 0; i++){
+            if (rate >= AUTOBAUD_DEFAULT_MIN_BAUD && rate <= AUTOBAUD_DEFAULT_MAX_BAUD)
+                batch.candidates[batch.candidate_count++] = rate;
+        }
+    }
+    batch.dwell_millis = dwell_millis;
+    batch.flags = flags;
+    count = (*env)->GetArrayLength(env, handles);
+    values = calloc(count + 1, sizeof(jlong));
+    batch.ports = calloc(count + 1, sizeof(struct serial_port*));
+    batch.results = calloc(2 * count + 1, sizeof(jint));
+    if (values == NULL || batch.ports == NULL || batch.results == NULL){
+        error = ENOMEM;
+        goto cleanup;
+    }
+    (*env)->GetLongArrayRegion(env, handles, 0, count, values);
+    for (acquired = 0; acquired < count; acquired++){
+        batch.ports[acquired] = port_acquire(values[acquired]);
+        if (batch.ports[acquired] == NULL){
+            error = errno;
+            goto cleanup;
+        }
+    }
+
+    run_parallel(count, PARALLEL_MAX_THREADS, detect_port, &batch);
+
+    return_array = (*env)->NewIntArray(env, 2 * count);
+    if (return_array != NULL)
+        (*env)->SetIntArrayRegion(env, return_array, 0, 2 * count, batch.results);
+
+cleanup:
+    for (i = 0; i < acquired; i++)
+        port_release(batch.ports[i]);
+    free(values);
+    free(batch.ports);
+    free(batch.results);
+    if (error != 0)
+        throw_ioexception(env, error);
+    return return_array;
+}
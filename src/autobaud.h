@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   autobaud.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Automatic baud rate detection. Each candidate rate is listened to for a
+ * short dwell and scored by the framing, parity, overrun and break errors
+ * the driver counts and by how plausible the bytes received look. The port
+ * is left at the rate that scored best.
+ */
+
+#ifndef AUTOBAUD_H
+#define	AUTOBAUD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <syslog.h>
+#include "port.h"
+#include "baud.h"
+#include "parallel.h"
+
+/*
+ Flags for detectBaudRates. These match the constants in Serial.
+ */
+#define AUTOBAUD_TEXT 1
+
+/*
+ The standard rates tried when no candidates are given.
+ */
+#define AUTOBAUD_DEFAULT_MIN_BAUD 1200
+#define AUTOBAUD_DEFAULT_MAX_BAUD 921600
+
+/*
+ Scores are in thousandths. Fewer bytes than AUTOBAUD_MIN_BYTES score 0;
+ each error counted by the driver weighs as much as AUTOBAUD_ERROR_WEIGHT
+ implausible bytes. A candidate scoring at least AUTOBAUD_LOCK_SCORE over
+ AUTOBAUD_LOCK_BYTES bytes without errors is taken without trying the rest.
+ */
+#define AUTOBAUD_MAX_SCORE 1000
+#define AUTOBAUD_MIN_BYTES 4
+#define AUTOBAUD_ERROR_WEIGHT 4
+#define AUTOBAUD_LOCK_SCORE 990
+#define AUTOBAUD_LOCK_BYTES 32
+
+#define AUTOBAUD_MAX_CANDIDATES 64
+#define AUTOBAUD_BUFFER_SIZE 4096
+
+/*
+ Rates without a termios speed value are set through termios2 with BOTHER
+ where the layout of that structure is known.
+ */
+#if defined(TCGETS2) && (defined(__i386__) || defined(__x86_64__) \
+        || defined(__arm__) || defined(__aarch64__) || defined(__riscv))
+#define AUTOBAUD_ARBITRARY_RATES
+#endif
+
+#endif	/* AUTOBAUD_H */
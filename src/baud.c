@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "baud.h"
+
+static const speed_t speeds[] = \
+                        {B50,       B75,        B110,       B134,       \
+                        B150,       B200,       B300,       B600,       \
+                        B1200,      B1800,      B2400,      B4800,      \
+                        B9600,      B19200,     B38400,     B57600,     \
+                        B115200,    B230400,    B460800,    B500000,    \
+                        B576000,    B921600,    B1000000,   B1152000,   \
+                        B1500000,   B2000000,   B2500000,   B3000000,   \
+                        B3500000,   B4000000};
+
+static const int bauds[] = \
+                        {50,        75,         110,        134,        \
+                        150,        200,        300,        600,        \
+                        1200,       1800,       2400,       4800,       \
+                        9600,       19200,      38400,      57600,      \
+                        115200,     230400,     460800,     500000,     \
+                        576000,     921600,     1000000,    1152000,    \
+                        1500000,    2000000,    2500000,    3000000,    \
+                        3500000,    4000000};
+
+static const int number_speeds = sizeof(speeds) / sizeof(speeds[0]);
+
+/**
+ * Converts a termios speed value, e.g. B9600, to its rate in bits per second.
+ * @param speed the speed as returned by cfgetispeed() or cfgetospeed().
+ * @return the baud rate or 0 for B0 and unknown speeds.
+ */
+int baud_from_speed(speed_t speed){
+    int i;
+    for (i = 0; i < number_speeds; i++){
+        if (speeds[i] == speed)
+            return bauds[i];
+    }
+    return 0;
+}
+
+/**
+ * Converts a rate in bits per second to its termios speed value.
+ * @param baud the baud rate.
+ * @return the speed value or B0 if there is no standard speed for the rate.
+ */
+speed_t speed_from_baud(int baud){
+    int i;
+    for (i = 0; i < number_speeds; i++){
+        if (bauds[i] == baud)
+            return speeds[i];
+    }
+    return B0;
+}
+
+/**
+ * Enumerates the standard rates, those with a termios speed value.
+ * @param index the index of the rate, from 0 in ascending order.
+ * @return the baud rate or 0 once index is past the last rate.
+ */
+int baud_standard_rate(int index){
+    return index >= 0 && index < number_speeds ? bauds[index] : 0;
+}
+
+/**
+ * Works out the number of bits on the line for each character: the start
+ * bit, data bits, optional parity bit and stop bit(s).
+ * @param l_termios the terminal settings.
+ * @return the number of bits per character.
+ */
+int bits_per_character(const struct termios *l_termios){
+    int bits = 1;
+    switch (l_termios->c_cflag & CSIZE){
+        case CS5: bits += 5; break;
+        case CS6: bits += 6; break;
+        case CS7: bits += 7; break;
+        default:  bits += 8; break;
+    }
+    if (l_termios->c_cflag & PARENB)
+        bits++;
+    bits += (l_termios->c_cflag & CSTOPB) ? 2 : 1;
+    return bits;
+}
+
+/**
+ * Works out how long one character takes to send at the configured speed.
+ * @param l_termios the terminal settings.
+ * @return the character time in nanoseconds or 0 if the speed is unknown.
+ */
+long character_time_nanos(const struct termios *l_termios){
+    int baud = baud_from_speed(cfgetispeed(l_termios));
+    if (baud == 0)
+        baud = baud_from_speed(cfgetospeed(l_termios));
+    if (baud == 0)
+        return 0;
+    return (long) (1000000000LL * bits_per_character(l_termios) / baud);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   baud.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Conversions between termios speed_t values and baud rates in bits per
+ * second, and line timing derived from them.
+ */
+
+#ifndef BAUD_H
+#define	BAUD_H
+
+#include <termios.h>
+
+int baud_from_speed(speed_t speed);
+
+speed_t speed_from_baud(int baud);
+
+int baud_standard_rate(int index);
+
+int bits_per_character(const struct termios *l_termios);
+
+long character_time_nanos(const struct termios *l_termios);
+
+#endif	/* BAUD_H */
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "bridge.h"
+
+static pthread_mutex_t bridges_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct bridge **bridges = NULL;
+static int bridge_capacity = 0;
+
+/*
+ * Turns buffered input into output for a direction whose output has all
+ * been written. Without framing the input is written as it is. With framing
+ * the serial side is decoded into whole frames, each written with a single
+ * write(), and each read() from the other side is encoded as one frame.
+ */
+static void bridge_produce(struct bridge *bridge, int index){
+    struct bridge_direction *direction = &bridge->directions[index];
+    size_t consumed;
+    int length;
+
+    while (direction->pending_length == 0 && direction->in_start < direction->in_end){
+        if (bridge->framing == BRIDGE_FRAMING_NONE){
+            direction->pending = direction->in + direction->in_start;
+            direction->pending_length = direction->in_end - direction->in_start;
+            direction->in_start = direction->in_end;
+        } else if (index == BRIDGE_TO_SERIAL){
+            direction->pending = direction->out;
+            direction->pending_length = stuffing_encode(bridge->framing,
+                                                direction->in + direction->in_start,
+                                                direction->in_end - direction->in_start,
+                                                direction->out);
+            direction->in_start = direction->in_end;
+            direction->frames++;
+        } else {
+            length = stuffing_decoder_feed(&bridge->decoder,
+                                            direction->in + direction->in_start,
+                                            direction->in_end - direction->in_start,
+                                            &consumed, direction->out);
+            direction->in_start += consumed;
+            if (length > 0){
+                direction->pending = direction->out;
+                direction->pending_length = length;
+                direction->frames++;
+            }
+        }
+    }
+}
+
+/*
+ * Thread body. Each direction either waits to read its source or, while it
+ * has output pending, to write its destination. Both descriptors are
+ * non-blocking, so a slow destination holds back its own source only.
+ */
+static void* bridge_thread(void *arg){
+    struct bridge *bridge = (struct bridge*) arg;
+    struct bridge_direction *direction;
+    struct pollfd pfds[3];
+    uint64_t value;
+    ssize_t result;
+    int i;
+
+    thread_config_register();
+    pfds[0].fd = bridge->wake_fd;
+    pfds[0].events = POLLIN;
+    while (!bridge->stopping && bridge->status == 0){
+        for (i = 0; i < 2; i++){
+            direction = &bridge->directions[i];
+            bridge_produce(bridge, i);
+            pfds[i + 1].fd = direction->pending_length > 0 ? direction->to_fd : direction->from_fd;
+            pfds[i + 1].events = direction->pending_length > 0 ? POLLOUT : POLLIN;
+        }
+        if (poll(pfds, 3, -1) == -1){
+            if (errno != EINTR)
+                bridge->status = errno;
+            continue;
+        }
+        if (pfds[0].revents & POLLIN)
+            eventfd_read(bridge->wake_fd, &value);
+        for (i = 0; i < 2 && bridge->status == 0; i++){
+            direction = &bridge->directions[i];
+            if (pfds[i + 1].revents == 0)
+                continue;
+            if (direction->pending_length > 0){
+                result = write(direction->to_fd, direction->pending, direction->pending_length);
+                if (result > 0){
+                    direction->pending += result;
+                    direction->pending_length -= result;
+                    direction->bytes += result;
+                } else if (result == -1 && errno != EINTR && errno != EAGAIN){
+                    bridge->status = errno;
+                }
+                continue;
+            }
+            result = read(direction->from_fd, direction->in, sizeof(direction->in));
+            if (result > 0){
+                direction->in_start = 0;
+                direction->in_end = result;
+            } else if (result == 0){
+                // A serial port may return nothing on a VTIME timeout without hanging up.
+                if (i == BRIDGE_TO_SERIAL || (pfds[i + 1].revents & (POLLHUP | POLLERR)))
+                    bridge->status = -1;
+            } else if (errno != EINTR && errno != EAGAIN){
+                bridge->status = errno;
+            }
+        }
+    }
+    thread_config_unregister();
+    return NULL;
+}
+
+/*
+ * Makes both descriptors non-blocking for the life of the bridge, keeping
+ * their flags to be put back by free_bridge. Returns 0 or an errno value.
+ */
+static int set_nonblocking(struct bridge *bridge, int serial_fd, int other_fd){
+    int fds[2] = {serial_fd, other_fd};
+    int flags, i;
+    for (i = 0; i < 2; i++){
+        flags = fcntl(fds[i], F_GETFL);
+        if (flags == -1 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) == -1)
+            return errno;
+        bridge->saved_flags[i] = flags;
+    }
+    return 0;
+}
+
+static void free_bridge(struct bridge *bridge){
+    if (bridge->saved_flags[0] != -1)
+        fcntl(bridge->directions[BRIDGE_TO_OTHER].from_fd, F_SETFL, bridge->saved_flags[0]);
+    if (bridge->saved_flags[1] != -1)
+        fcntl(bridge->directions[BRIDGE_TO_SERIAL].from_fd, F_SETFL, bridge->saved_flags[1]);
+    if (bridge->wake_fd != -1)
+        close(bridge->wake_fd);
+    free(bridge);
+}
+
+/*
+ * Stores bridge in the first free slot of the table and returns its id, or
+ * -1.
+ */
+static int register_bridge(struct bridge *bridge){
+    int id = -1, i;
+    pthread_mutex_lock(&bridges_lock);
+    for (i = 0; i < bridge_capacity && id == -1; i++){
+        if (bridges[i] == NULL)
+            id = i;
+    }
+    if (id == -1){
+        int capacity = bridge_capacity == 0 ? 16 : bridge_capacity * 2;
+        struct bridge **table = realloc(bridges, capacity * sizeof(*table));
+        if (table != NULL){
+            memset(table + bridge_capacity, 0, (capacity - bridge_capacity) * sizeof(*table));
+            id = bridge_capacity;
+            bridges = table;
+            bridge_capacity = capacity;
+        }
+    }
+    if (id != -1)
+        bridges[id] = bridge;
+    pthread_mutex_unlock(&bridges_lock);
+    return id;
+}
+
+/**
+ * Starts relaying between a serial port and another file descriptor in both
+ * directions until either side reaches end of file or fails, or the bridge
+ * is closed. Both descriptors are made non-blocking until the bridge is
+ * closed and neither should be used otherwise meanwhile. With
+ * framing, frames are byte stuffed on the serial side; on the other side
+ * each frame is one write() and each read() is taken as one frame, which
+ * suits datagram and SOCK_SEQPACKET sockets.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param serial_fd file descriptor of the serial port.
+ * @param other_fd the other file descriptor.
+ * @param framing BRIDGE_FRAMING_NONE or a byte stuffing encoding.
+ * @return the bridge id, for getBridgeStatistics and closeBridge.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_openBridge (JNIEnv *env,
+                                            jobject obj,
+                                            jint serial_fd,
+                                            jint other_fd,
+                                            jint framing){
+    struct bridge *bridge;
+    int id, error;
+
+    if (framing != BRIDGE_FRAMING_NONE && !stuffing_valid_encoding(framing)){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    bridge = calloc(1, sizeof(*bridge));
+    if (bridge == NULL){
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    bridge->saved_flags[0] = bridge->saved_flags[1] = -1;
+    bridge->framing = framing;
+    if (framing != BRIDGE_FRAMING_NONE)
+        stuffing_decoder_init(&bridge->decoder, framing);
+    bridge->directions[BRIDGE_TO_OTHER].from_fd = serial_fd;
+    bridge->directions[BRIDGE_TO_OTHER].to_fd = other_fd;
+    bridge->directions[BRIDGE_TO_SERIAL].from_fd = other_fd;
+    bridge->directions[BRIDGE_TO_SERIAL].to_fd = serial_fd;
+    bridge->wake_fd = eventfd(0, EFD_CLOEXEC);
+    error = bridge->wake_fd == -1 ? errno : set_nonblocking(bridge, serial_fd, other_fd);
+    if (error != 0){
+        free_bridge(bridge);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    id = register_bridge(bridge);
+    if (id == -1){
+        free_bridge(bridge);
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    if ((error = pthread_create(&bridge->thread, NULL, bridge_thread, bridge)) != 0){
+        pthread_mutex_lock(&bridges_lock);
+        bridges[id] = NULL;
+        pthread_mutex_unlock(&bridges_lock);
+        free_bridge(bridge);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return id;
+}
+
+/**
+ * Returns the counters and status of a bridge.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the bridge id returned by openBridge.
+ * @return an array of bytes and frames relayed to the other side, bytes and
+ * frames relayed to the serial port and the status.
+ * @throws IOException if the id is not that of an open bridge.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getBridgeStatistics (JNIEnv *env,
+                                                    jobject obj,
+                                                    jint id){
+    jlong values[BRIDGE_STATISTICS_COUNT];
+    jlongArray return_array;
+    struct bridge *bridge;
+
+    pthread_mutex_lock(&bridges_lock);
+    bridge = id >= 0 && id < bridge_capacity ? bridges[id] : NULL;
+    if (bridge != NULL){
+        values[0] = bridge->directions[BRIDGE_TO_OTHER].bytes;
+        values[1] = bridge->directions[BRIDGE_TO_OTHER].frames;
+        values[2] = bridge->directions[BRIDGE_TO_SERIAL].bytes;
+        values[3] = bridge->directions[BRIDGE_TO_SERIAL].frames;
+        values[4] = bridge->status;
+    }
+    pthread_mutex_unlock(&bridges_lock);
+    if (bridge == NULL){
+        throw_ioexception(env, EINVAL);
+        return NULL;
+    }
+    return_array = (*env)->NewLongArray(env, BRIDGE_STATISTICS_COUNT);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, BRIDGE_STATISTICS_COUNT, values);
+    return return_array;
+}
+
+/**
+ * Stops a bridge. Data read but not yet written is discarded. Neither file
+ * descriptor is closed; both get back their flags from before openBridge.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the bridge id returned by openBridge.
+ * @return 0 upon success or -1 if an error occurs and an exception not thrown.
+ * @throws IOException if the id is not that of an open bridge.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_closeBridge (JNIEnv *env, jobject obj, jint id){
+    struct bridge *bridge = NULL;
+
+    pthread_mutex_lock(&bridges_lock);
+    if (id >= 0 && id < bridge_capacity){
+        bridge = bridges[id];
+        bridges[id] = NULL;
+    }
+    pthread_mutex_unlock(&bridges_lock);
+    if (bridge == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    bridge->stopping = 1;
+    eventfd_write(bridge->wake_fd, 1);
+    pthread_join(bridge->thread, NULL);
+    free_bridge(bridge);
+    return 0;
+}
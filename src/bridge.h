@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   bridge.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Relays between a serial port and another file descriptor, such as a pty,
+ * pipe or socket, on a native thread so that the data never passes through
+ * the JVM.
+ */
+
+#ifndef BRIDGE_H
+#define	BRIDGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include <jni.h>
+#include "jni/com_javatechnics_rs232_Serial.h"
+#include "stuffing.h"
+#include "thread_config.h"
+
+/*
+ Framing for openBridge: none, i.e. bytes are relayed as they come, or a
+ byte stuffing encoding (see stuffing.h) used on the serial side.
+ */
+#define BRIDGE_FRAMING_NONE -1
+
+#define BRIDGE_TO_OTHER     0
+#define BRIDGE_TO_SERIAL    1
+
+/*
+ The statistics handed to Java: bytes and frames (0 without framing)
+ relayed in each direction and the status of the bridge: 0 while it is
+ running, -1 once either side reached end of file or otherwise the errno
+ value that stopped it.
+ */
+#define BRIDGE_STATISTICS_COUNT 5
+
+/*
+ One direction of the bridge. Input is read into in and turned into output,
+ which is written from out before anything more is read.
+ */
+struct bridge_direction {
+    int from_fd;
+    int to_fd;
+    unsigned char in[STUFFING_MAX_FRAME];
+    size_t in_start;
+    size_t in_end;
+    unsigned char out[2 * STUFFING_MAX_FRAME + 2];
+    const unsigned char *pending;
+    size_t pending_length;
+    uint64_t bytes;
+    uint64_t frames;
+};
+
+struct bridge {
+    /*
+     The file status flags of the serial and other descriptor before the
+     bridge made them non-blocking, or -1 if it has not.
+     */
+    int saved_flags[2];
+    int framing;
+    int wake_fd;
+    int stopping;
+    int status;
+    pthread_t thread;
+    struct stuffing_decoder decoder;
+    struct bridge_direction directions[2];
+};
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* BRIDGE_H */
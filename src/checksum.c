@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "checksum.h"
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_HAVE_PCLMUL 1
+/*
+ The carry-less multiply folding needs at least this many bytes and works on
+ multiples of 16 bytes.
+ */
+#define PCLMUL_MINIMUM_LENGTH 64
+#endif
+
+/*
+ Slicing-by-8 tables: table[0] is the classic byte-at-a-time table and
+ table[k] advances a byte through k further zero bytes.
+ */
+static uint32_t crc32_table[8][256];
+static uint16_t crc16_modbus_table[8][256];
+static uint16_t crc16_ccitt_table[8][256];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+#ifdef CHECKSUM_HAVE_PCLMUL
+static int have_pclmul = 0;
+#endif
+
+static void build_tables(void){
+    uint32_t crc;
+    int i, k, bit;
+    for (i = 0; i < 256; i++){
+        crc = i;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        crc32_table[0][i] = crc;
+        crc = i;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        crc16_modbus_table[0][i] = (uint16_t) crc;
+        crc = i << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        crc16_ccitt_table[0][i] = (uint16_t) crc;
+    }
+    for (k = 1; k < 8; k++){
+        for (i = 0; i < 256; i++){
+            crc = crc32_table[k - 1][i];
+            crc32_table[k][i] = (crc >> 8) ^ crc32_table[0][crc & 0xFF];
+            crc = crc16_modbus_table[k - 1][i];
+            crc16_modbus_table[k][i] = (uint16_t) ((crc >> 8) ^ crc16_modbus_table[0][crc & 0xFF]);
+            crc = crc16_ccitt_table[k - 1][i];
+            crc16_ccitt_table[k][i] = (uint16_t) ((crc << 8) ^ crc16_ccitt_table[0][crc >> 8]);
+        }
+    }
+#ifdef CHECKSUM_HAVE_PCLMUL
+    __builtin_cpu_init();
+    have_pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static inline uint32_t load_le32(const unsigned char *data){
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/*
+ * Slicing-by-8 for the reflected CRCs. Both fit in 32 bits so one routine
+ * serves CRC32 and the reflected CRC16 by passing the matching tables.
+ */
+#define SLICE8_REFLECTED(table, crc, data, length) \
+    while (length >= 8){ \
+        uint32_t low = crc ^ load_le32(data); \
+        uint32_t high = load_le32(data + 4); \
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] \
+            ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] \
+            ^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] \
+            ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24]; \
+        data += 8; \
+        length -= 8; \
+    } \
+    while (length-- > 0) \
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+
+#ifdef CHECKSUM_HAVE_PCLMUL
+/*
+ * CRC32 by carry-less multiplication, folding 64 bytes at a time (Intel,
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"). The crc
+ * is the raw, uninverted register. length must be a multiple of 16 and at
+ * least PCLMUL_MINIMUM_LENGTH.
+ */
+__attribute__ ((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *data, size_t length){
+    static const uint64_t k1k2[] __attribute__ ((aligned(16))) = {0x0154442bd4ULL, 0x01c6e41596ULL};
+    static const uint64_t k3k4[] __attribute__ ((aligned(16))) = {0x01751997d0ULL, 0x00ccaa009eULL};
+    static const uint64_t k5k0[] __attribute__ ((aligned(16))) = {0x0163cd6124ULL, 0x0000000000ULL};
+    static const uint64_t poly[] __attribute__ ((aligned(16))) = {0x01db710641ULL, 0x01f7011641ULL};
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*) (data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*) (data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*) (data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*) (data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i*) k1k2);
+    data += 64;
+    length -= 64;
+
+    // Fold four lanes in parallel.
+    while (length >= 64){
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i*) (data + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*) (data + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*) (data + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*) (data + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        data += 64;
+        length -= 64;
+    }
+
+    // Fold the four lanes into one.
+    x0 = _mm_load_si128((const __m128i*) k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Fold any remaining 16 byte blocks.
+    while (length >= 16){
+        x2 = _mm_loadu_si128((const __m128i*) data);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        data += 16;
+        length -= 16;
+    }
+
+    // Fold 128 bits down to 64.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*) k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits.
+    x0 = _mm_load_si128((const __m128i*) poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t) _mm_extract_epi32(x1, 1);
+}
+#endif
+
+/**
+ * Calculates the CRC32 used by zlib, Ethernet and PNG.
+ * @param crc the CRC so far, 0 to start.
+ * @param data the bytes to add.
+ * @param length the number of bytes.
+ * @return the updated CRC.
+ */
+uint32_t checksum_crc32(uint32_t crc, const unsigned char *data, size_t length){
+    pthread_once(&tables_once, build_tables);
+    crc = ~crc;
+#if defined(__ARM_FEATURE_CRC32)
+    while (length >= 8){
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32d(crc, word);
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0)
+        crc = __crc32b(crc, *data++);
+#else
+#ifdef CHECKSUM_HAVE_PCLMUL
+    if (have_pclmul && length >= PCLMUL_MINIMUM_LENGTH){
+        size_t blocks = length & ~(size_t) 15;
+        crc = crc32_pclmul(crc, data, blocks);
+        data += blocks;
+        length -= blocks;
+    }
+#endif
+    SLICE8_REFLECTED(crc32_table, crc, data, length)
+#endif
+    return ~crc;
+}
+
+/**
+ * Calculates the CRC16 used by Modbus RTU.
+ * @param crc the CRC so far, 0xFFFF to start.
+ * @param data the bytes to add.
+ * @param length the number of bytes.
+ * @return the updated CRC. It is sent low byte first.
+ */
+uint16_t checksum_crc16_modbus(uint16_t crc, const unsigned char *data, size_t length){
+    uint32_t value = crc;
+    pthread_once(&tables_once, build_tables);
+    SLICE8_REFLECTED(crc16_modbus_table, value, data, length)
+    return (uint16_t) value;
+}
+
+/**
+ * Calculates the CRC16-CCITT (polynomial 0x1021, most significant bit
+ * first, no final XOR).
+ * @param crc the CRC so far: 0xFFFF to start for CCITT-FALSE or 0 for XMODEM.
+ * @param data the bytes to add.
+ * @param length the number of bytes.
+ * @return the updated CRC.
+ */
+uint16_t checksum_crc16_ccitt(uint16_t crc, const unsigned char *data, size_t length){
+    pthread_once(&tables_once, build_tables);
+    while (length >= 8){
+        crc = crc16_ccitt_table[7][(data[0] ^ (crc >> 8)) & 0xFF]
+            ^ crc16_ccitt_table[6][(data[1] ^ crc) & 0xFF]
+            ^ crc16_ccitt_table[5][data[2]] ^ crc16_ccitt_table[4][data[3]]
+            ^ crc16_ccitt_table[3][data[4]] ^ crc16_ccitt_table[2][data[5]]
+            ^ crc16_ccitt_table[1][data[6]] ^ crc16_ccitt_table[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0)
+        crc = (uint16_t) ((crc << 8) ^ crc16_ccitt_table[0][((crc >> 8) ^ *data++) & 0xFF]);
+    return crc;
+}
+
+/**
+ * Checks that an algorithm selector is one this module knows about.
+ * @param algorithm the algorithm selector.
+ * @return non-zero if the algorithm is valid.
+ */
+int checksum_valid_algorithm(int algorithm){
+    return algorithm >= 0 && algorithm < NUMBER_CHECKSUM_ALGORITHMS;
+}
+
+/**
+ * Adds bytes to a running checksum of any of the supported algorithms.
+ * @param algorithm the algorithm selector, one of CHECKSUM_*.
+ * @param value the checksum so far; see checksum.h for the start values.
+ * @param data the bytes to add.
+ * @param length the number of bytes.
+ * @return the updated checksum or value unchanged if the algorithm is unknown.
+ */
+uint32_t checksum_update(int algorithm, uint32_t value,
+                            const unsigned char *data, size_t length){
+    unsigned int sum = 0;
+    size_t i;
+    switch (algorithm){
+        case CHECKSUM_CRC16_MODBUS:
+            return checksum_crc16_modbus((uint16_t) value, data, length);
+        case CHECKSUM_CRC16_CCITT:
+            return checksum_crc16_ccitt((uint16_t) value, data, length);
+        case CHECKSUM_CRC32:
+            return checksum_crc32(value, data, length);
+        case CHECKSUM_XOR:
+            for (i = 0; i < length; i++)
+                sum ^= data[i];
+            return (value ^ sum) & 0xFF;
+        case CHECKSUM_SUM8:
+            for (i = 0; i < length; i++)
+                sum += data[i];
+            return (value + sum) & 0xFF;
+        case CHECKSUM_LRC:
+            for (i = 0; i < length; i++)
+                sum += data[i];
+            return (value - sum) & 0xFF;
+    }
+    return value;
+}
+
+/**
+ * Calculates a checksum over part of a Java byte array.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param algorithm the algorithm selector.
+ * @param value the checksum so far.
+ * @param buffer the data.
+ * @param offset the offset of the first byte in buffer.
+ * @param length the number of bytes.
+ * @return the updated checksum.
+ * @throws IOException if the algorithm is unknown.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_util_Checksum_nativeUpdate (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint algorithm,
+                                                        jint value,
+                                                        jbyteArray buffer,
+                                                        jint offset,
+                                                        jint length){
+    unsigned char *data;
+    if (!checksum_valid_algorithm(algorithm) || offset < 0 || length < 0
+            || offset + length > (*env)->GetArrayLength(env, buffer)){
+        throw_ioexception(env, EINVAL);
+        return value;
+    }
+    // The array is only pinned for the duration of the calculation.
+    data = (*env)->GetPrimitiveArrayCritical(env, buffer, NULL);
+    if (data == NULL)
+        return value;
+    value = (jint) checksum_update(algorithm, (uint32_t) value, data + offset, length);
+    (*env)->ReleasePrimitiveArrayCritical(env, buffer, data, JNI_ABORT);
+    return value;
+}
+
+/**
+ * Calculates a checksum over part of a direct ByteBuffer without copying it.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param algorithm the algorithm selector.
+ * @param value the checksum so far.
+ * @param buffer the direct buffer holding the data.
+ * @param offset the offset of the first byte in buffer.
+ * @param length the number of bytes.
+ * @return the updated checksum.
+ * @throws IOException if the algorithm is unknown or the buffer is not direct.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_util_Checksum_nativeUpdateDirect (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint algorithm,
+                                                        jint value,
+                                                        jobject buffer,
+                                                        jint offset,
+                                                        jint length){
+    unsigned char *data = (*env)->GetDirectBufferAddress(env, buffer);
+    if (data == NULL || !checksum_valid_algorithm(algorithm) || offset < 0 || length < 0
+            || offset + length > (*env)->GetDirectBufferCapacity(env, buffer)){
+        throw_ioexception(env, EINVAL);
+        return value;
+    }
+    return (jint) checksum_update(algorithm, (uint32_t) value, data + offset, length);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   checksum.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * CRC and simple checksums used by serial protocols.
+ */
+
+#ifndef CHECKSUM_H
+#define	CHECKSUM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <syslog.h>
+#include "jni/com_javatechnics_rs232_util_Checksum.h"
+
+/*
+ Algorithm selectors. These match the constants in the Java Checksum class.
+ The value passed to and returned from checksum_update() is the running
+ checksum; the start value for each algorithm is given alongside.
+ */
+#define CHECKSUM_CRC16_MODBUS   0   /* reflected 0x8005, start 0xFFFF */
+#define CHECKSUM_CRC16_CCITT    1   /* 0x1021, start 0xFFFF or 0x0000 (XMODEM) */
+#define CHECKSUM_CRC32          2   /* reflected 0x04C11DB7 as zlib, start 0 */
+#define CHECKSUM_XOR            3   /* XOR of all bytes, start 0 */
+#define CHECKSUM_SUM8           4   /* 8-bit sum of all bytes, start 0 */
+#define CHECKSUM_LRC            5   /* two's complement of SUM8, start 0 */
+
+#define NUMBER_CHECKSUM_ALGORITHMS 6
+
+int checksum_valid_algorithm(int algorithm);
+
+uint32_t checksum_update(int algorithm, uint32_t value,
+                            const unsigned char *data, size_t length);
+
+uint16_t checksum_crc16_modbus(uint16_t crc, const unsigned char *data, size_t length);
+
+uint16_t checksum_crc16_ccitt(uint16_t crc, const unsigned char *data, size_t length);
+
+uint32_t checksum_crc32(uint32_t crc, const unsigned char *data, size_t length);
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* CHECKSUM_H */
@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "coalesce.h"
+
+/*
+ A single flusher thread serves the deadlines of every port. It runs while
+ any port has coalescing enabled.
+ */
+static pthread_mutex_t flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_wake;
+static pthread_cond_t flusher_done;
+static pthread_once_t flusher_once = PTHREAD_ONCE_INIT;
+static struct coalescer *coalescers = NULL;
+static int flusher_running = 0;
+
+static uint64_t now_nanos(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void init_flusher(void){
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&flusher_wake, &attributes);
+    pthread_cond_init(&flusher_done, &attributes);
+    pthread_condattr_destroy(&attributes);
+}
+
+/*
+ * Writes all of a buffer straight to the port. With a coalescer, whose lock
+ * the caller holds, writes do not block and stop waiting for room once the
+ * port is being closed, so that flow control cannot hold up close.
+ */
+static int write_all(struct serial_port *port, struct coalescer *coalescer,
+                        const unsigned char *data, size_t length){
+    size_t written = 0;
+    ssize_t result;
+    while (written < length){
+        if (coalescer == NULL)
+            result = port_write(port, data + written, length - written);
+        else
+            result = port_write_nonblocking(port, data + written, length - written);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN || coalescer == NULL)
+                return -1;
+            if (coalescer->closing){
+                // What is left is discarded, as by any write to a closed port.
+                errno = EBADF;
+                return -1;
+            }
+            if (port_wait_writable(port, -1, COALESCE_WRITE_WAIT_MILLIS) == -1)
+                return -1;
+            continue;
+        }
+        if (coalescer != NULL)
+            coalescer->system_calls++;
+        written += result;
+    }
+    return 0;
+}
+
+/*
+ * Writes out the buffer. Called with the coalescer lock held.
+ */
+static int flush_buffer(struct coalescer *coalescer){
+    int result = write_all(coalescer->port, coalescer, coalescer->buffer, coalescer->length);
+    // On failure the unwritten data is discarded, as it would be by write().
+    coalescer->length = 0;
+    return result;
+}
+
+/*
+ * Thread body. Sleeps until the earliest deadline of any port, then writes
+ * out each port whose oldest buffered byte has waited long enough.
+ */
+static void* flusher_thread(void *arg){
+    struct coalescer *coalescer, *due;
+    struct timespec wake;
+    uint64_t now, earliest;
+
+    thread_config_register();
+    pthread_mutex_lock(&flusher_lock);
+    while (coalescers != NULL){
+        now = now_nanos();
+        due = NULL;
+        earliest = 0;
+        for (coalescer = coalescers; coalescer != NULL; coalescer = coalescer->next){
+            if (coalescer->due == 0)
+                continue;
+            if (coalescer->due <= now){
+                due = coalescer;
+                break;
+            }
+            if (earliest == 0 || coalescer->due < earliest)
+                earliest = coalescer->due;
+        }
+        if (due == NULL){
+            if (earliest == 0){
+                pthread_cond_wait(&flusher_wake, &flusher_lock);
+            } else {
+                wake.tv_sec = earliest / 1000000000ULL;
+                wake.tv_nsec = earliest % 1000000000ULL;
+                pthread_cond_timedwait(&flusher_wake, &flusher_lock, &wake);
+            }
+            continue;
+        }
+        // Pin the coalescer so it is not freed while its lock is taken.
+        due->due = 0;
+        due->busy++;
+        pthread_mutex_unlock(&flusher_lock);
+        pthread_mutex_lock(&due->lock);
+        earliest = 0;
+        if (due->length > 0){
+            if (due->first_pending + due->deadline <= now_nanos()){
+                due->deadline_flushes++;
+                flush_buffer(due);
+            } else {
+                // Flushed and refilled since the deadline was set.
+                earliest = due->first_pending + due->deadline;
+            }
+        }
+        pthread_mutex_unlock(&due->lock);
+        pthread_mutex_lock(&flusher_lock);
+        if (earliest != 0 && (due->due == 0 || earliest < due->due))
+            due->due = earliest;
+        due->busy--;
+        pthread_cond_broadcast(&flusher_done);
+    }
+    flusher_running = 0;
+    pthread_mutex_unlock(&flusher_lock);
+    thread_config_unregister();
+    return NULL;
+}
+
+static int add_coalescer(struct coalescer *coalescer){
+    pthread_t thread;
+    int error = 0;
+    pthread_once(&flusher_once, init_flusher);
+    pthread_mutex_lock(&flusher_lock);
+    if (!flusher_running){
+        error = pthread_create(&thread, NULL, flusher_thread, NULL);
+        if (error == 0){
+            pthread_detach(thread);
+            flusher_running = 1;
+        }
+    }
+    if (error == 0){
+        coalescer->next = coalescers;
+        coalescers = coalescer;
+    }
+    pthread_mutex_unlock(&flusher_lock);
+    return error;
+}
+
+/*
+ * Unlinks a coalescer from the flusher and waits until the flusher is done
+ * with it.
+ */
+static void remove_coalescer(struct coalescer *coalescer){
+    struct coalescer **link;
+    pthread_mutex_lock(&flusher_lock);
+    for (link = &coalescers; *link != NULL; link = &(*link)->next){
+        if (*link == coalescer){
+            *link = coalescer->next;
+            break;
+        }
+    }
+    while (coalescer->busy > 0)
+        pthread_cond_wait(&flusher_done, &flusher_lock);
+    pthread_cond_signal(&flusher_wake);
+    pthread_mutex_unlock(&flusher_lock);
+}
+
+/*
+ * Writes out anything still buffered and frees a coalescer once it has been
+ * detached from its port. When the port is being closed, only what the
+ * driver takes at once is written and the rest is discarded.
+ */
+static void free_coalescer(struct coalescer *coalescer){
+    remove_coalescer(coalescer);
+    pthread_mutex_lock(&coalescer->lock);
+    if (coalescer->length > 0)
+        flush_buffer(coalescer);
+    pthread_mutex_unlock(&coalescer->lock);
+    pthread_mutex_destroy(&coalescer->lock);
+    free(coalescer->buffer);
+    free(coalescer);
+}
+
+static void stop_coalescer(struct port_helper *helper){
+    struct coalescer *coalescer = (struct coalescer*) helper;
+    coalescer->port->coalescer = NULL;
+    // The port lock is held: no flush, even one in progress, may wait for room.
+    __sync_lock_test_and_set(&coalescer->closing, 1);
+    free_coalescer(coalescer);
+}
+
+/*
+ * Returns the locked coalescer of a port or NULL if coalescing is off.
+ */
+static struct coalescer* lock_coalescer(struct serial_port *port){
+    struct coalescer *coalescer;
+    pthread_mutex_lock(&port->lock);
+    coalescer = port->coalescer;
+    if (coalescer != NULL)
+        pthread_mutex_lock(&coalescer->lock);
+    pthread_mutex_unlock(&port->lock);
+    return coalescer;
+}
+
+/**
+ * Turns write coalescing on or off for a port, or changes its settings.
+ * Anything already buffered is written out first.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param threshold the number of buffered bytes that causes a write, up to
+ * COALESCE_MAX_THRESHOLD, or 0 to turn coalescing off.
+ * @param deadline_micros the longest a byte may wait in the buffer.
+ * @return 0 upon success.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setWriteCoalescing (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle,
+                                                    jint threshold,
+                                                    jint deadline_micros){
+    struct serial_port *port;
+    struct coalescer *coalescer = NULL, *previous;
+    int error = 0;
+
+    if (threshold < 0 || threshold > COALESCE_MAX_THRESHOLD || deadline_micros < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    if (threshold > 0){
+        coalescer = calloc(1, sizeof(*coalescer));
+        if (coalescer == NULL || (coalescer->buffer = malloc(threshold)) == NULL){
+            free(coalescer);
+            port_release(port);
+            throw_ioexception(env, ENOMEM);
+            return -1;
+        }
+        pthread_mutex_init(&coalescer->lock, NULL);
+        coalescer->helper.stop = stop_coalescer;
+        coalescer->port = port;
+        coalescer->threshold = threshold;
+        coalescer->deadline = (uint64_t) deadline_micros * 1000;
+    }
+    pthread_mutex_lock(&port->lock);
+    previous = port->coalescer;
+    if (coalescer != NULL && port->shutdown)
+        error = EBADF;
+    else if (coalescer != NULL && (error = add_coalescer(coalescer)) == 0)
+        port_add_helper(port, &coalescer->helper);
+    if (error == 0){
+        port->coalescer = coalescer;
+        if (previous != NULL)
+            port_detach_helper(port, &previous->helper);
+    }
+    pthread_mutex_unlock(&port->lock);
+    if (error == 0 && previous != NULL){
+        // The counters carry over to the new settings.
+        if (coalescer != NULL){
+            pthread_mutex_lock(&previous->lock);
+            coalescer->bytes = previous->bytes;
+            coalescer->calls = previous->calls;
+            coalescer->system_calls = previous->system_calls;
+            coalescer->threshold_flushes = previous->threshold_flushes;
+            coalescer->deadline_flushes = previous->deadline_flushes;
+            coalescer->explicit_flushes = previous->explicit_flushes;
+            pthread_mutex_unlock(&previous->lock);
+        }
+        free_coalescer(previous);
+    }
+    port_release(port);
+    if (error != 0){
+        if (coalescer != NULL){
+            pthread_mutex_destroy(&coalescer->lock);
+            free(coalescer->buffer);
+            free(coalescer);
+        }
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the counters of the write coalescing of a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return an array of COALESCE_STATISTICS_COUNT values, all 0 if coalescing
+ * is off.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getCoalescingStatistics (JNIEnv *env,
+                                                        jobject obj,
+                                                        jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct coalescer *coalescer;
+    jlong values[COALESCE_STATISTICS_COUNT];
+    jlongArray return_array;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    bzero(values, sizeof(values));
+    coalescer = lock_coalescer(port);
+    if (coalescer != NULL){
+        values[0] = coalescer->bytes;
+        values[1] = coalescer->calls;
+        values[2] = coalescer->system_calls;
+        values[3] = coalescer->threshold_flushes;
+        values[4] = coalescer->deadline_flushes;
+        values[5] = coalescer->explicit_flushes;
+        pthread_mutex_unlock(&coalescer->lock);
+    }
+    port_release(port);
+    return_array = (*env)->NewLongArray(env, COALESCE_STATISTICS_COUNT);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, COALESCE_STATISTICS_COUNT, values);
+    return return_array;
+}
+
+/**
+ * Writes to a port through its coalescing buffer. The data is buffered
+ * unless that would take the buffer past its threshold, in which case the
+ * buffer is written out first; data at least as long as the threshold is
+ * then written directly. Without coalescing this is the same as writePort.
+ * @param env pointer to the JNI environment.
+ * @param jobj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array holding the data to write.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the number of bytes to write.
+ * @return the number of bytes accepted.
+ * @throws IOException if an error occurs or the handle is not that of an
+ * open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortOutputStream_writeCoalesced (JNIEnv *env,
+                                                                    jobject jobj,
+                                                                    jlong handle,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length){
+    struct serial_port *port;
+    struct coalescer *coalescer;
+    unsigned char *data = NULL;
+    int error = 0, set_due = 0;
+    uint64_t due = 0;
+
+    if (length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    coalescer = lock_coalescer(port);
+    if (coalescer == NULL || (size_t) length >= coalescer->threshold){
+        data = malloc(length > 0 ? length : 1);
+        if (data == NULL){
+            error = ENOMEM;
+        } else {
+            (*env)->GetByteArrayRegion(env, buffer, offset, length, (jbyte*) data);
+            if ((*env)->ExceptionCheck(env))
+                error = -1;
+        }
+        if (error == 0 && coalescer != NULL){
+            coalescer->bytes += length;
+            coalescer->calls++;
+            if (coalescer->length > 0){
+                coalescer->threshold_flushes++;
+                if (flush_buffer(coalescer) == -1)
+                    error = errno;
+            }
+        }
+        if (error == 0 && write_all(port, coalescer, data, length) == -1)
+            error = errno;
+    } else {
+        if (coalescer->length + length > coalescer->threshold){
+            coalescer->threshold_flushes++;
+            if (flush_buffer(coalescer) == -1)
+                error = errno;
+        }
+        if (error == 0){
+            (*env)->GetByteArrayRegion(env, buffer, offset, length,
+                                        (jbyte*) coalescer->buffer + coalescer->length);
+            if ((*env)->ExceptionCheck(env))
+                error = -1;
+        }
+        if (error == 0 && length > 0){
+            if (coalescer->length == 0){
+                coalescer->first_pending = now_nanos();
+                due = coalescer->first_pending + coalescer->deadline;
+                set_due = 1;
+            }
+            coalescer->length += length;
+            coalescer->bytes += length;
+            coalescer->calls++;
+            if (coalescer->length == coalescer->threshold){
+                coalescer->threshold_flushes++;
+                set_due = 0;
+                if (flush_buffer(coalescer) == -1)
+                    error = errno;
+            }
+        }
+    }
+    if (set_due){
+        pthread_mutex_lock(&flusher_lock);
+        if (coalescer->due == 0 || due < coalescer->due){
+            coalescer->due = due;
+            pthread_cond_signal(&flusher_wake);
+        }
+        pthread_mutex_unlock(&flusher_lock);
+    }
+    if (coalescer != NULL)
+        pthread_mutex_unlock(&coalescer->lock);
+    port_release(port);
+    free(data);
+    if (error != 0){
+        if (error != -1)
+            throw_ioexception(env, error);
+        return -1;
+    }
+    return length;
+}
+
+/**
+ * Writes out anything held in the coalescing buffer of a port.
+ * @param env pointer to the JNI environment.
+ * @param jobj the calling Java object.
+ * @param handle the handle of the port.
+ * @return 0 upon success.
+ * @throws IOException if an error occurs or the handle is not that of an
+ * open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortOutputStream_flushPort (JNIEnv *env,
+                                                                jobject jobj,
+                                                                jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct coalescer *coalescer;
+    int error = 0;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    coalescer = lock_coalescer(port);
+    if (coalescer != NULL){
+        if (coalescer->length > 0){
+            coalescer->explicit_flushes++;
+            if (flush_buffer(coalescer) == -1)
+                error = errno;
+        }
+        pthread_mutex_unlock(&coalescer->lock);
+    }
+    port_release(port);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return 0;
+}
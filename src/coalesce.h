@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   coalesce.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Write coalescing: small writes to a port are gathered in a native buffer
+ * and written with one system call once the buffer reaches a threshold, on
+ * an explicit flush or when the oldest buffered byte has waited a set
+ * deadline, whichever comes first.
+ */
+
+#ifndef COALESCE_H
+#define	COALESCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <syslog.h>
+#include "jni/com_javatechnics_rs232_stream_SerialPortOutputStream.h"
+#include "port.h"
+#include "thread_config.h"
+
+#define COALESCE_MAX_THRESHOLD (64 * 1024)
+
+/*
+ The statistics handed to Java: bytes accepted, write calls accepted,
+ write() system calls made and flushes by threshold, by deadline and on
+ request.
+ */
+#define COALESCE_STATISTICS_COUNT 6
+
+/*
+ How long a flush waits for the driver to have room before it looks again
+ whether the port is being closed.
+ */
+#define COALESCE_WRITE_WAIT_MILLIS 10
+
+struct coalescer {
+    struct port_helper helper;
+    struct serial_port *port;
+    /* Set without the lock when the port is closed; flushes stop waiting. */
+    int closing;
+    /* Held while the buffer is used or written out. */
+    pthread_mutex_t lock;
+    unsigned char *buffer;
+    size_t length;
+    size_t threshold;
+    uint64_t deadline;
+    /* When the oldest buffered byte was accepted. */
+    uint64_t first_pending;
+    uint64_t bytes;
+    uint64_t calls;
+    uint64_t system_calls;
+    uint64_t threshold_flushes;
+    uint64_t deadline_flushes;
+    uint64_t explicit_flushes;
+    /* The rest is guarded by the flusher's lock. */
+    uint64_t due;
+    int busy;
+    struct coalescer *next;
+};
+
+#endif	/* COALESCE_H */
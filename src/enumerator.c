@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "enumerator.h"
+
+/*
+ The change list is bounded so that a caller that never asks for changes
+ does not grow it forever. The oldest changes are discarded first.
+ */
+#define MAX_PORT_CHANGES 4096
+
+struct port_list {
+    struct port_info *entries;
+    int count;
+    int capacity;
+};
+
+static pthread_mutex_t enumerator_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct port_list port_cache;
+static struct port_list port_changes;
+static int inotify_fd = -1;
+
+/*
+ * Reads a single line sysfs attribute into buffer, without the trailing
+ * newline. Returns 0 upon success or -1 if the attribute cannot be read.
+ */
+static int read_sysfs_string(const char *path, char *buffer, size_t size){
+    int fd, result;
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    result = read(fd, buffer, size - 1);
+    close(fd);
+    if (result < 0)
+        return -1;
+    buffer[result] = '\0';
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return 0;
+}
+
+/**
+ * Fills in a port_info for the tty of the given name from sysfs. Only ttys
+ * backed by a device (i.e. not virtual consoles or ptys) are reported.
+ * @param name the tty name, e.g. "ttyUSB0".
+ * @param info the structure to fill in.
+ * @return 0 if the tty is a serial port or -1 if it is not.
+ */
+static int probe_port(const char *name, struct port_info *info){
+    char path[PATH_MAX + 32], link[PATH_MAX], device[PATH_MAX], value[PORT_INFO_STRING_LENGTH];
+    char *slash;
+    int length;
+
+    if (strlen(name) >= PORT_INFO_NAME_LENGTH)
+        return -1;
+    snprintf(path, sizeof(path), "%s/%s/device", SYSFS_TTY_DIRECTORY, name);
+    if (realpath(path, device) == NULL)
+        return -1;
+
+    bzero(info, sizeof(*info));
+    strcpy(info->name, name);
+    info->attached = 1;
+
+    snprintf(path, sizeof(path), "%s/%s/device/driver", SYSFS_TTY_DIRECTORY, name);
+    length = readlink(path, link, sizeof(link) - 1);
+    if (length > 0){
+        link[length] = '\0';
+        slash = strrchr(link, '/');
+        strncpy(info->driver, slash != NULL ? slash + 1 : link, sizeof(info->driver) - 1);
+    }
+
+    // Serial core ports report the UART type; 0 is PORT_UNKNOWN, i.e. the
+    // port is registered but there is no UART behind it.
+    snprintf(path, sizeof(path), "%s/%s/type", SYSFS_TTY_DIRECTORY, name);
+    if (read_sysfs_string(path, value, sizeof(value)) == 0)
+        info->uart_present = atoi(value) != 0;
+    else
+        info->uart_present = 1;
+
+    // Walk up the device tree looking for the USB device the port hangs off.
+    while ((slash = strrchr(device, '/')) != NULL && slash != device){
+        snprintf(path, sizeof(path), "%s/idVendor", device);
+        if (read_sysfs_string(path, value, sizeof(value)) == 0){
+            info->vendor_id = (int) strtol(value, NULL, 16);
+            snprintf(path, sizeof(path), "%s/idProduct", device);
+            if (read_sysfs_string(path, value, sizeof(value)) == 0)
+                info->product_id = (int) strtol(value, NULL, 16);
+            snprintf(path, sizeof(path), "%s/serial", device);
+            read_sysfs_string(path, info->serial_number, sizeof(info->serial_number));
+            break;
+        }
+        *slash = '\0';
+    }
+    return 0;
+}
+
+static int find_port(const struct port_list *list, const char *name){
+    int i;
+    for (i = 0; i < list->count; i++){
+        if (strcmp(list->entries[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int append_port(struct port_list *list, const struct port_info *info){
+    if (list->count == list->capacity){
+        int capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        struct port_info *entries = realloc(list->entries, capacity * sizeof(*entries));
+        if (entries == NULL)
+            return -1;
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+    list->entries[list->count++] = *info;
+    return 0;
+}
+
+static void remove_port(struct port_list *list, int index){
+    memmove(&list->entries[index], &list->entries[index + 1],
+            (list->count - index - 1) * sizeof(list->entries[0]));
+    list->count--;
+}
+
+static void record_change(const struct port_info *info){
+    if (port_changes.count == MAX_PORT_CHANGES)
+        remove_port(&port_changes, 0);
+    append_port(&port_changes, info);
+}
+
+/*
+ * Updates the cache for a single tty that has appeared in or disappeared from
+ * /dev, recording the change if the set of serial ports was affected.
+ */
+static void update_port(const char *name, int attached){
+    struct port_info info;
+    int index = find_port(&port_cache, name);
+    if (attached && probe_port(name, &info) == 0){
+        if (index == -1)
+            append_port(&port_cache, &info);
+        else
+            port_cache.entries[index] = info;
+        record_change(&info);
+    } else if (!attached && index != -1){
+        info = port_cache.entries[index];
+        info.attached = 0;
+        remove_port(&port_cache, index);
+        record_change(&info);
+    }
+}
+
+/*
+ * Rebuilds the cache from a complete scan of sysfs. If report_changes is set
+ * the differences from the previous cache are recorded as changes.
+ */
+static int scan_ports(int report_changes){
+    struct port_list scanned = {NULL, 0, 0};
+    struct port_info info;
+    struct dirent *entry;
+    DIR *directory;
+    int i;
+
+    directory = opendir(SYSFS_TTY_DIRECTORY);
+    if (directory == NULL)
+        return -1;
+    while ((entry = readdir(directory)) != NULL){
+        if (entry->d_name[0] == '.')
+            continue;
+        if (probe_port(entry->d_name, &info) == 0)
+            append_port(&scanned, &info);
+    }
+    closedir(directory);
+
+    if (report_changes){
+        for (i = 0; i < port_cache.count; i++){
+            if (find_port(&scanned, port_cache.entries[i].name) == -1){
+                info = port_cache.entries[i];
+                info.attached = 0;
+                record_change(&info);
+            }
+        }
+        for (i = 0; i < scanned.count; i++){
+            if (find_port(&port_cache, scanned.entries[i].name) == -1)
+                record_change(&scanned.entries[i]);
+        }
+    }
+    free(port_cache.entries);
+    port_cache = scanned;
+    return 0;
+}
+
+/*
+ * Sets up the /dev watch and the initial cache. The watch is created first
+ * so that no port can slip in between the scan and the watch.
+ * Must be called with enumerator_lock held.
+ */
+static int enumerator_init(void){
+    if (inotify_fd != -1)
+        return 0;
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+        return -1;
+    if (inotify_add_watch(inotify_fd, DEVICE_DIRECTORY,
+                IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) == -1
+            || scan_ports(0) == -1){
+        int error = errno;
+        close(inotify_fd);
+        inotify_fd = -1;
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Applies all pending hotplug events to the cache.
+ * Must be called with enumerator_lock held.
+ */
+static void process_events(void){
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t length;
+    char *position;
+
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0){
+        for (position = buffer; position < buffer + length;
+                position += sizeof(struct inotify_event) + event->len){
+            event = (const struct inotify_event*) position;
+            if (event->mask & IN_Q_OVERFLOW){
+                // Events were lost so fall back to a full rescan.
+                scan_ports(1);
+            } else if (event->len > 0){
+                update_port(event->name, (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0);
+            }
+        }
+    }
+}
+
+/*
+ * Converts a list of port_info into a Java SerialPortInfo[] array.
+ */
+static jobjectArray new_port_info_array(JNIEnv *env, const struct port_list *list){
+    jfieldID field_ids[JAVA_PORT_INFO_FIELD_COUNT];
+    jobjectArray return_array;
+    jclass info_class;
+    jmethodID cid;
+    char path[PATH_MAX];
+    int i;
+
+    info_class = (*env)->FindClass(env, SERIAL_PORT_INFO_CLASS_STRING);
+    if (info_class == NULL)
+        return NULL;
+    cid = (*env)->GetMethodID(env, info_class, "<init>", "()V");
+    if (cid == NULL)
+        return NULL;
+    if (get_field_ids(env, info_class, java_port_info_fields,
+                        java_port_info_field_descriptors,
+                        field_ids, JAVA_PORT_INFO_FIELD_COUNT) != 0)
+        return NULL;
+    return_array = (*env)->NewObjectArray(env, list->count, info_class, NULL);
+    if (return_array == NULL)
+        return NULL;
+    for (i = 0; i < list->count; i++){
+        const struct port_info *info = &list->entries[i];
+        jobject object = (*env)->NewObject(env, info_class, cid);
+        if (object == NULL)
+            return NULL;
+        snprintf(path, sizeof(path), "%s/%s", DEVICE_DIRECTORY, info->name);
+        (*env)->SetObjectField(env, object, field_ids[0], (*env)->NewStringUTF(env, info->name));
+        (*env)->SetObjectField(env, object, field_ids[1], (*env)->NewStringUTF(env, path));
+        (*env)->SetObjectField(env, object, field_ids[2], (*env)->NewStringUTF(env, info->driver));
+        (*env)->SetIntField(env, object, field_ids[3], info->vendor_id);
+        (*env)->SetIntField(env, object, field_ids[4], info->product_id);
+        (*env)->SetObjectField(env, object, field_ids[5], (*env)->NewStringUTF(env, info->serial_number));
+        (*env)->SetBooleanField(env, object, field_ids[6], info->uart_present ? JNI_TRUE : JNI_FALSE);
+        (*env)->SetBooleanField(env, object, field_ids[7], info->attached ? JNI_TRUE : JNI_FALSE);
+        (*env)->SetObjectArrayElement(env, return_array, i, object);
+        (*env)->DeleteLocalRef(env, object);
+        if ((*env)->ExceptionCheck(env))
+            return NULL;
+    }
+    return return_array;
+}
+
+/**
+ * Returns the serial ports currently present on the system. The first call
+ * scans /sys/class/tty; later calls are served from a cache that is kept up
+ * to date by watching /dev for ports being added or removed.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @return an array of SerialPortInfo objects, one per port.
+ * @throws IOException if the ports cannot be enumerated.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_javatechnics_rs232_Serial_getSerialPorts (JNIEnv *env, jobject obj){
+    jobjectArray return_array = NULL;
+    pthread_mutex_lock(&enumerator_lock);
+    if (enumerator_init() == -1){
+        throw_ioexception(env, errno);
+    } else {
+        process_events();
+        return_array = new_port_info_array(env, &port_cache);
+    }
+    pthread_mutex_unlock(&enumerator_lock);
+    return return_array;
+}
+
+/**
+ * Returns the serial ports that have been attached or detached since the
+ * last call. Detached ports are reported with their last known details and
+ * the attached field set to false.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param timeout the maximum time in milliseconds to wait for a change if
+ * none is pending; 0 returns immediately and a negative value waits forever.
+ * @return an array of SerialPortInfo objects, empty if nothing changed.
+ * @throws IOException if the ports cannot be enumerated.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_javatechnics_rs232_Serial_getSerialPortChanges (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint timeout){
+    jobjectArray return_array = NULL;
+    struct pollfd pfd;
+
+    pthread_mutex_lock(&enumerator_lock);
+    if (enumerator_init() == -1){
+        throw_ioexception(env, errno);
+        pthread_mutex_unlock(&enumerator_lock);
+        return NULL;
+    }
+    process_events();
+    if (port_changes.count == 0 && timeout != 0){
+        pfd.fd = inotify_fd;
+        pfd.events = POLLIN;
+        pthread_mutex_unlock(&enumerator_lock);
+        poll(&pfd, 1, timeout);
+        pthread_mutex_lock(&enumerator_lock);
+        process_events();
+    }
+    return_array = new_port_info_array(env, &port_changes);
+    if (return_array != NULL)
+        port_changes.count = 0;
+    pthread_mutex_unlock(&enumerator_lock);
+    return return_array;
+}
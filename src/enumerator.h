@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   enumerator.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Discovery of the serial ports present on the system.
+ */
+
+#ifndef ENUMERATOR_H
+#define	ENUMERATOR_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/inotify.h>
+#include "jni/com_javatechnics_rs232_Serial.h"
+
+#define SERIAL_PORT_INFO_CLASS_STRING "com/javatechnics/rs232/struct/SerialPortInfo"
+
+#define SYSFS_TTY_DIRECTORY "/sys/class/tty"
+#define DEVICE_DIRECTORY "/dev"
+
+#define PORT_INFO_NAME_LENGTH 64
+#define PORT_INFO_STRING_LENGTH 128
+
+/*
+ Everything that is known about a single serial port.
+ */
+struct port_info {
+    char name[PORT_INFO_NAME_LENGTH];
+    char driver[PORT_INFO_STRING_LENGTH];
+    char serial_number[PORT_INFO_STRING_LENGTH];
+    int vendor_id;
+    int product_id;
+    int uart_present;
+    int attached;
+};
+
+const char* java_port_info_fields[] = {"name", "path", "driver", "vendorId",
+                                    "productId", "serialNumber", "uartPresent",
+                                    "attached"};
+const char* java_port_info_field_descriptors[] = {"Ljava/lang/String;",
+                                    "Ljava/lang/String;", "Ljava/lang/String;",
+                                    "I", "I", "Ljava/lang/String;", "Z", "Z"};
+
+#define JAVA_PORT_INFO_FIELD_COUNT 8
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+extern int get_field_ids(JNIEnv* env, jclass cls, const char* const field_names[], \
+                                            const char* const field_name_descriptors[],
+                                            jfieldID field_ids[], \
+                                            const int field_count);
+
+#endif	/* ENUMERATOR_H */
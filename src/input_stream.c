@@ -38,3 +38,498 @@ Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNative (JNIEnv * en
     return result;
     //return 0;
 }
+
+/**
+ * Reads from the serial port and updates a running checksum over the bytes
+ * read while they are still in the native buffer.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param buffer the array to read into.
+ * @param offset the offset into buffer to store the first byte.
+ * @param length the maximum number of bytes to read.
+ * @param algorithm the checksum algorithm, see Checksum.
+ * @param checksum a single element array holding the running checksum,
+ * updated in place.
+ * @return the number of bytes read.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNativeChecksum (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jint fileDescriptor,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jint algorithm,
+                                                                    jintArray checksum){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    jint value;
+    int result;
+    if (!checksum_valid_algorithm(algorithm) || length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    (*env)->GetIntArrayRegion(env, checksum, 0, 1, &value);
+    if ((*env)->ExceptionCheck(env))
+        return -1;
+    result = read(fileDescriptor, n_buffer, length < NATIVE_BUFFER_SIZE ? length : NATIVE_BUFFER_SIZE);
+    if (result == -1){
+        throw_ioexception(env, errno);
+    } else {
+        value = (jint) checksum_update(algorithm, (uint32_t) value, n_buffer, result);
+        (*env)->SetByteArrayRegion(env, buffer, offset, result, (jbyte*) n_buffer);
+        (*env)->SetIntArrayRegion(env, checksum, 0, 1, &value);
+    }
+    return result;
+}
+
+/*
+ Decoders for readNativeDecoded, one per file descriptor, holding the
+ partial frame and any bytes read beyond the last complete frame. lock is
+ held by a read for as long as it uses the decoder. references counts the
+ reads using an entry, under fd_decoders_lock; an entry dropped while in
+ use is freed by the last of them. A decoded frame too large for the
+ caller's buffer is kept in frame until a call with room takes it.
+ */
+struct fd_decoder {
+    int fd;
+    pthread_mutex_t lock;
+    int references;
+    int dropped;
+    struct stuffing_decoder decoder;
+    unsigned char input[NATIVE_BUFFER_SIZE];
+    size_t start;
+    size_t end;
+    unsigned char frame[STUFFING_MAX_FRAME];
+    int frame_length;
+    struct fd_decoder *next;
+};
+
+static struct fd_decoder *fd_decoders = NULL;
+static pthread_mutex_t fd_decoders_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void free_fd_decoder(struct fd_decoder *entry){
+    pthread_mutex_destroy(&entry->lock);
+    free(entry);
+}
+
+/*
+ * Returns the locked decoder of a file descriptor, creating it if need be,
+ * or NULL. Each successful call must be paired with put_fd_decoder().
+ */
+static struct fd_decoder* get_fd_decoder(int fd, int encoding){
+    struct fd_decoder *entry;
+    pthread_mutex_lock(&fd_decoders_lock);
+    for (entry = fd_decoders; entry != NULL && entry->fd != fd; entry = entry->next)
+        ;
+    if (entry == NULL){
+        entry = calloc(1, sizeof(*entry));
+        if (entry != NULL){
+            pthread_mutex_init(&entry->lock, NULL);
+            entry->fd = fd;
+            stuffing_decoder_init(&entry->decoder, encoding);
+            entry->next = fd_decoders;
+            fd_decoders = entry;
+        }
+    }
+    if (entry != NULL)
+        entry->references++;
+    pthread_mutex_unlock(&fd_decoders_lock);
+    if (entry == NULL)
+        return NULL;
+    pthread_mutex_lock(&entry->lock);
+    if (entry->decoder.encoding != encoding){
+        entry->start = entry->end = 0;
+        entry->frame_length = 0;
+        stuffing_decoder_init(&entry->decoder, encoding);
+    }
+    return entry;
+}
+
+static void put_fd_decoder(struct fd_decoder *entry){
+    int last;
+    pthread_mutex_unlock(&entry->lock);
+    pthread_mutex_lock(&fd_decoders_lock);
+    last = --entry->references == 0 && entry->dropped;
+    pthread_mutex_unlock(&fd_decoders_lock);
+    if (last)
+        free_fd_decoder(entry);
+}
+
+/**
+ * Discards the decoder state kept by readNativeDecoded for a file
+ * descriptor, so that a port later opened on the same descriptor number
+ * starts afresh. A read still using the state finishes with it first.
+ * @param fd the file descriptor.
+ */
+void decoder_forget(int fd){
+    struct fd_decoder **link, *entry = NULL;
+    pthread_mutex_lock(&fd_decoders_lock);
+    for (link = &fd_decoders; *link != NULL; link = &(*link)->next){
+        if ((*link)->fd == fd){
+            entry = *link;
+            *link = entry->next;
+            entry->dropped = 1;
+            if (entry->references > 0)
+                entry = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fd_decoders_lock);
+    if (entry != NULL)
+        free_fd_decoder(entry);
+}
+
+/**
+ * Reads and decodes the next frame of a byte stuffing encoding (SLIP, COBS
+ * or HDLC). Bytes are read in blocks and scanned for the frame delimiter;
+ * anything beyond the end of the frame is kept for the next call. Empty,
+ * oversized and malformed frames are dropped. A frame that does not fit in
+ * buffer is kept and returned by the next call with room for it.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param buffer the array to store the decoded frame in.
+ * @param offset the offset into buffer to store the frame.
+ * @param length the room in buffer from offset.
+ * @param encoding the encoding, see SerialPortInputStream.
+ * @return the length of the frame or 0 if a read returned no data (e.g. the
+ * VTIME timeout expired) before a frame was complete.
+ * @throws IOException if an error occurs, offset and length do not fit
+ * buffer (EINVAL) or the frame does not fit in length (EMSGSIZE).
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNativeDecoded (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jint fileDescriptor,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jint encoding){
+    struct fd_decoder *entry;
+    size_t consumed;
+    int result;
+
+    if (!stuffing_valid_encoding(encoding) || offset < 0 || length < 0
+            || offset > (*env)->GetArrayLength(env, buffer) - length){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    entry = get_fd_decoder(fileDescriptor, encoding);
+    if (entry == NULL){
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    // A frame that did not fit last time is returned before any other.
+    while (entry->frame_length == 0){
+        if (entry->start < entry->end){
+            result = stuffing_decoder_feed(&entry->decoder, entry->input + entry->start,
+                                            entry->end - entry->start, &consumed, entry->frame);
+            entry->start += consumed;
+            if (result > 0){
+                entry->frame_length = result;
+                break;
+            }
+        }
+        result = read(fileDescriptor, entry->input, sizeof(entry->input));
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            put_fd_decoder(entry);
+            throw_ioexception(env, errno);
+            return -1;
+        }
+        if (result == 0){
+            put_fd_decoder(entry);
+            return 0;
+        }
+        entry->start = 0;
+        entry->end = result;
+    }
+    result = entry->frame_length;
+    if (result > length){
+        put_fd_decoder(entry);
+        throw_ioexception(env, EMSGSIZE);
+        return -1;
+    }
+    (*env)->SetByteArrayRegion(env, buffer, offset, result, (jbyte*) entry->frame);
+    entry->frame_length = 0;
+    put_fd_decoder(entry);
+    return result;
+}
+
+/**
+ * Discards the decoder state kept by readNativeDecoded for a file
+ * descriptor. closeSerialPort does this itself.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ */
+JNIEXPORT void JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_resetNativeDecoder (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jint fileDescriptor){
+    decoder_forget(fileDescriptor);
+}
+
+/**
+ * Reads from a port opened with openPort.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array to read into.
+ * @param offset the offset into buffer to store the first byte.
+ * @param length the maximum number of bytes to read.
+ * @return the number of bytes read.
+ * @throws IOException if an error occurs or the handle is not that of an
+ * open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readPort (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jlong handle,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    struct serial_port *port;
+    int result;
+    if (length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    result = port_read(port, n_buffer, length < NATIVE_BUFFER_SIZE ? length : NATIVE_BUFFER_SIZE);
+    if (result == -1){
+        throw_ioexception(env, errno);
+    } else {
+        (*env)->SetByteArrayRegion(env, buffer, offset, result, (jbyte*) n_buffer);
+    }
+    port_release(port);
+    return result;
+}
+
+/**
+ * Reads from a port opened with openPort, waiting at most for the given
+ * timeout and returning early if waits on the port are cancelled with
+ * cancelPort or the port is closed. Whatever is available once the port is
+ * readable is returned; VTIME does not apply, and VMIN only as far as it
+ * decides readability with VTIME 0.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array to store the data in.
+ * @param offset the offset into buffer to store the data.
+ * @param length the maximum number of bytes to read.
+ * @param timeout_millis the longest to wait, negative to wait indefinitely.
+ * @return the number of bytes read, 0 if the timeout expired or
+ * READ_CANCELLED.
+ * @throws IOException if an error occurs or the handle is not that of an
+ * open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readPortCancellable (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jlong handle,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jint timeout_millis){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    struct serial_port *port;
+    int result;
+    if (length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    result = port_read_cancellable(port, n_buffer,
+                    length < NATIVE_BUFFER_SIZE ? length : NATIVE_BUFFER_SIZE, timeout_millis);
+    if (result == -1 && errno == ECANCELED){
+        result = READ_CANCELLED;
+    } else if (result == -1){
+        throw_ioexception(env, errno);
+    } else {
+        (*env)->SetByteArrayRegion(env, buffer, offset, result, (jbyte*) n_buffer);
+    }
+    port_release(port);
+    return result;
+}
+
+/**
+ * Reads from a port with PARMRK set (and IGNPAR clear) in its input flags,
+ * returning the data without the marks the driver inserts and a bitmap of
+ * the bytes that were received with a parity or framing error, or were a
+ * break. A mark split across reads is completed by the next call.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array to store the data in.
+ * @param offset the offset into buffer to store the data.
+ * @param length the maximum number of bytes to read.
+ * @param errors the array to store the error bitmap in, at least
+ * (length + 7) / 8 bytes long: bit i of byte i / 8, least significant first,
+ * is set if byte offset + i of buffer was received with an error.
+ * @return the number of bytes stored in buffer.
+ * @throws IOException if an error occurs or the handle is not that of an
+ * open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readPortMarked (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jlong handle,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jbyteArray errors){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    unsigned char bitmap[NATIVE_BUFFER_SIZE / 8];
+    struct serial_port *port;
+    size_t error_count = 0;
+    int result;
+
+    if (length < 0 || (*env)->GetArrayLength(env, errors) < (length + 7) / 8){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    bzero(bitmap, sizeof(bitmap));
+    do {
+        result = port_read(port, n_buffer, length < NATIVE_BUFFER_SIZE ? length : NATIVE_BUFFER_SIZE);
+        if (result <= 0)
+            break;
+        pthread_mutex_lock(&port->lock);
+        result = parmrk_strip(&port->mark_state, n_buffer, result, n_buffer, bitmap, &error_count);
+        pthread_mutex_unlock(&port->lock);
+        // Data made up only of the start of a mark: read the rest of it.
+    } while (result == 0 && length > 0);
+    if (result == -1){
+        throw_ioexception(env, errno);
+    } else if (result > 0){
+        __sync_fetch_and_add(&port->statistics.marked_errors, error_count);
+        (*env)->SetByteArrayRegion(env, buffer, offset, result, (jbyte*) n_buffer);
+        (*env)->SetByteArrayRegion(env, errors, 0, (result + 7) / 8, (jbyte*) bitmap);
+    }
+    port_release(port);
+    return result;
+}
+
+/**
+ * Reads every ready port of a set in one call. The ports are polled once;
+ * each that is readable has as much as FIONREAD reports available read into
+ * the next free region of a direct buffer, so no read blocks whatever VMIN
+ * is. Once the buffer is full any remaining ready ports are left for the
+ * next call. A port that has hung up or fails gets a record with no data
+ * and the errno value.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptors the file descriptors of the ports.
+ * @param buffer a direct ByteBuffer to store the data in, from position 0.
+ * @param timeout_millis how long to wait for any port to become readable,
+ * negative to wait indefinitely.
+ * @param records the array to fill with READ_MANY_RECORD_FIELDS values per
+ * port read, at least that many times the number of ports long.
+ * @return the number of records filled in, 0 if the timeout expired.
+ * @throws IOException if the arguments are not valid or poll() fails.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readMany (JNIEnv *env,
+                                                                jobject obj,
+                                                                jintArray fileDescriptors,
+                                                                jobject buffer,
+                                                                jint timeout_millis,
+                                                                jintArray records){
+    unsigned char *data = (*env)->GetDirectBufferAddress(env, buffer);
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, buffer);
+    jint count = (*env)->GetArrayLength(env, fileDescriptors);
+    struct pollfd *pfds = NULL;
+    jint *fds = NULL, *values = NULL;
+    jlong used = 0;
+    int result, available, record_count = 0, i;
+    ssize_t length;
+
+    if (data == NULL || capacity < 0
+            || (*env)->GetArrayLength(env, records) < count * READ_MANY_RECORD_FIELDS){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    if (count == 0)
+        return 0;
+    pfds = malloc(count * sizeof(*pfds));
+    fds = malloc(count * sizeof(*fds));
+    values = malloc(count * READ_MANY_RECORD_FIELDS * sizeof(*values));
+    if (pfds == NULL || fds == NULL || values == NULL){
+        throw_ioexception(env, ENOMEM);
+        record_count = -1;
+        goto cleanup;
+    }
+    (*env)->GetIntArrayRegion(env, fileDescriptors, 0, count, fds);
+    for (i = 0; i < count; i++){
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+    }
+    do {
+        result = poll(pfds, count, timeout_millis);
+    } while (result == -1 && errno == EINTR);
+    if (result == -1){
+        throw_ioexception(env, errno);
+        record_count = -1;
+        goto cleanup;
+    }
+    for (i = 0; i < count && result > 0; i++){
+        jint *record = values + record_count * READ_MANY_RECORD_FIELDS;
+        if (pfds[i].revents == 0)
+            continue;
+        record[0] = i;
+        record[1] = (jint) used;
+        record[2] = 0;
+        record[3] = 0;
+        if (pfds[i].revents & POLLNVAL){
+            record[3] = EBADF;
+        } else if (pfds[i].revents & POLLIN){
+            if (used == capacity)
+                continue;
+            if (ioctl(fds[i], FIONREAD, &available) == -1){
+                record[3] = errno;
+            } else if (available == 0 && !(pfds[i].revents & (POLLHUP | POLLERR))){
+                continue;
+            } else {
+                // Nothing available on a hang up: the read reports how it ended.
+                if (available == 0)
+                    available = 1;
+                if (available > capacity - used)
+                    available = (int) (capacity - used);
+                length = read(fds[i], data + used, available);
+                if (length > 0){
+                    record[2] = (jint) length;
+                    used += length;
+                } else {
+                    record[3] = length == 0 ? EPIPE : errno;
+                }
+            }
+        } else {
+            // POLLHUP or POLLERR with nothing left to read.
+            record[3] = (pfds[i].revents & POLLHUP) ? EPIPE : EIO;
+        }
+        record_count++;
+    }
+    (*env)->SetIntArrayRegion(env, records, 0, record_count * READ_MANY_RECORD_FIELDS, values);
+cleanup:
+    free(values);
+    free(fds);
+    free(pfds);
+    return record_count;
+}
@@ -29,10 +29,35 @@
 #include <unistd.h>
 #include <string.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <poll.h>
 #include "jni/com_javatechnics_rs232_stream_SerialPortInputStream.h"
+#include "checksum.h"
+#include "stuffing.h"
+#include "port.h"
+#include "parmrk.h"
+
+/*
+ The most read in one go by the natives that read into a native buffer first.
+ */
+#define NATIVE_BUFFER_SIZE 4096
+
+/*
+ Returned by readPortCancellable when waits on the port were cancelled.
+ */
+#define READ_CANCELLED -2
+
+/*
+ Each record filled in by readMany is the index of the port in the array
+ passed, the offset and length of its data in the buffer and 0 or the errno
+ value the port failed with.
+ */
+#define READ_MANY_RECORD_FIELDS 4
 
 extern int throw_ioexception(JNIEnv *env, int error_number);
 
+void decoder_forget(int fd);
+
 JNIEXPORT jint JNICALL
 Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNative (JNIEnv * env,\
                                                                     jobject obj,\
@@ -71,6 +71,454 @@ JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setNativeModemcontrolB
 JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_nativeTCFlush
   (JNIEnv *, jobject, jint, jint);
 
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    openSerialPorts
+ * Signature: ([Ljava/lang/String;IILcom/javatechnics/rs232/struct/TermIOS;I)[I
+ */
+JNIEXPORT jintArray JNICALL Java_com_javatechnics_rs232_Serial_openSerialPorts
+  (JNIEnv *, jobject, jobjectArray, jint, jint, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getSerialPorts
+ * Signature: ()[Lcom/javatechnics/rs232/struct/SerialPortInfo;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_javatechnics_rs232_Serial_getSerialPorts
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getSerialPortChanges
+ * Signature: (I)[Lcom/javatechnics/rs232/struct/SerialPortInfo;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_javatechnics_rs232_Serial_getSerialPortChanges
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    openVirtualPortPair
+ * Signature: (III)[I
+ */
+JNIEXPORT jintArray JNICALL Java_com_javatechnics_rs232_Serial_openVirtualPortPair
+  (JNIEnv *, jobject, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getVirtualPortNames
+ * Signature: (I)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_javatechnics_rs232_Serial_getVirtualPortNames
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    closeVirtualPortPair
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_closeVirtualPortPair
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    openPort
+ * Signature: (Ljava/lang/String;I)J
+ */
+JNIEXPORT jlong JNICALL Java_com_javatechnics_rs232_Serial_openPort
+  (JNIEnv *, jobject, jstring, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    closePort
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_closePort
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setPortAttributes
+ * Signature: (JILcom/javatechnics/rs232/struct/TermIOS;)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setPortAttributes
+  (JNIEnv *, jobject, jlong, jint, jobject);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getPortAttributes
+ * Signature: (J)Lcom/javatechnics/rs232/struct/TermIOS;
+ */
+JNIEXPORT jobject JNICALL Java_com_javatechnics_rs232_Serial_getPortAttributes
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getPortFileDescriptor
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_getPortFileDescriptor
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getPortStatistics
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getPortStatistics
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getMonotonicTime
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_javatechnics_rs232_Serial_getMonotonicTime
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    scheduleTransmit
+ * Signature: (J[BIIJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_scheduleTransmit
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    scheduleBreak
+ * Signature: (JIJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_scheduleBreak
+  (JNIEnv *, jobject, jlong, jint, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getTransmitTimings
+ * Signature: (J[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_getTransmitTimings
+  (JNIEnv *, jobject, jlong, jlongArray);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    cancelScheduledTransmits
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_cancelScheduledTransmits
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setNativeThreadConfig
+ * Signature: (II[IZ)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setNativeThreadConfig
+  (JNIEnv *, jobject, jint, jint, jintArray, jboolean);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getNativeThreadStatus
+ * Signature: ()[I
+ */
+JNIEXPORT jintArray JNICALL Java_com_javatechnics_rs232_Serial_getNativeThreadStatus
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setRS485Mode
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setRS485Mode
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getRS485Config
+ * Signature: (I)[I
+ */
+JNIEXPORT jintArray JNICALL Java_com_javatechnics_rs232_Serial_getRS485Config
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setRS485Config
+ * Signature: (IIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setRS485Config
+  (JNIEnv *, jobject, jint, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    writeRS485
+ * Signature: (I[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_writeRS485
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    openTee
+ * Signature: (JII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_openTee
+  (JNIEnv *, jobject, jlong, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    addTeeConsumer
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_addTeeConsumer
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    removeTeeConsumer
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_removeTeeConsumer
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    readTee
+ * Signature: (II[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_readTee
+  (JNIEnv *, jobject, jint, jint, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getTeeStatistics
+ * Signature: (II)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getTeeStatistics
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    closeTee
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_closeTee
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    openBridge
+ * Signature: (III)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_openBridge
+  (JNIEnv *, jobject, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getBridgeStatistics
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getBridgeStatistics
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    closeBridge
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_closeBridge
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setWriteCoalescing
+ * Signature: (JII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setWriteCoalescing
+  (JNIEnv *, jobject, jlong, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getCoalescingStatistics
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getCoalescingStatistics
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setReadAhead
+ * Signature: (JI)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setReadAhead
+  (JNIEnv *, jobject, jlong, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    invalidatePortAttributes
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_invalidatePortAttributes
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    cancelPort
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_cancelPort
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    resetPortCancel
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_resetPortCancel
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setReadTuning
+ * Signature: (JIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setReadTuning
+  (JNIEnv *, jobject, jlong, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getReadTuning
+ * Signature: (J)[I
+ */
+JNIEXPORT jintArray JNICALL Java_com_javatechnics_rs232_Serial_getReadTuning
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getReadTuningHistory
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getReadTuningHistory
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getNmeaStatistics
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getNmeaStatistics
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    detectBaudRates
+ * Signature: ([J[III)[I
+ */
+JNIEXPORT jintArray JNICALL Java_com_javatechnics_rs232_Serial_detectBaudRates
+  (JNIEnv *, jobject, jlongArray, jintArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setTransmitLanes
+ * Signature: (JII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setTransmitLanes
+  (JNIEnv *, jobject, jlong, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    queueLaneTransmit
+ * Signature: (J[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_queueLaneTransmit
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getTransmitLaneStatistics
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getTransmitLaneStatistics
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    startPortServer
+ * Signature: (Ljava/lang/String;[JI)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_startPortServer
+  (JNIEnv *, jobject, jstring, jlongArray, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getPortServerStatistics
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getPortServerStatistics
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    stopPortServer
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_stopPortServer
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    connectPortServer
+ * Signature: (Ljava/lang/String;I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_connectPortServer
+  (JNIEnv *, jobject, jstring, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    readPortClient
+ * Signature: (I[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_readPortClient
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    writePortClient
+ * Signature: (I[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_writePortClient
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    closePortClient
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_closePortClient
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    setPortWatchdog
+ * Signature: (JII[B)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_Serial_setPortWatchdog
+  (JNIEnv *, jobject, jlong, jint, jint, jbyteArray);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    getPortWatchdogStatus
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_getPortWatchdogStatus
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_javatechnics_rs232_Serial
+ * Method:    pollWatchdogEvents
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_javatechnics_rs232_Serial_pollWatchdogEvents
+  (JNIEnv *, jobject, jint);
+
 #ifdef __cplusplus
 }
 #endif
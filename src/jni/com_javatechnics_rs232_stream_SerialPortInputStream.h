@@ -17,6 +17,78 @@ extern "C" {
 JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNative
   (JNIEnv *, jobject, jint, jbyteArray, jint, jint);
 
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readModbusFrame
+ * Signature: (I[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readModbusFrame
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readNativeChecksum
+ * Signature: (I[BIII[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNativeChecksum
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint, jint, jintArray);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readNativeDecoded
+ * Signature: (I[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNativeDecoded
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    resetNativeDecoder
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_resetNativeDecoder
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readPort
+ * Signature: (J[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readPort
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readPortCancellable
+ * Signature: (J[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readPortCancellable
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readPortMarked
+ * Signature: (J[BII[B)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readPortMarked
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint, jbyteArray);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readMany
+ * Signature: ([ILjava/nio/ByteBuffer;I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readMany
+  (JNIEnv *, jobject, jintArray, jobject, jint, jintArray);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortInputStream
+ * Method:    readNmeaSentences
+ * Signature: (J[BII[IZ)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNmeaSentences
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint, jintArray, jboolean);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,6 +15,46 @@ extern "C" {
 JNIEXPORT void JNICALL Java_com_javatechnics_rs232_stream_SerialPortOutputStream_nativeWrite
   (JNIEnv *, jobject, jint, jbyteArray, jint, jint);
 
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortOutputStream
+ * Method:    nativeWriteChecksum
+ * Signature: (I[BIII[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortOutputStream_nativeWriteChecksum
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint, jint, jintArray);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortOutputStream
+ * Method:    nativeWriteEncoded
+ * Signature: (I[BIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortOutputStream_nativeWriteEncoded
+  (JNIEnv *, jobject, jint, jbyteArray, jint, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortOutputStream
+ * Method:    writePort
+ * Signature: (J[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortOutputStream_writePort
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortOutputStream
+ * Method:    writeCoalesced
+ * Signature: (J[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortOutputStream_writeCoalesced
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_stream_SerialPortOutputStream
+ * Method:    flushPort
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_stream_SerialPortOutputStream_flushPort
+  (JNIEnv *, jobject, jlong);
+
 #ifdef __cplusplus
 }
 #endif
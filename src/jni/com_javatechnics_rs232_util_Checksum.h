@@ -0,0 +1,41 @@
+/* DO NOT EDIT THIS FILE - it is machine generated */
+#include <jni.h>
+/* Header for class com_javatechnics_rs232_util_Checksum */
+
+#ifndef _Included_com_javatechnics_rs232_util_Checksum
+#define _Included_com_javatechnics_rs232_util_Checksum
+#ifdef __cplusplus
+extern "C" {
+#endif
+#undef com_javatechnics_rs232_util_Checksum_CRC16_MODBUS
+#define com_javatechnics_rs232_util_Checksum_CRC16_MODBUS 0L
+#undef com_javatechnics_rs232_util_Checksum_CRC16_CCITT
+#define com_javatechnics_rs232_util_Checksum_CRC16_CCITT 1L
+#undef com_javatechnics_rs232_util_Checksum_CRC32
+#define com_javatechnics_rs232_util_Checksum_CRC32 2L
+#undef com_javatechnics_rs232_util_Checksum_XOR
+#define com_javatechnics_rs232_util_Checksum_XOR 3L
+#undef com_javatechnics_rs232_util_Checksum_SUM8
+#define com_javatechnics_rs232_util_Checksum_SUM8 4L
+#undef com_javatechnics_rs232_util_Checksum_LRC
+#define com_javatechnics_rs232_util_Checksum_LRC 5L
+/*
+ * Class:     com_javatechnics_rs232_util_Checksum
+ * Method:    nativeUpdate
+ * Signature: (II[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_util_Checksum_nativeUpdate
+  (JNIEnv *, jobject, jint, jint, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_javatechnics_rs232_util_Checksum
+ * Method:    nativeUpdateDirect
+ * Signature: (IILjava/nio/ByteBuffer;II)I
+ */
+JNIEXPORT jint JNICALL Java_com_javatechnics_rs232_util_Checksum_nativeUpdateDirect
+  (JNIEnv *, jobject, jint, jint, jobject, jint, jint);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "modbus.h"
+
+/*
+ * Checks the CRC at the end of a frame. It is sent low byte first.
+ */
+static int modbus_frame_valid(const unsigned char *frame, int length){
+    uint16_t crc;
+    if (length < MODBUS_MIN_FRAME)
+        return 0;
+    crc = checksum_crc16_modbus(0xFFFF, frame, length - 2);
+    return frame[length - 2] == (crc & 0xFF) && frame[length - 1] == (crc >> 8);
+}
+
+static long elapsed_millis(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/**
+ * Reads one complete, CRC checked Modbus RTU frame. The end of a frame is
+ * detected by 3.5 character times of silence, worked out from the speed and
+ * character format the port is configured with. Frames with a bad CRC or
+ * that are too short or long are discarded and reading carries on. The port
+ * should be in non-canonical mode with VMIN of 0 or 1 so that reads return
+ * as soon as data is available.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param buffer the array the frame is copied into, including the CRC.
+ * @param offset the offset into buffer to copy the frame to.
+ * @param length the number of bytes available in buffer from offset, at
+ * least MODBUS_MAX_FRAME so that no frame is read only to be lost.
+ * @param timeout the maximum time in milliseconds to wait for a frame to
+ * start; a negative value waits forever.
+ * @return the length of the frame or 0 if no valid frame arrived in time.
+ * A valid frame that ends with the line hanging up is still returned.
+ * @throws IOException if the port cannot be read, has hung up (EIO), is not
+ * configured suitably or buffer has too little room.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readModbusFrame (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jint fileDescriptor,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jint timeout){
+    unsigned char frame[MODBUS_MAX_FRAME];
+    struct termios l_termios;
+    struct timespec start, silence;
+    struct pollfd pfd;
+    long character_time, frame_delay, wait;
+    int frame_length, overflow, available, result, hangup = 0;
+
+    if (offset < 0 || length < MODBUS_MAX_FRAME
+            || offset > (*env)->GetArrayLength(env, buffer) - length){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    if (tcgetattr(fileDescriptor, &l_termios) == -1){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    character_time = character_time_nanos(&l_termios);
+    if (character_time == 0 || (l_termios.c_lflag & ICANON) || l_termios.c_cc[VMIN] > 1){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    if (baud_from_speed(cfgetispeed(&l_termios)) > MODBUS_FIXED_DELAY_BAUD)
+        frame_delay = MODBUS_FIXED_FRAME_DELAY_NANOS;
+    else
+        frame_delay = character_time * 7 / 2;
+    silence.tv_sec = frame_delay / 1000000000L;
+    silence.tv_nsec = frame_delay % 1000000000L;
+#ifdef DEBUG
+    syslog(LOG_USER | LOG_DEBUG, "Modbus character time: %ldns frame delay: %ldns", character_time, frame_delay);
+#endif
+
+    pfd.fd = fileDescriptor;
+    pfd.events = POLLIN;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!hangup){
+        // Wait for the first byte of a frame.
+        wait = timeout < 0 ? -1 : timeout - elapsed_millis(&start);
+        if (timeout >= 0 && wait < 0)
+            return 0;
+        result = poll(&pfd, 1, (int) wait);
+        if (result == 0)
+            return 0;
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            throw_ioexception(env, errno);
+            return -1;
+        }
+        // Gather bytes until the line has been silent for the frame delay.
+        frame_length = 0;
+        overflow = 0;
+        do {
+            if (ioctl(fileDescriptor, FIONREAD, &available) == -1 || available < 1)
+                available = 1;
+            if (frame_length + available > MODBUS_MAX_FRAME){
+                // Keep consuming, the frame is already known to be bad.
+                overflow = 1;
+                frame_length = 0;
+                if (available > MODBUS_MAX_FRAME)
+                    available = MODBUS_MAX_FRAME;
+            }
+            result = read(fileDescriptor, frame + frame_length, available);
+            if (result == -1 && errno != EINTR){
+                throw_ioexception(env, errno);
+                return -1;
+            }
+            // Readable yet nothing to read: the line has hung up.
+            if (result == 0){
+                hangup = 1;
+                break;
+            }
+            if (result > 0)
+                frame_length += result;
+            do {
+                result = ppoll(&pfd, 1, &silence, NULL);
+            } while (result == -1 && errno == EINTR);
+            if (result > 0 && !(pfd.revents & POLLIN)){
+                hangup = 1;
+                break;
+            }
+        } while (result > 0);
+
+        if (!overflow && modbus_frame_valid(frame, frame_length))
+            break;
+        if (frame_length > 0)
+            syslog(LOG_USER | LOG_DEBUG, "Discarded invalid Modbus frame of %d bytes.", frame_length);
+    }
+    if (hangup && (overflow || !modbus_frame_valid(frame, frame_length))){
+        throw_ioexception(env, EIO);
+        return -1;
+    }
+    (*env)->SetByteArrayRegion(env, buffer, offset, frame_length, (jbyte*) frame);
+    return frame_length;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   modbus.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Modbus RTU framing: frames are delimited by 3.5 character times of
+ * silence on the line and end in a CRC16.
+ */
+
+#ifndef MODBUS_H
+#define	MODBUS_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <syslog.h>
+#include "jni/com_javatechnics_rs232_stream_SerialPortInputStream.h"
+#include "baud.h"
+#include "checksum.h"
+
+/*
+ The largest RTU frame: address, function code, 252 data bytes and the CRC.
+ */
+#define MODBUS_MAX_FRAME 256
+#define MODBUS_MIN_FRAME 4
+
+/*
+ Above 19200 baud the specification fixes the inter-frame delay at 1750us
+ rather than scaling it with the character time.
+ */
+#define MODBUS_FIXED_DELAY_BAUD 19200
+#define MODBUS_FIXED_FRAME_DELAY_NANOS 1750000L
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* MODBUS_H */
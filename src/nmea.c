@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "nmea.h"
+
+/*
+ * Finds the first start character, '$' or '!', in data.
+ */
+static const unsigned char* find_start(const unsigned char *data, size_t length){
+    const unsigned char *dollar = memchr(data, '$', length);
+    const unsigned char *bang = memchr(data, '!', dollar != NULL ? (size_t) (dollar - data) : length);
+    return bang != NULL ? bang : dollar;
+}
+
+static int hex_value(unsigned char c){
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/*
+ * XORs data a word at a time, folding the word down to a byte at the end.
+ */
+static unsigned char xor_checksum(const unsigned char *data, size_t length){
+    uint64_t word, sum = 0;
+    unsigned char result = 0;
+    size_t i = 0;
+    for (; i + sizeof(word) <= length; i += sizeof(word)){
+        memcpy(&word, data + i, sizeof(word));
+        sum ^= word;
+    }
+    for (; i < length; i++)
+        result ^= data[i];
+    for (i = 0; i < sizeof(sum); i++)
+        result ^= (unsigned char) (sum >> (8 * i));
+    return result;
+}
+
+/**
+ * Finds the next sentence in a block of data. Noise before a start
+ * character is skipped and a sentence cut short by the start of another is
+ * discarded.
+ * @param data the data.
+ * @param length the number of bytes of data.
+ * @param require_checksum non-zero if sentences without a checksum are
+ * malformed.
+ * @param consumed set to the number of bytes of data dealt with; the rest
+ * must be offered again with more data after it.
+ * @param sentence_start set, for a valid sentence or one with a bad
+ * checksum, to the offset of its start character.
+ * @param sentence_length set to the length of the sentence up to but not
+ * including CR LF.
+ * @return NMEA_VALID, NMEA_BAD_CHECKSUM or NMEA_MALFORMED for the sentence
+ * ending within the data or NMEA_NEED_MORE if no sentence is complete.
+ */
+int nmea_next_sentence(const unsigned char *data, size_t length, int require_checksum,
+                        size_t *consumed, size_t *sentence_start, size_t *sentence_length){
+    const unsigned char *begin, *end, *next, *stop, *star;
+    int high, low;
+
+    begin = find_start(data, length);
+    if (begin == NULL){
+        *consumed = length;
+        return NMEA_NEED_MORE;
+    }
+    end = memchr(begin, '\n', data + length - begin);
+    next = find_start(begin + 1, (end != NULL ? end : data + length) - begin - 1);
+    if (next != NULL){
+        *consumed = next - data;
+        return NMEA_MALFORMED;
+    }
+    if (end == NULL){
+        if (data + length - begin > NMEA_MAX_SENTENCE + 2){
+            *consumed = length;
+            return NMEA_MALFORMED;
+        }
+        *consumed = begin - data;
+        return NMEA_NEED_MORE;
+    }
+    *consumed = end + 1 - data;
+    stop = end > begin && end[-1] == '\r' ? end - 1 : end;
+    if (stop - begin > NMEA_MAX_SENTENCE)
+        return NMEA_MALFORMED;
+    *sentence_start = begin - data;
+    *sentence_length = stop - begin;
+    star = memchr(begin, '*', stop - begin);
+    if (star == NULL)
+        return require_checksum ? NMEA_MALFORMED : NMEA_VALID;
+    if (stop - star != 3 || (high = hex_value(star[1])) < 0 || (low = hex_value(star[2])) < 0)
+        return NMEA_MALFORMED;
+    if (xor_checksum(begin + 1, star - begin - 1) != ((high << 4) | low))
+        return NMEA_BAD_CHECKSUM;
+    return NMEA_VALID;
+}
+
+/**
+ * Frees the parser of a port once the port can no longer be read.
+ * @param parser the parser, may be NULL.
+ */
+void nmea_free(struct nmea_parser *parser){
+    if (parser == NULL)
+        return;
+    pthread_mutex_destroy(&parser->lock);
+    free(parser);
+}
+
+static struct nmea_parser* get_parser(struct serial_port *port){
+    struct nmea_parser *parser;
+    pthread_mutex_lock(&port->lock);
+    parser = port->nmea;
+    if (parser == NULL){
+        parser = calloc(1, sizeof(struct nmea_parser));
+        if (parser != NULL){
+            pthread_mutex_init(&parser->lock, NULL);
+            port->nmea = parser;
+        }
+    }
+    pthread_mutex_unlock(&port->lock);
+    return parser;
+}
+
+/*
+ * Returns the length of the part of a sentence holding fields: from after
+ * the start character up to the checksum.
+ */
+static size_t body_length(const unsigned char *sentence, size_t length){
+    const unsigned char *star = memchr(sentence, '*', length);
+    return (star != NULL ? (size_t) (star - sentence) : length) - 1;
+}
+
+/*
+ * Counts the fields of a sentence: the address and each comma separated
+ * field up to the checksum.
+ */
+static size_t count_fields(const unsigned char *body, size_t length){
+    const unsigned char *comma;
+    size_t fields = 1;
+    while ((comma = memchr(body, ',', length)) != NULL){
+        fields++;
+        length -= comma + 1 - body;
+        body = comma + 1;
+    }
+    return fields;
+}
+
+/*
+ * Stores the offset and length of each field of a sentence in table.
+ */
+static void store_fields(const unsigned char *body, size_t length, jint offset, jint *table){
+    const unsigned char *start = body, *comma;
+    while ((comma = memchr(body, ',', length)) != NULL){
+        *table++ = offset + (body - start);
+        *table++ = comma - body;
+        length -= comma + 1 - body;
+        body = comma + 1;
+    }
+    *table++ = offset + (body - start);
+    *table = length;
+}
+
+/**
+ * Reads validated NMEA 0183 sentences from a port opened with openPort. The
+ * port is read only when no complete sentence is already held, and every
+ * complete sentence that fits is returned in one call. Each sentence is
+ * copied to buffer from its start character up to, not including, CR LF and
+ * is described in table by its offset into buffer, its length and its field
+ * count, followed by the offset and length of each field. The first field
+ * is the address, e.g. GPGGA; the last ends at the checksum. Sentences with
+ * a bad checksum and malformed sentences are dropped and counted.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array to copy the sentences into.
+ * @param offset the offset into buffer to copy the first sentence to.
+ * @param length the room in buffer from offset.
+ * @param table the array to describe the sentences in, from index 0.
+ * @param requireChecksum true to drop sentences without a checksum.
+ * @return the number of sentences read or 0 if a read returned no data
+ * (e.g. the VTIME timeout expired) before a sentence was complete.
+ * @throws IOException if an error occurs, the handle is not that of an open
+ * port, table is shorter than NMEA_MIN_TABLE or a sentence does not fit in
+ * buffer or table.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortInputStream_readNmeaSentences (JNIEnv *env,
+                                                                    jobject obj,
+                                                                    jlong handle,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length,
+                                                                    jintArray table,
+                                                                    jboolean requireChecksum){
+    unsigned char sentences[NMEA_BUFFER_SIZE];
+    struct serial_port *port;
+    struct nmea_parser *parser;
+    jint *entries = NULL;
+    size_t consumed, start, sentence_length, body, fields, used = 0, table_used = 0;
+    size_t table_length;
+    ssize_t result;
+    int status, count = 0, full = 0, error = 0;
+
+    table_length = (*env)->GetArrayLength(env, table);
+    if (length < 0 || offset < 0 || table_length < NMEA_MIN_TABLE){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    // Nothing beyond what one buffer of input holds can be returned at once.
+    if ((size_t) length > sizeof(sentences))
+        length = sizeof(sentences);
+    // Each byte of a sentence adds at most one field.
+    if (table_length > 5 * NMEA_BUFFER_SIZE)
+        table_length = 5 * NMEA_BUFFER_SIZE;
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    parser = get_parser(port);
+    entries = malloc(table_length * sizeof(jint));
+    if (parser == NULL || entries == NULL){
+        free(entries);
+        port_release(port);
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    pthread_mutex_lock(&parser->lock);
+    for (;;){
+        while (parser->start < parser->end && !full){
+            status = nmea_next_sentence(parser->input + parser->start, parser->end - parser->start,
+                                        requireChecksum, &consumed, &start, &sentence_length);
+            if (status == NMEA_VALID){
+                start += parser->start;
+                body = body_length(parser->input + start, sentence_length);
+                fields = count_fields(parser->input + start + 1, body);
+                if (used + sentence_length > (size_t) length || table_used + 3 + 2 * fields > table_length){
+                    full = 1;
+                    if (count == 0)
+                        error = EMSGSIZE;
+                    break;
+                }
+                memcpy(sentences + used, parser->input + start, sentence_length);
+                entries[table_used++] = offset + used;
+                entries[table_used++] = sentence_length;
+                entries[table_used++] = fields;
+                store_fields(sentences + used + 1, body, offset + used + 1, entries + table_used);
+                table_used += 2 * fields;
+                used += sentence_length;
+                __sync_fetch_and_add(&parser->sentences, 1);
+                count++;
+            } else if (status == NMEA_BAD_CHECKSUM){
+                __sync_fetch_and_add(&parser->checksum_errors, 1);
+            } else if (status == NMEA_MALFORMED){
+                __sync_fetch_and_add(&parser->discarded, 1);
+            }
+            parser->start += consumed;
+            if (status == NMEA_NEED_MORE)
+                break;
+        }
+        if (count > 0 || full)
+            break;
+        // Keep the start of an unfinished sentence and read more after it.
+        memmove(parser->input, parser->input + parser->start, parser->end - parser->start);
+        parser->end -= parser->start;
+        parser->start = 0;
+        result = port_read(port, parser->input + parser->end, sizeof(parser->input) - parser->end);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+        if (result == 0)
+            break;
+        parser->end += result;
+    }
+    pthread_mutex_unlock(&parser->lock);
+    port_release(port);
+    if (error != 0){
+        free(entries);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    if (count > 0){
+        (*env)->SetByteArrayRegion(env, buffer, offset, used, (jbyte*) sentences);
+        (*env)->SetIntArrayRegion(env, table, 0, table_used, entries);
+    }
+    free(entries);
+    return count;
+}
+
+/**
+ * Returns the counters of the NMEA parsing of a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return an array of NMEA_STATISTICS_COUNT values, all 0 if no sentences
+ * were ever read from the port.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getNmeaStatistics (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct nmea_parser *parser;
+    jlong values[NMEA_STATISTICS_COUNT];
+    jlongArray return_array;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    bzero(values, sizeof(values));
+    pthread_mutex_lock(&port->lock);
+    parser = port->nmea;
+    pthread_mutex_unlock(&port->lock);
+    // The parser lock is held across blocking reads, so it is not taken here.
+    if (parser != NULL){
+        values[0] = parser->sentences;
+        values[1] = parser->checksum_errors;
+        values[2] = parser->discarded;
+    }
+    port_release(port);
+    return_array = (*env)->NewLongArray(env, NMEA_STATISTICS_COUNT);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, NMEA_STATISTICS_COUNT, values);
+    return return_array;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   nmea.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * NMEA 0183 sentence parsing: sentences start with '$' or '!', end in CR LF
+ * and may carry an XOR checksum of the characters between the start
+ * character and '*' as two hexadecimal digits.
+ */
+
+#ifndef NMEA_H
+#define	NMEA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include "jni/com_javatechnics_rs232_stream_SerialPortInputStream.h"
+#include "port.h"
+
+/*
+ The longest sentence accepted, start character to checksum. The standard
+ allows 82 characters including CR LF but proprietary sentences run longer.
+ */
+#define NMEA_MAX_SENTENCE 256
+
+/*
+ The data held for a port between reads.
+ */
+#define NMEA_BUFFER_SIZE 4096
+
+/*
+ The table entries of a sentence with a single field.
+ */
+#define NMEA_MIN_TABLE 5
+
+/*
+ What nmea_next_sentence() found.
+ */
+#define NMEA_NEED_MORE      0
+#define NMEA_VALID          1
+#define NMEA_BAD_CHECKSUM   2
+#define NMEA_MALFORMED      3
+
+/*
+ The statistics handed to Java: valid sentences, sentences with a bad
+ checksum and sentences discarded as malformed or too long.
+ */
+#define NMEA_STATISTICS_COUNT 3
+
+struct nmea_parser {
+    /* Held while the port is read and parsed; guards input, start and end. */
+    pthread_mutex_t lock;
+    unsigned char input[NMEA_BUFFER_SIZE];
+    size_t start;
+    size_t end;
+    /* Only ever added to atomically, read without the lock. */
+    uint64_t sentences;
+    uint64_t checksum_errors;
+    uint64_t discarded;
+};
+
+int nmea_next_sentence(const unsigned char *data, size_t length, int require_checksum,
+                        size_t *consumed, size_t *sentence_start, size_t *sentence_length);
+
+void nmea_free(struct nmea_parser *parser);
+
+#endif	/* NMEA_H */
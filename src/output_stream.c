@@ -44,3 +44,169 @@ Java_com_javatechnics_rs232_stream_SerialPortOutputStream_nativeWrite  (JNIEnv *
     }
     
 }
+
+/**
+ * Writes to the serial port and updates a running checksum over the bytes
+ * written while they are already in the native buffer.
+ * @param env pointer to the JNI environment.
+ * @param jobj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param buffer the array holding the data to write.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the number of bytes to write.
+ * @param algorithm the checksum algorithm, see Checksum.
+ * @param checksum a single element array holding the running checksum,
+ * updated in place.
+ * @return the number of bytes written.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortOutputStream_nativeWriteChecksum (JNIEnv *env,
+                                                                        jobject jobj,
+                                                                        jint fileDescriptor,
+                                                                        jbyteArray buffer,
+                                                                        jint offset,
+                                                                        jint length,
+                                                                        jint algorithm,
+                                                                        jintArray checksum){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    int written = 0, chunk, result;
+    jint value;
+    if (!checksum_valid_algorithm(algorithm) || length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    (*env)->GetIntArrayRegion(env, checksum, 0, 1, &value);
+    if ((*env)->ExceptionCheck(env))
+        return -1;
+    while (written < length){
+        chunk = length - written < NATIVE_BUFFER_SIZE ? length - written : NATIVE_BUFFER_SIZE;
+        (*env)->GetByteArrayRegion(env, buffer, offset + written, chunk, (jbyte*) n_buffer);
+        if ((*env)->ExceptionCheck(env))
+            return -1;
+        result = write(fileDescriptor, n_buffer, chunk);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            throw_ioexception(env, errno);
+            break;
+        }
+        value = (jint) checksum_update(algorithm, (uint32_t) value, n_buffer, result);
+        written += result;
+    }
+    (*env)->SetIntArrayRegion(env, checksum, 0, 1, &value);
+    return written;
+}
+
+/**
+ * Encodes a frame with a byte stuffing encoding (SLIP, COBS or HDLC) and
+ * writes it, delimiters included, to the serial port. The frame is encoded
+ * in one pass straight into the native buffer that is written.
+ * @param env pointer to the JNI environment.
+ * @param jobj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param buffer the array holding the frame.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the length of the frame.
+ * @param encoding the encoding, see SerialPortOutputStream.
+ * @return the number of encoded bytes written.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortOutputStream_nativeWriteEncoded (JNIEnv *env,
+                                                                        jobject jobj,
+                                                                        jint fileDescriptor,
+                                                                        jbyteArray buffer,
+                                                                        jint offset,
+                                                                        jint length,
+                                                                        jint encoding){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    unsigned char *data = n_buffer, *encoded;
+    size_t encoded_length, written = 0;
+    int result;
+
+    if (!stuffing_valid_encoding(encoding) || length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    // The frame and its encoding share one buffer; the stack suffices for
+    // all but large frames.
+    if ((size_t) length + stuffing_max_encoded(length) > sizeof(n_buffer)){
+        data = malloc(length + stuffing_max_encoded(length));
+        if (data == NULL){
+            throw_ioexception(env, ENOMEM);
+            return -1;
+        }
+    }
+    encoded = data + length;
+    (*env)->GetByteArrayRegion(env, buffer, offset, length, (jbyte*) data);
+    if ((*env)->ExceptionCheck(env)){
+        written = -1;
+        goto cleanup;
+    }
+    encoded_length = stuffing_encode(encoding, data, length, encoded);
+    while (written < encoded_length){
+        result = write(fileDescriptor, encoded + written, encoded_length - written);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            throw_ioexception(env, errno);
+            break;
+        }
+        written += result;
+    }
+cleanup:
+    if (data != n_buffer)
+        free(data);
+    return (jint) written;
+}
+
+/**
+ * Writes to a port opened with openPort. All the bytes are written before
+ * returning.
+ * @param env pointer to the JNI environment.
+ * @param jobj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array holding the data to write.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the number of bytes to write.
+ * @return the number of bytes written.
+ * @throws IOException if an error occurs or the handle is not that of an
+ * open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_stream_SerialPortOutputStream_writePort (JNIEnv *env,
+                                                                    jobject jobj,
+                                                                    jlong handle,
+                                                                    jbyteArray buffer,
+                                                                    jint offset,
+                                                                    jint length){
+    unsigned char n_buffer[NATIVE_BUFFER_SIZE];
+    struct serial_port *port;
+    int written = 0, chunk, result;
+    if (length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    while (written < length){
+        chunk = length - written < NATIVE_BUFFER_SIZE ? length - written : NATIVE_BUFFER_SIZE;
+        (*env)->GetByteArrayRegion(env, buffer, offset + written, chunk, (jbyte*) n_buffer);
+        if ((*env)->ExceptionCheck(env))
+            break;
+        result = port_write(port, n_buffer, chunk);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            throw_ioexception(env, errno);
+            break;
+        }
+        written += result;
+    }
+    port_release(port);
+    return written;
+}
@@ -36,6 +36,14 @@
 #include <string.h>
 #include <syslog.h>
 #include "jni/com_javatechnics_rs232_stream_SerialPortOutputStream.h"
+#include "checksum.h"
+#include "stuffing.h"
+#include "port.h"
+
+/*
+ The most written in one go by the natives that copy into a native buffer first.
+ */
+#define NATIVE_BUFFER_SIZE 4096
 
 extern int throw_ioexception(JNIEnv *env, int error_number);
 
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "parallel.h"
+
+struct parallel_batch {
+    int count;
+    int next_index;
+    parallel_task task;
+    void *context;
+};
+
+/*
+ * Thread body. Each worker keeps claiming the next unprocessed index until
+ * the batch is exhausted so that slow ports do not hold up the others.
+ */
+static void* parallel_worker(void *arg){
+    struct parallel_batch *batch = (struct parallel_batch*) arg;
+    int index;
+    while ((index = __sync_fetch_and_add(&batch->next_index, 1)) < batch->count){
+        batch->task(index, batch->context);
+    }
+    return NULL;
+}
+
+/*
+ * Body of the threads started for a batch, as opposed to the calling thread
+ * which also works on the batch.
+ */
+static void* parallel_thread(void *arg){
+    thread_config_register();
+    parallel_worker(arg);
+    thread_config_unregister();
+    return NULL;
+}
+
+/**
+ * Runs task(index, context) for every index in [0, count) spread across up to
+ * max_threads native threads and waits for all of them to finish. If no
+ * thread can be created the tasks are run on the calling thread instead.
+ * @param count the number of tasks to run.
+ * @param max_threads the maximum number of threads to use. Values less than 1
+ * or greater than PARALLEL_MAX_THREADS are clamped.
+ * @param task the function to call for each index.
+ * @param context opaque pointer handed to every task invocation.
+ * @return the number of threads used, 0 if the calling thread did all the
+ * work.
+ */
+int run_parallel(int count, int max_threads, parallel_task task, void *context){
+    struct parallel_batch batch;
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    int started = 0, i;
+
+    batch.count = count;
+    batch.next_index = 0;
+    batch.task = task;
+    batch.context = context;
+
+    if (max_threads < 1)
+        max_threads = 1;
+    if (max_threads > PARALLEL_MAX_THREADS)
+        max_threads = PARALLEL_MAX_THREADS;
+    if (max_threads > count)
+        max_threads = count;
+
+    for (i = 0; i < max_threads; i++){
+        if (pthread_create(&threads[started], NULL, parallel_thread, &batch) == 0)
+            started++;
+    }
+    // Whatever the workers have not claimed is finished off here.
+    parallel_worker(&batch);
+    for (i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+    return started;
+}
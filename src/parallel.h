@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   parallel.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Helper for running independent per-port tasks on native threads.
+ */
+
+#ifndef PARALLEL_H
+#define	PARALLEL_H
+
+#include "thread_config.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+/*
+ The upper limit on the number of native threads run_parallel() will start
+ for a single batch.
+ */
+#define PARALLEL_MAX_THREADS 32
+
+typedef void (*parallel_task)(int index, void *context);
+
+int run_parallel(int count, int max_threads, parallel_task task, void *context);
+
+#endif	/* PARALLEL_H */
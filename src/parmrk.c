@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "parmrk.h"
+
+#define PARMRK_MARK 0xFF
+
+/**
+ * Strips PARMRK marks from data read from a port. Runs of unmarked data are
+ * found with memchr() and copied in one go. A mark split across reads is
+ * carried over in state.
+ * @param state the mark state, PARMRK_DATA at the start of the stream.
+ * @param input the data as read.
+ * @param length the number of bytes read.
+ * @param output where to store the data without marks, which may be input.
+ * @param errors a bitmap, zeroed by the caller, in which bit i (of byte
+ * i / 8, least significant first) is set if output[i] was received with an
+ * error.
+ * @param error_count incremented for each byte received with an error.
+ * @return the number of bytes stored in output.
+ */
+size_t parmrk_strip(int *state, const unsigned char *input, size_t length,
+                    unsigned char *output, unsigned char *errors, size_t *error_count){
+    const unsigned char *end = input + length, *mark;
+    unsigned char *out = output;
+    size_t run;
+
+    while (input < end){
+        if (*state == PARMRK_ESCAPE){
+            if (*input == PARMRK_MARK){
+                *out++ = PARMRK_MARK;
+                *state = PARMRK_DATA;
+            } else {
+                // Only 0x00 may follow; anything else is passed on as it came.
+                *state = *input == 0x00 ? PARMRK_ERROR : PARMRK_DATA;
+                if (*state == PARMRK_DATA)
+                    *out++ = *input;
+            }
+            input++;
+            continue;
+        }
+        if (*state == PARMRK_ERROR){
+            errors[(out - output) / 8] |= 1 << ((out - output) % 8);
+            (*error_count)++;
+            *out++ = *input++;
+            *state = PARMRK_DATA;
+            continue;
+        }
+        mark = memchr(input, PARMRK_MARK, end - input);
+        run = (mark != NULL ? mark : end) - input;
+        if (out != input)
+            memmove(out, input, run);
+        out += run;
+        input += run;
+        if (mark != NULL){
+            *state = PARMRK_ESCAPE;
+            input++;
+        }
+    }
+    return out - output;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   parmrk.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Removal of the marks the tty layer inserts when PARMRK is set: a byte
+ * received with a parity or framing error arrives as 0xFF 0x00 <byte>, a
+ * break as 0xFF 0x00 0x00 and a genuine 0xFF as 0xFF 0xFF. The driver does
+ * not say which kind of error it was.
+ */
+
+#ifndef PARMRK_H
+#define	PARMRK_H
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ How far into a mark the data seen so far ends.
+ */
+#define PARMRK_DATA     0
+#define PARMRK_ESCAPE   1
+#define PARMRK_ERROR    2
+
+size_t parmrk_strip(int *state, const unsigned char *input, size_t length,
+                    unsigned char *output, unsigned char *errors, size_t *error_count);
+
+#endif	/* PARMRK_H */
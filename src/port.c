@@ -0,0 +1,833 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "port.h"
+#include "rs485.h"
+#include "input_stream.h"
+#include "tuner.h"
+#include "watchdog.h"
+#include "nmea.h"
+#include "baud.h"
+
+/*
+ Slots are allocated on first use and then kept for the life of the library
+ so that the generation of a slot survives the port being closed.
+ */
+static struct serial_port *ports[PORT_MAX_HANDLES];
+static pthread_mutex_t ports_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static jlong make_handle(int slot, uint32_t generation){
+    return ((jlong) generation << 32) | (jlong) (slot + 1);
+}
+
+/*
+ * Returns the slot a handle refers to or -1 if it cannot be one.
+ */
+static int handle_slot(jlong handle){
+    int64_t slot = (handle & 0xFFFFFFFFLL) - 1;
+    return slot >= 0 && slot < PORT_MAX_HANDLES ? (int) slot : -1;
+}
+
+/*
+ * Closes the descriptor and frees the slot for reuse. Called without
+ * ports_lock held once the last reference to a closing port is dropped:
+ * close() on a tty may wait for the output to drain, and no other port
+ * should wait with it. Nothing else can reach a closing port with no
+ * references, and the slot is only reopened once this is done.
+ */
+static void port_destroy(struct serial_port *port){
+    rs485_forget(port->fd);
+    decoder_forget(port->fd);
+    free(port->read_ahead);
+    port->read_ahead = NULL;
+    tuner_free(port->tuner);
+    port->tuner = NULL;
+    nmea_free(port->nmea);
+    port->nmea = NULL;
+    watchdog_free(port->watchdog);
+    port->watchdog = NULL;
+    port->watching = NULL;
+    close(port->cancel_fd);
+    port->cancel_fd = -1;
+    if (port->nonblocking_fd != -1 && port->nonblocking_fd != port->fd)
+        close(port->nonblocking_fd);
+    port->nonblocking_fd = -1;
+    close(port->fd);
+    port->fd = -1;
+    pthread_mutex_lock(&ports_lock);
+    port->open = 0;
+    port->closing = 0;
+    pthread_mutex_unlock(&ports_lock);
+}
+
+/*
+ * Stops the helpers of a closing port. Called without ports_lock held since
+ * helper threads drop their own references to the port on exit.
+ */
+static void port_shutdown(struct serial_port *port){
+    struct port_helper *helper;
+    pthread_mutex_lock(&port->lock);
+    port->shutdown = 1;
+    port->scheduler = NULL;
+    while ((helper = port->helpers) != NULL){
+        port->helpers = helper->next;
+        helper->stop(helper);
+    }
+    pthread_mutex_unlock(&port->lock);
+}
+
+/**
+ * Opens a serial port and allocates its native state.
+ * @param path the file system path to the serial port.
+ * @param native_flags the flags for open().
+ * @return the handle of the port or -1 with errno set.
+ */
+jlong port_open(const char *path, int native_flags){
+    struct serial_port *port = NULL;
+    jlong handle;
+    int fd, cancel_fd, slot;
+
+    fd = open(path, native_flags);
+    if (fd == -1)
+        return -1;
+    cancel_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (cancel_fd == -1){
+        slot = errno;
+        close(fd);
+        errno = slot;
+        return -1;
+    }
+    pthread_mutex_lock(&ports_lock);
+    for (slot = 0; slot < PORT_MAX_HANDLES; slot++){
+        if (ports[slot] == NULL){
+            ports[slot] = calloc(1, sizeof(struct serial_port));
+            if (ports[slot] == NULL)
+                break;
+            pthread_mutex_init(&ports[slot]->lock, NULL);
+            pthread_mutex_init(&ports[slot]->read_lock, NULL);
+            pthread_mutex_init(&ports[slot]->termios_lock, NULL);
+        }
+        if (!ports[slot]->open){
+            port = ports[slot];
+            break;
+        }
+    }
+    if (port == NULL){
+        pthread_mutex_unlock(&ports_lock);
+        close(cancel_fd);
+        close(fd);
+        errno = slot == PORT_MAX_HANDLES ? EMFILE : ENOMEM;
+        return -1;
+    }
+    port->fd = fd;
+    port->nonblocking_fd = -1;
+    port->cancel_fd = cancel_fd;
+    port->generation++;
+    if (port->generation == 0)
+        port->generation = 1;
+    port->open = 1;
+    port->closing = 0;
+    port->references = 0;
+    port->shutdown = 0;
+    port->helpers = NULL;
+    port->scheduler = NULL;
+    port->coalescer = NULL;
+    port->tuner = NULL;
+    port->nmea = NULL;
+    port->lanes = NULL;
+    port->watchdog = NULL;
+    port->watching = NULL;
+    port->read_ahead_size = 0;
+    port->read_ahead_start = port->read_ahead_end = 0;
+    port->requested_valid = 0;
+    port->actual_valid = 0;
+    port->mark_state = 0;
+    bzero(&port->statistics, sizeof(port->statistics));
+    handle = make_handle(slot, port->generation);
+    pthread_mutex_unlock(&ports_lock);
+    return handle;
+}
+
+/**
+ * Closes a port. The handle is invalid from this point on. Cancellable
+ * waits on the port are woken, anything still queued for timed transmission
+ * is discarded and the descriptor itself is closed once no other native call
+ * is using the port.
+ * @param handle the handle of the port.
+ * @return 0 upon success or -1 with errno set to EBADF if the handle is not
+ * that of an open port.
+ */
+int port_close(jlong handle){
+    struct serial_port *port;
+    int slot = handle_slot(handle);
+    pthread_mutex_lock(&ports_lock);
+    port = slot != -1 ? ports[slot] : NULL;
+    if (port == NULL || !port->open || port->closing
+            || port->generation != (uint32_t) (handle >> 32)){
+        pthread_mutex_unlock(&ports_lock);
+        errno = EBADF;
+        return -1;
+    }
+    port->closing = 1;
+    // Hold the slot while the helper threads are stopped.
+    port->references++;
+    pthread_mutex_unlock(&ports_lock);
+    eventfd_write(port->cancel_fd, 1);
+    port_shutdown(port);
+    port_release(port);
+    return 0;
+}
+
+/**
+ * Looks up the port a handle refers to and takes a reference to it so that
+ * it cannot be closed underneath the caller. Every successful call must be
+ * paired with port_release().
+ * @param handle the handle of the port.
+ * @return the port or NULL with errno set to EBADF if the handle is not that
+ * of an open port.
+ */
+struct serial_port* port_acquire(jlong handle){
+    struct serial_port *port;
+    int slot = handle_slot(handle);
+    pthread_mutex_lock(&ports_lock);
+    port = slot != -1 ? ports[slot] : NULL;
+    if (port == NULL || !port->open || port->closing
+            || port->generation != (uint32_t) (handle >> 32)){
+        port = NULL;
+        errno = EBADF;
+    } else {
+        port->references++;
+    }
+    pthread_mutex_unlock(&ports_lock);
+    return port;
+}
+
+/**
+ * Drops a reference taken by port_acquire().
+ * @param port the port.
+ */
+void port_release(struct serial_port *port){
+    int destroy;
+    pthread_mutex_lock(&ports_lock);
+    destroy = --port->references == 0 && port->closing;
+    pthread_mutex_unlock(&ports_lock);
+    if (destroy)
+        port_destroy(port);
+}
+
+/**
+ * Registers a helper to be stopped when the port is closed.
+ * @param port the port, acquired and locked by the caller.
+ * @param helper the helper.
+ * @return 0 upon success or -1 with errno set to EBADF if the port is
+ * already being closed.
+ */
+int port_add_helper(struct serial_port *port, struct port_helper *helper){
+    if (port->shutdown){
+        errno = EBADF;
+        return -1;
+    }
+    helper->next = port->helpers;
+    port->helpers = helper;
+    return 0;
+}
+
+/**
+ * Unregisters a helper that is being stopped by its owner. Once this
+ * returns the port will not call the helper's stop function: if the port
+ * was closed first, stop has already returned.
+ * @param port the port the helper was added to.
+ * @param helper the helper.
+ */
+void port_remove_helper(struct serial_port *port, struct port_helper *helper){
+    pthread_mutex_lock(&port->lock);
+    port_detach_helper(port, helper);
+    pthread_mutex_unlock(&port->lock);
+}
+
+/**
+ * As port_remove_helper() for a caller that already holds the port lock.
+ * @param port the port the helper was added to, locked by the caller.
+ * @param helper the helper.
+ */
+void port_detach_helper(struct serial_port *port, struct port_helper *helper){
+    struct port_helper **link;
+    for (link = &port->helpers; *link != NULL; link = &(*link)->next){
+        if (*link == helper){
+            *link = helper->next;
+            break;
+        }
+    }
+}
+
+static ssize_t read_counted(struct serial_port *port, void *buffer, size_t length){
+    struct port_watchdog *watchdog;
+    ssize_t result = read(port->fd, buffer, length);
+    if (result > 0){
+        __sync_fetch_and_add(&port->statistics.bytes_read, result);
+        watchdog = port->watching;
+        if (watchdog != NULL)
+            watchdog_received(watchdog);
+    }
+    __sync_fetch_and_add(&port->statistics.reads, 1);
+    if (port->tuner != NULL)
+        tuner_observe(port, length, result);
+    return result;
+}
+
+/*
+ * Serves a read through the read-ahead buffer. Called with read_lock held.
+ */
+static ssize_t read_ahead(struct serial_port *port, unsigned char *buffer, size_t length){
+    size_t held = port->read_ahead_end - port->read_ahead_start;
+    ssize_t result;
+    int available = 0;
+
+    if (held == 0 && port->read_ahead_size > 0 && length < port->read_ahead_size
+            && ioctl(port->fd, FIONREAD, &available) == 0 && (size_t) available > length){
+        // More is waiting than asked for: take it all in one call.
+        if ((size_t) available > port->read_ahead_size)
+            available = port->read_ahead_size;
+        result = read_counted(port, port->read_ahead, available);
+        if (result <= 0)
+            return result;
+        port->read_ahead_start = 0;
+        port->read_ahead_end = held = result;
+    } else if (held == 0){
+        return read_counted(port, buffer, length);
+    } else {
+        __sync_fetch_and_add(&port->statistics.buffered_reads, 1);
+    }
+    if (length > held)
+        length = held;
+    memcpy(buffer, port->read_ahead + port->read_ahead_start, length);
+    port->read_ahead_start += length;
+    if (port->read_ahead_start == port->read_ahead_end){
+        port->read_ahead_start = port->read_ahead_end = 0;
+        if (port->read_ahead_size == 0){
+            // Read-ahead was turned off while data was held.
+            free(port->read_ahead);
+            port->read_ahead = NULL;
+        }
+    }
+    return length;
+}
+
+/**
+ * Reads from a port, keeping its statistics. Where the port has a
+ * read-ahead buffer, a read for less than FIONREAD reports available takes
+ * everything available into the buffer and later reads are served from it
+ * without a system call.
+ * @param port the port, acquired by the caller.
+ * @param buffer where to store the data.
+ * @param length the maximum number of bytes to read.
+ * @return the number of bytes read or -1 with errno set.
+ */
+ssize_t port_read(struct serial_port *port, void *buffer, size_t length){
+    ssize_t result;
+    /*
+     Looked at without read_lock so that a blocking read does not hold it.
+     The pointer is only NULL while no data is held, and is checked again
+     under the lock.
+     */
+    if (*(unsigned char * volatile *) &port->read_ahead == NULL)
+        return read_counted(port, buffer, length);
+    pthread_mutex_lock(&port->read_lock);
+    if (port->read_ahead != NULL)
+        result = read_ahead(port, buffer, length);
+    else
+        result = read_counted(port, buffer, length);
+    pthread_mutex_unlock(&port->read_lock);
+    return result;
+}
+
+/**
+ * Waits until a port is ready or waits on it are cancelled.
+ * @param port the port, acquired by the caller.
+ * @param events the poll() events to wait for.
+ * @param timeout_millis the longest to wait, negative to wait indefinitely.
+ * @return the poll() events of the port, 0 if the timeout expired or -1
+ * with errno set, to ECANCELED if waits on the port are cancelled.
+ */
+int port_wait(struct serial_port *port, short events, int timeout_millis){
+    struct pollfd pfds[2];
+    struct timespec now;
+    int64_t deadline = 0, remaining;
+    int result;
+
+    pfds[0].fd = port->fd;
+    pfds[0].events = events;
+    pfds[1].fd = port->cancel_fd;
+    pfds[1].events = POLLIN;
+    if (timeout_millis > 0){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeout_millis;
+    }
+    for (;;){
+        result = poll(pfds, 2, timeout_millis);
+        if (result > 0 && (pfds[1].revents & POLLIN)){
+            errno = ECANCELED;
+            return -1;
+        }
+        if (result > 0)
+            return pfds[0].revents;
+        if (result == 0 || errno != EINTR)
+            return result;
+        if (timeout_millis > 0){
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining = deadline - ((int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+            timeout_millis = remaining > 0 ? (int) remaining : 0;
+        }
+    }
+}
+
+/**
+ * Reads from a port without blocking beyond the timeout: once poll() finds
+ * the port readable only as much as FIONREAD reports available is read, so
+ * the read itself never waits. Note that with VTIME 0 the tty is readable
+ * only once VMIN bytes are available. Data held by the read-ahead buffer is
+ * returned straight away.
+ * @param port the port, acquired by the caller.
+ * @param buffer where to store the data.
+ * @param length the maximum number of bytes to read.
+ * @param timeout_millis the longest to wait, negative to wait indefinitely.
+ * @return the number of bytes read, 0 if the timeout expired or -1 with
+ * errno set, to ECANCELED if waits on the port are cancelled.
+ */
+ssize_t port_read_cancellable(struct serial_port *port, void *buffer, size_t length,
+                                int timeout_millis){
+    int available = 0, revents;
+    size_t held;
+
+    pthread_mutex_lock(&port->read_lock);
+    held = port->read_ahead_end - port->read_ahead_start;
+    pthread_mutex_unlock(&port->read_lock);
+    if (held == 0 || length == 0){
+        revents = port_wait(port, POLLIN, timeout_millis);
+        if (revents <= 0)
+            return revents;
+        if (ioctl(port->fd, FIONREAD, &available) == -1)
+            return -1;
+        if (available == 0 && !(revents & (POLLHUP | POLLERR)))
+            return 0;
+        // On a hang up the read fails or returns 0 at once.
+        if (available > 0 && (size_t) available < length)
+            length = available;
+    }
+    return port_read(port, buffer, length);
+}
+
+/**
+ * Sets the size of the read-ahead buffer of a port.
+ * @param port the port, acquired by the caller.
+ * @param size the size in bytes, up to PORT_MAX_READ_AHEAD, or 0 to read
+ * directly once any data already held has been read.
+ * @return 0 upon success or -1 with errno set.
+ */
+int port_set_read_ahead(struct serial_port *port, size_t size){
+    unsigned char *buffer = NULL;
+    size_t held;
+    if (size > PORT_MAX_READ_AHEAD){
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&port->read_lock);
+    held = port->read_ahead_end - port->read_ahead_start;
+    if (size > 0 && size < held){
+        pthread_mutex_unlock(&port->read_lock);
+        errno = EBUSY;
+        return -1;
+    }
+    if (size > 0){
+        buffer = malloc(size);
+        if (buffer == NULL){
+            pthread_mutex_unlock(&port->read_lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        if (held > 0)
+            memcpy(buffer, port->read_ahead + port->read_ahead_start, held);
+        free(port->read_ahead);
+        port->read_ahead = buffer;
+        port->read_ahead_start = 0;
+        port->read_ahead_end = held;
+    } else if (held == 0){
+        free(port->read_ahead);
+        port->read_ahead = NULL;
+    }
+    port->read_ahead_size = size;
+    pthread_mutex_unlock(&port->read_lock);
+    return 0;
+}
+
+static ssize_t write_counted(struct serial_port *port, int fd, const void *buffer, size_t length){
+    struct port_watchdog *watchdog;
+    ssize_t result = write(fd, buffer, length);
+    if (result > 0){
+        __sync_fetch_and_add(&port->statistics.bytes_written, result);
+        watchdog = port->watching;
+        if (watchdog != NULL)
+            watchdog_sent(watchdog);
+    }
+    __sync_fetch_and_add(&port->statistics.writes, 1);
+    return result;
+}
+
+/**
+ * Writes to a port, keeping its statistics.
+ * @param port the port, acquired by the caller.
+ * @param buffer the data to write.
+ * @param length the number of bytes to write.
+ * @return the number of bytes written or -1 with errno set.
+ */
+ssize_t port_write(struct serial_port *port, const void *buffer, size_t length){
+    return write_counted(port, port->fd, buffer, length);
+}
+
+/*
+ * Returns the non-blocking descriptor of a port, opening it on first use.
+ * A port opened read-only gets none, so its writes still fail. The port
+ * lock is not taken: helpers write while close holds it.
+ */
+static int nonblocking_fd(struct serial_port *port){
+    char path[32];
+    int fd = *(volatile int*) &port->nonblocking_fd, flags;
+    if (fd != -1)
+        return fd;
+    flags = fcntl(port->fd, F_GETFL);
+    fd = -1;
+    if (flags != -1 && (flags & O_ACCMODE) != O_RDONLY){
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", port->fd);
+        fd = open(path, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1)
+            syslog(LOG_USER | LOG_DEBUG, "Writes to fd %d may block: %s", port->fd, strerror(errno));
+    }
+    if (fd == -1)
+        fd = port->fd;
+    if (!__sync_bool_compare_and_swap(&port->nonblocking_fd, -1, fd)){
+        if (fd != port->fd)
+            close(fd);
+        fd = port->nonblocking_fd;
+    }
+    return fd;
+}
+
+/**
+ * Writes to a port without blocking, keeping its statistics, for helper
+ * threads that must stop promptly when the port is closed. The write goes
+ * through a second descriptor for the device, opened non-blocking on first
+ * use, so that the port's own descriptor keeps its flags for Java callers.
+ * Where the device cannot be opened again, e.g. it is in exclusive mode,
+ * the port's own descriptor is used and the write may block.
+ * @param port the port, acquired by the caller.
+ * @param buffer the data to write.
+ * @param length the number of bytes to write.
+ * @return the number of bytes written or -1 with errno set, to EAGAIN if
+ * the driver has no room.
+ */
+ssize_t port_write_nonblocking(struct serial_port *port, const void *buffer, size_t length){
+    return write_counted(port, nonblocking_fd(port), buffer, length);
+}
+
+/**
+ * Waits until a port has room to write or another descriptor, such as a
+ * helper thread's wakeup eventfd, is readable. Unlike port_wait() it is
+ * not woken by cancelPort, which cancels reads only.
+ * @param port the port, acquired by the caller.
+ * @param wake_fd the descriptor to wake on, or -1 for none.
+ * @param timeout_millis the longest to wait, negative to wait indefinitely.
+ * @return the poll() events of the port, 0 if wake_fd is readable, the
+ * timeout expired or a signal interrupted the wait, or -1 with errno set.
+ */
+int port_wait_writable(struct serial_port *port, int wake_fd, int timeout_millis){
+    struct pollfd pfds[2];
+    int result;
+
+    pfds[0].fd = port->fd;
+    pfds[0].events = POLLOUT;
+    pfds[1].fd = wake_fd;
+    pfds[1].events = POLLIN;
+    result = poll(pfds, 2, timeout_millis);
+    if (result == -1)
+        return errno == EINTR ? 0 : -1;
+    if (result == 0 || (pfds[1].revents & POLLIN))
+        return 0;
+    return pfds[0].revents;
+}
+
+/**
+ * Waits until a port has sent everything queued, as tcdrain() does, but
+ * gives up once wake_fd is readable. The driver's queue, which flow control
+ * can hold indefinitely, is watched with TIOCOUTQ; only once it is empty
+ * does tcdrain() wait for the UART itself, which takes at most a few
+ * character times.
+ * @param port the port, acquired by the caller.
+ * @param wake_fd the descriptor to wake on, or -1 for none.
+ * @return 0 once drained, 1 if wake_fd is readable or -1 with errno set.
+ */
+int port_drain(struct serial_port *port, int wake_fd){
+    struct termios termios;
+    struct pollfd pfd;
+    long character_time = 0, wait;
+    int queued;
+
+    if (port_get_termios(port, &termios) == 0)
+        character_time = character_time_nanos(&termios);
+    pfd.fd = wake_fd;
+    pfd.events = POLLIN;
+    for (;;){
+        if (ioctl(port->fd, TIOCOUTQ, &queued) == -1)
+            return -1;
+        if (queued == 0)
+            break;
+        // Look again about when the queue should have left.
+        wait = character_time * (long) queued / 1000000L;
+        if (poll(&pfd, 1, wait > 1 ? (int) wait : 1) > 0)
+            return 1;
+    }
+    return tcdrain(port->fd) == -1 ? -1 : 0;
+}
+
+/**
+ * Sets the terminal attributes of a port unless they are those last set
+ * through the port, in which case tcsetattr(), and with it any wait for
+ * output to drain, is skipped. For TCSAFLUSH pending input is still
+ * discarded.
+ * @param port the port, acquired by the caller.
+ * @param action the native tcsetattr() action.
+ * @param termios the attributes, zeroed before being filled in so that
+ * requests compare equal byte for byte.
+ * @return 0 upon success or -1 with errno set.
+ */
+int port_set_termios(struct serial_port *port, int action, const struct termios *termios){
+    int result = 0;
+    pthread_mutex_lock(&port->termios_lock);
+    if (port->requested_valid && memcmp(&port->requested, termios, sizeof(*termios)) == 0){
+        __sync_fetch_and_add(&port->statistics.attribute_sets_skipped, 1);
+        if (action == TCSAFLUSH)
+            result = tcflush(port->fd, TCIFLUSH);
+    } else if (tcsetattr(port->fd, action, termios) == 0){
+        port->requested = *termios;
+        port->requested_valid = 1;
+        // The driver may not take every setting as given.
+        port->actual_valid = tcgetattr(port->fd, &port->actual) == 0;
+    } else {
+        port->requested_valid = 0;
+        port->actual_valid = 0;
+        result = -1;
+    }
+    pthread_mutex_unlock(&port->termios_lock);
+    return result;
+}
+
+/**
+ * Gets the terminal attributes of a port, from the cache when they are
+ * known.
+ * @param port the port, acquired by the caller.
+ * @param termios where to store the attributes.
+ * @return 0 upon success or -1 with errno set.
+ */
+int port_get_termios(struct serial_port *port, struct termios *termios){
+    int result = 0;
+    pthread_mutex_lock(&port->termios_lock);
+    if (!port->actual_valid){
+        result = tcgetattr(port->fd, &port->actual);
+        port->actual_valid = result == 0;
+    }
+    if (result == 0)
+        *termios = port->actual;
+    pthread_mutex_unlock(&port->termios_lock);
+    return result;
+}
+
+/**
+ * Forgets the cached terminal attributes of a port, e.g. after they were
+ * changed through its file descriptor.
+ * @param port the port, acquired by the caller.
+ */
+void port_invalidate_termios(struct serial_port *port){
+    pthread_mutex_lock(&port->termios_lock);
+    port->requested_valid = 0;
+    port->actual_valid = 0;
+    pthread_mutex_unlock(&port->termios_lock);
+}
+
+/**
+ * Returns the file descriptor behind a port handle, for use with the natives
+ * that take a file descriptor. Terminal attributes changed that way should
+ * be followed by invalidatePortAttributes.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return the file descriptor.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_getPortFileDescriptor (JNIEnv *env,
+                                                        jobject obj,
+                                                        jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    jint fd;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    fd = port->fd;
+    port_release(port);
+    return fd;
+}
+
+/**
+ * Returns the counters kept for a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return an array of bytes read, bytes written, read calls, write calls,
+ * reads served from the read-ahead buffer, attribute changes skipped and
+ * bytes readPortMarked found marked as errors.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getPortStatistics (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    jlong values[PORT_STATISTICS_COUNT];
+    jlongArray return_array;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    values[0] = port->statistics.bytes_read;
+    values[1] = port->statistics.bytes_written;
+    values[2] = port->statistics.reads;
+    values[3] = port->statistics.writes;
+    values[4] = port->statistics.buffered_reads;
+    values[5] = port->statistics.attribute_sets_skipped;
+    values[6] = port->statistics.marked_errors;
+    port_release(port);
+    return_array = (*env)->NewLongArray(env, PORT_STATISTICS_COUNT);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, PORT_STATISTICS_COUNT, values);
+    return return_array;
+}
+
+/**
+ * Gives a port a read-ahead buffer so that small reads, such as those of
+ * InputStream.read(), are served from native memory rather than with a
+ * system call each. Reads through readPort and the native threads of the
+ * port all share the buffer.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param size the size of the buffer, up to PORT_MAX_READ_AHEAD, or 0 to
+ * turn read-ahead off.
+ * @return 0 upon success.
+ * @throws IOException if an error occurs, EBUSY if the buffer holds more
+ * than the new size.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setReadAhead (JNIEnv *env,
+                                                jobject obj,
+                                                jlong handle,
+                                                jint size){
+    struct serial_port *port;
+    int result;
+    if (size < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    result = port_set_read_ahead(port, size);
+    if (result == -1)
+        throw_ioexception(env, errno);
+    port_release(port);
+    return result;
+}
+
+/**
+ * Forgets the terminal attributes cached for a port so that the next
+ * getPortAttributes and setPortAttributes go to the driver. Needed only
+ * when the attributes were changed other than through the handle.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return 0 upon success.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_invalidatePortAttributes (JNIEnv *env,
+                                                            jobject obj,
+                                                            jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    port_invalidate_termios(port);
+    port_release(port);
+    return 0;
+}
+
+/**
+ * Cancels waits on a port: every cancellable read blocked on it returns at
+ * once with the cancelled status, as do those started later until
+ * resetPortCancel is called. Closing the port cancels waits too.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return 0 upon success.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_cancelPort (JNIEnv *env, jobject obj, jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    eventfd_write(port->cancel_fd, 1);
+    port_release(port);
+    return 0;
+}
+
+/**
+ * Undoes cancelPort so that cancellable reads wait again.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return 0 upon success.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_resetPortCancel (JNIEnv *env, jobject obj, jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    eventfd_t value;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    eventfd_read(port->cancel_fd, &value);
+    port_release(port);
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   port.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Native per-port state. Java holds an opaque handle to each open port
+ * rather than its file descriptor. A handle combines a slot in the port
+ * table with the generation of that slot, so a handle to a closed port can
+ * never reach a later port that reuses the slot or the file descriptor.
+ */
+
+#ifndef PORT_H
+#define	PORT_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include <jni.h>
+#include "jni/com_javatechnics_rs232_Serial.h"
+
+/*
+ The maximum number of ports that may be open through handles at once.
+ */
+#define PORT_MAX_HANDLES 4096
+
+/*
+ The largest read-ahead buffer a port may have.
+ */
+#define PORT_MAX_READ_AHEAD (64 * 1024)
+
+/*
+ Counters kept for every port. Fields are only ever added to. reads counts
+ read() calls; reads served from the read-ahead buffer are counted apart,
+ as are attribute changes that needed no tcsetattr().
+ */
+struct port_statistics {
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t buffered_reads;
+    uint64_t attribute_sets_skipped;
+    uint64_t marked_errors;
+};
+
+#define PORT_STATISTICS_COUNT 7
+
+struct tx_scheduler;
+struct coalescer;
+struct read_tuner;
+struct nmea_parser;
+struct tx_lanes;
+struct port_watchdog;
+
+/*
+ Native helpers that run on behalf of a port, such as threads, register to
+ be stopped when the port is closed. stop is called with the port lock held
+ and must not take it.
+ */
+struct port_helper {
+    void (*stop)(struct port_helper *helper);
+    struct port_helper *next;
+};
+
+struct serial_port {
+    int fd;
+    /*
+     A second descriptor for the device, opened non-blocking on first use by
+     port_write_nonblocking; -1 until then, or fd if it could not be opened.
+     */
+    int nonblocking_fd;
+    /* An eventfd that, once written, wakes and fails every cancellable wait. */
+    int cancel_fd;
+    uint32_t generation;
+    int open;
+    int closing;
+    int references;
+    /* Guards the per-port state below. */
+    pthread_mutex_t lock;
+    /* Set when the port is closed; no helper thread may be started after. */
+    int shutdown;
+    struct port_statistics statistics;
+    /* Guards the read-ahead buffer, whose data is read before the port's. */
+    pthread_mutex_t read_lock;
+    unsigned char *read_ahead;
+    size_t read_ahead_size;
+    size_t read_ahead_start;
+    size_t read_ahead_end;
+    /*
+     Guards the cached terminal attributes: the last set through the port,
+     and what the driver reported back.
+     */
+    pthread_mutex_t termios_lock;
+    struct termios requested;
+    struct termios actual;
+    int requested_valid;
+    int actual_valid;
+    struct port_helper *helpers;
+    /* How far into a PARMRK mark the data read by readPortMarked ended. */
+    int mark_state;
+    /* The transmit scheduler, created on first use. */
+    struct tx_scheduler *scheduler;
+    /* The write coalescing buffer, NULL unless enabled. */
+    struct coalescer *coalescer;
+    /* The VMIN/VTIME tuner, created when first turned on and kept until close. */
+    struct read_tuner *tuner;
+    /* The NMEA sentence parser, created by the first readNmeaSentences. */
+    struct nmea_parser *nmea;
+    /* The prioritised transmit lanes, started on first use. */
+    struct tx_lanes *lanes;
+    /* The idle watchdog, created when first turned on and kept until close. */
+    struct port_watchdog *watchdog;
+    /*
+     The watchdog while it is on, NULL while it is off. Read without the lock
+     by the read and write paths, so unwatched ports pay only the test.
+     */
+    struct port_watchdog *watching;
+};
+
+jlong port_open(const char *path, int native_flags);
+
+int port_close(jlong handle);
+
+struct serial_port* port_acquire(jlong handle);
+
+void port_release(struct serial_port *port);
+
+int port_add_helper(struct serial_port *port, struct port_helper *helper);
+
+void port_remove_helper(struct serial_port *port, struct port_helper *helper);
+
+void port_detach_helper(struct serial_port *port, struct port_helper *helper);
+
+ssize_t port_read(struct serial_port *port, void *buffer, size_t length);
+
+int port_set_read_ahead(struct serial_port *port, size_t size);
+
+int port_wait(struct serial_port *port, short events, int timeout_millis);
+
+ssize_t port_read_cancellable(struct serial_port *port, void *buffer, size_t length,
+                                int timeout_millis);
+
+int port_set_termios(struct serial_port *port, int action, const struct termios *termios);
+
+int port_get_termios(struct serial_port *port, struct termios *termios);
+
+void port_invalidate_termios(struct serial_port *port);
+
+ssize_t port_write(struct serial_port *port, const void *buffer, size_t length);
+
+ssize_t port_write_nonblocking(struct serial_port *port, const void *buffer, size_t length);
+
+int port_wait_writable(struct serial_port *port, int wake_fd, int timeout_millis);
+
+int port_drain(struct serial_port *port, int wake_fd);
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* PORT_H */
@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "port_server.h"
+
+/*
+ A connection to a port server. Reads and writes each use one ring, so the
+ two may run on different threads; each lock keeps a direction to one
+ thread at a time. The table holds one reference and each call using the
+ client another, all guarded by the table lock; the client is freed when
+ the last is dropped.
+ */
+struct port_client {
+    int fd;
+    int references;
+    /* Set by closePortClient; calls still using the client then fail. */
+    int closed;
+    int rx_event;
+    int tx_event;
+    struct share_header *share;
+    size_t map_length;
+    pthread_mutex_t read_lock;
+    pthread_mutex_t write_lock;
+};
+
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct port_client **clients = NULL;
+static int client_capacity = 0;
+
+static void free_port_client(struct port_client *client){
+    if (client->share != NULL)
+        munmap(client->share, client->map_length);
+    if (client->rx_event != -1)
+        close(client->rx_event);
+    if (client->tx_event != -1)
+        close(client->tx_event);
+    if (client->fd != -1)
+        close(client->fd);
+    pthread_mutex_destroy(&client->read_lock);
+    pthread_mutex_destroy(&client->write_lock);
+    free(client);
+}
+
+/*
+ * Stores client in the first free slot of the table and returns its id, or
+ * -1.
+ */
+static int register_client(struct port_client *client){
+    int id = -1, i;
+    pthread_mutex_lock(&clients_lock);
+    for (i = 0; i < client_capacity && id == -1; i++){
+        if (clients[i] == NULL)
+            id = i;
+    }
+    if (id == -1){
+        int capacity = client_capacity == 0 ? 16 : client_capacity * 2;
+        struct port_client **table = realloc(clients, capacity * sizeof(*table));
+        if (table != NULL){
+            memset(table + client_capacity, 0, (capacity - client_capacity) * sizeof(*table));
+            id = client_capacity;
+            clients = table;
+            client_capacity = capacity;
+        }
+    }
+    if (id != -1){
+        client->references = 1;
+        clients[id] = client;
+    }
+    pthread_mutex_unlock(&clients_lock);
+    return id;
+}
+
+/*
+ * Looks up a client and takes a reference to it, to be dropped with
+ * release_client.
+ */
+static struct port_client* acquire_client(jint id){
+    struct port_client *client;
+    pthread_mutex_lock(&clients_lock);
+    client = id >= 0 && id < client_capacity ? clients[id] : NULL;
+    if (client != NULL)
+        client->references++;
+    pthread_mutex_unlock(&clients_lock);
+    return client;
+}
+
+static void release_client(struct port_client *client){
+    int references;
+    pthread_mutex_lock(&clients_lock);
+    references = --client->references;
+    pthread_mutex_unlock(&clients_lock);
+    if (references == 0)
+        free_port_client(client);
+}
+
+/*
+ * Receives the handshake reply and the descriptors that come with it.
+ * Returns 0 or an errno value.
+ */
+static int receive_reply(struct port_client *client){
+    struct share_reply reply;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr *control;
+    union {
+        struct cmsghdr header;
+        unsigned char buffer[CMSG_SPACE(SHARE_FD_COUNT * sizeof(int))];
+    } control_buffer;
+    int fds[SHARE_FD_COUNT];
+
+    bzero(&message, sizeof(message));
+    vector.iov_base = &reply;
+    vector.iov_len = sizeof(reply);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer.buffer;
+    message.msg_controllen = sizeof(control_buffer.buffer);
+    if (recvmsg(client->fd, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC) != sizeof(reply))
+        return errno != 0 ? errno : EPROTO;
+    if (reply.status != 0)
+        return reply.status;
+    control = CMSG_FIRSTHDR(&message);
+    if (control == NULL || control->cmsg_type != SCM_RIGHTS
+            || control->cmsg_len != CMSG_LEN(SHARE_FD_COUNT * sizeof(int)))
+        return EPROTO;
+    memcpy(fds, CMSG_DATA(control), sizeof(fds));
+    client->rx_event = fds[SHARE_FD_RX_EVENT];
+    client->tx_event = fds[SHARE_FD_TX_EVENT];
+    client->map_length = share_region_size(reply.ring_size);
+    client->share = mmap(NULL, client->map_length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fds[SHARE_FD_REGION], 0);
+    close(fds[SHARE_FD_REGION]);
+    if (client->share == MAP_FAILED){
+        client->share = NULL;
+        return errno;
+    }
+    if (client->share->magic != PORT_SHARE_MAGIC || client->share->ring_size != reply.ring_size)
+        return EPROTO;
+    return 0;
+}
+
+/*
+ * Waits for an eventfd to be signalled or the server to go away. Returns 1
+ * if woken, 0 on timeout or -1 with errno set to EPIPE if the server has
+ * gone.
+ */
+static int wait_event(struct port_client *client, int event_fd, int timeout_millis){
+    struct pollfd pfds[2];
+    uint64_t value;
+    int result;
+
+    pfds[0].fd = event_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = client->fd;
+    pfds[1].events = POLLIN;
+    result = poll(pfds, 2, timeout_millis);
+    if (result <= 0)
+        return result == -1 && errno == EINTR ? 1 : result;
+    if (pfds[0].revents & POLLIN)
+        eventfd_read(event_fd, &value);
+    // The server never sends after the handshake: this is the end.
+    if (pfds[1].revents){
+        errno = EPIPE;
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Connects to a port server started with startPortServer, possibly in
+ * another process, to share one of its ports.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param path the file system path of the server's socket.
+ * @param port_index the index of the port in the server's list.
+ * @return the client id, for readPortClient, writePortClient and
+ * closePortClient.
+ * @throws IOException if the server cannot be reached or refuses the
+ * client, e.g. ENODEV if there is no such port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_connectPortServer (JNIEnv *env,
+                                                    jobject obj,
+                                                    jstring path,
+                                                    jint port_index){
+    struct port_client *client;
+    struct sockaddr_un address;
+    struct share_hello hello;
+    const char *c_path;
+    int id, error = 0;
+
+    if (path == NULL || port_index < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    bzero(&address, sizeof(address));
+    address.sun_family = AF_UNIX;
+    c_path = (*env)->GetStringUTFChars(env, path, NULL);
+    if (c_path == NULL)
+        return -1;
+    if (strlen(c_path) >= sizeof(address.sun_path))
+        error = ENAMETOOLONG;
+    else
+        strcpy(address.sun_path, c_path);
+    (*env)->ReleaseStringUTFChars(env, path, c_path);
+    client = error == 0 ? calloc(1, sizeof(*client)) : NULL;
+    if (error == 0 && client == NULL)
+        error = ENOMEM;
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    pthread_mutex_init(&client->read_lock, NULL);
+    pthread_mutex_init(&client->write_lock, NULL);
+    client->rx_event = client->tx_event = -1;
+    hello.magic = PORT_SHARE_MAGIC;
+    hello.port_index = port_index;
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    errno = 0;
+    if (client->fd == -1
+            || connect(client->fd, (struct sockaddr*) &address, sizeof(address)) == -1
+            || send(client->fd, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello))
+        error = errno;
+    else
+        error = receive_reply(client);
+    if (error == 0 && (id = register_client(client)) == -1)
+        error = ENOMEM;
+    if (error != 0){
+        free_port_client(client);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return id;
+}
+
+/**
+ * Reads data a port server has received for this client.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the client id returned by connectPortServer.
+ * @param buffer the array to read into.
+ * @param offset the offset into buffer to store the first byte.
+ * @param length the maximum number of bytes to read.
+ * @param timeout_millis how long to wait for data, negative to wait
+ * indefinitely.
+ * @return the number of bytes read, 0 if the timeout expired.
+ * @throws IOException if the id is not that of a connected client, EBADF if
+ * the client is closed while waiting or, once everything received has been
+ * read, EPIPE if the server has gone.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_readPortClient (JNIEnv *env,
+                                                jobject obj,
+                                                jint id,
+                                                jbyteArray buffer,
+                                                jint offset,
+                                                jint length,
+                                                jint timeout_millis){
+    unsigned char n_buffer[PORT_SERVER_READ_SIZE];
+    struct port_client *client;
+    size_t result;
+    int woken, error = 0;
+
+    if (length < 0 || (client = acquire_client(id)) == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    if (length > PORT_SERVER_READ_SIZE)
+        length = PORT_SERVER_READ_SIZE;
+    pthread_mutex_lock(&client->read_lock);
+    for (;;){
+        result = share_ring_get(&client->share->rx, share_rx_data(client->share),
+                                client->share->ring_size, n_buffer, length);
+        if (result > 0 || length == 0)
+            break;
+        woken = wait_event(client, client->rx_event, timeout_millis);
+        if (woken == 0)
+            break;
+        if (woken == -1){
+            // Anything that arrived before the server went is still wanted.
+            result = share_ring_get(&client->share->rx, share_rx_data(client->share),
+                                    client->share->ring_size, n_buffer, length);
+            if (result == 0)
+                error = client->closed ? EBADF : EPIPE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&client->read_lock);
+    release_client(client);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    if (result > 0)
+        (*env)->SetByteArrayRegion(env, buffer, offset, result, (jbyte*) n_buffer);
+    return result;
+}
+
+/**
+ * Queues data for a port server to write to the client's port, waiting
+ * while the transmit ring is full.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the client id returned by connectPortServer.
+ * @param buffer the array holding the data.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the number of bytes to write.
+ * @return the number of bytes queued, which is length.
+ * @throws IOException if the id is not that of a connected client, EBADF if
+ * the client is closed while waiting or EPIPE if the server has gone.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_writePortClient (JNIEnv *env,
+                                                jobject obj,
+                                                jint id,
+                                                jbyteArray buffer,
+                                                jint offset,
+                                                jint length){
+    unsigned char n_buffer[PORT_SERVER_READ_SIZE];
+    struct port_client *client;
+    size_t done = 0, chunk, copied = 0, put;
+    int was_empty, error = 0;
+
+    if (length < 0 || (client = acquire_client(id)) == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    pthread_mutex_lock(&client->write_lock);
+    while (done < (size_t) length && error == 0){
+        if (copied == 0){
+            chunk = (size_t) length - done < PORT_SERVER_READ_SIZE ? (size_t) length - done : PORT_SERVER_READ_SIZE;
+            (*env)->GetByteArrayRegion(env, buffer, offset + done, chunk, (jbyte*) n_buffer);
+            if ((*env)->ExceptionCheck(env)){
+                pthread_mutex_unlock(&client->write_lock);
+                release_client(client);
+                return -1;
+            }
+        }
+        put = share_ring_put(&client->share->tx, share_tx_data(client->share),
+                            client->share->ring_size, n_buffer + copied, chunk - copied, &was_empty);
+        if (was_empty && put > 0 && send(client->fd, "w", 1, MSG_DONTWAIT | MSG_NOSIGNAL) == -1
+                && errno != EAGAIN)
+            error = EPIPE;
+        copied += put;
+        done += put;
+        if (copied == chunk){
+            copied = 0;
+            continue;
+        }
+        // Full: ask to be woken once the server has drained it, then look again.
+        share_store(&client->share->tx.waiting, 1);
+        if (share_load(&client->share->tx.head) - share_load(&client->share->tx.tail)
+                < client->share->ring_size)
+            continue;
+        if (wait_event(client, client->tx_event, -1) == -1)
+            error = client->closed ? EBADF : errno;
+    }
+    pthread_mutex_unlock(&client->write_lock);
+    release_client(client);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return length;
+}
+
+/**
+ * Disconnects from a port server. Reads and writes waiting on the client
+ * are woken and fail.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the client id returned by connectPortServer.
+ * @return 0 upon success or -1 if an error occurs and an exception not thrown.
+ * @throws IOException if the id is not that of a connected client.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_closePortClient (JNIEnv *env, jobject obj, jint id){
+    struct port_client *client = NULL;
+
+    pthread_mutex_lock(&clients_lock);
+    if (id >= 0 && id < client_capacity){
+        client = clients[id];
+        clients[id] = NULL;
+    }
+    if (client != NULL)
+        client->closed = 1;
+    pthread_mutex_unlock(&clients_lock);
+    if (client == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    // Waiters poll the socket, so this wakes them; the last to leave frees.
+    shutdown(client->fd, SHUT_RDWR);
+    release_client(client);
+    return 0;
+}
@@ -0,0 +1,717 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "port_server.h"
+
+
+static pthread_mutex_t servers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct port_server **servers = NULL;
+static int server_capacity = 0;
+
+uint64_t share_load(const uint64_t *position){
+    uint64_t value = *(volatile const uint64_t*) position;
+    __sync_synchronize();
+    return value;
+}
+
+void share_store(uint64_t *position, uint64_t value){
+    __sync_synchronize();
+    *(volatile uint64_t*) position = value;
+    __sync_synchronize();
+}
+
+/**
+ * Works out the size of a shared region.
+ * @param ring_size the size of each ring, a power of two.
+ * @return the size in bytes.
+ */
+size_t share_region_size(uint32_t ring_size){
+    return sizeof(struct share_header) + 2 * (size_t) ring_size;
+}
+
+unsigned char* share_rx_data(struct share_header *share){
+    return (unsigned char*) (share + 1);
+}
+
+unsigned char* share_tx_data(struct share_header *share){
+    return (unsigned char*) (share + 1) + share->ring_size;
+}
+
+/**
+ * Copies as much as fits into a ring. Called by the producer only.
+ * @param ring the ring.
+ * @param data the ring's data.
+ * @param size the ring's size, a power of two.
+ * @param source the data to copy.
+ * @param length the number of bytes of source.
+ * @param was_empty set if the consumer had read everything before.
+ * @return the number of bytes copied.
+ */
+size_t share_ring_put(struct share_ring *ring, unsigned char *data, uint32_t size,
+                        const unsigned char *source, size_t length, int *was_empty){
+    uint64_t head = ring->head, tail = share_load(&ring->tail);
+    size_t offset = head & (size - 1), first;
+    if (length > size - (head - tail))
+        length = size - (head - tail);
+    first = size - offset < length ? size - offset : length;
+    memcpy(data + offset, source, first);
+    memcpy(data, source + first, length - first);
+    if (was_empty != NULL)
+        *was_empty = head == tail;
+    share_store(&ring->head, head + length);
+    return length;
+}
+
+/**
+ * Copies as much as is available out of a ring. Called by the consumer
+ * only.
+ * @param ring the ring.
+ * @param data the ring's data.
+ * @param size the ring's size, a power of two.
+ * @param destination where to copy the data.
+ * @param length the room in destination.
+ * @return the number of bytes copied.
+ */
+size_t share_ring_get(struct share_ring *ring, const unsigned char *data, uint32_t size,
+                        unsigned char *destination, size_t length){
+    uint64_t tail = ring->tail, head = share_load(&ring->head);
+    size_t offset = tail & (size - 1), first;
+    if (length > head - tail)
+        length = head - tail;
+    first = size - offset < length ? size - offset : length;
+    memcpy(destination, data + offset, first);
+    memcpy(destination + first, data, length - first);
+    share_store(&ring->tail, tail + length);
+    return length;
+}
+
+static uint64_t now_nanos(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void free_client(struct share_client *client){
+    if (client->share != NULL)
+        munmap(client->share, client->map_length);
+    if (client->rx_event != -1)
+        close(client->rx_event);
+    if (client->tx_event != -1)
+        close(client->tx_event);
+    close(client->fd);
+    free(client);
+}
+
+static void remove_client(struct port_server *server, int slot){
+    struct share_client *client;
+    pthread_mutex_lock(&server->lock);
+    client = server->clients[slot];
+    server->clients[slot] = NULL;
+    pthread_mutex_unlock(&server->lock);
+    if (client->port_index != -1 && server->ports[client->port_index].pending_client == slot)
+        server->ports[client->port_index].pending_client = -1;
+    free_client(client);
+}
+
+/*
+ * Sends the handshake reply, with the client's descriptors if it was
+ * accepted.
+ */
+static int send_reply(int fd, const struct share_reply *reply, const int *fds){
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr *control;
+    union {
+        struct cmsghdr header;
+        unsigned char buffer[CMSG_SPACE(SHARE_FD_COUNT * sizeof(int))];
+    } control_buffer;
+
+    bzero(&message, sizeof(message));
+    vector.iov_base = (void*) reply;
+    vector.iov_len = sizeof(*reply);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    if (fds != NULL){
+        bzero(&control_buffer, sizeof(control_buffer));
+        message.msg_control = control_buffer.buffer;
+        message.msg_controllen = sizeof(control_buffer.buffer);
+        control = CMSG_FIRSTHDR(&message);
+        control->cmsg_level = SOL_SOCKET;
+        control->cmsg_type = SCM_RIGHTS;
+        control->cmsg_len = CMSG_LEN(SHARE_FD_COUNT * sizeof(int));
+        memcpy(CMSG_DATA(control), fds, SHARE_FD_COUNT * sizeof(int));
+    }
+    return sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(*reply) ? 0 : -1;
+}
+
+/*
+ * Takes a newly connected client. Its hello is read as it arrives by
+ * greet_client so that a client that connects and says nothing cannot
+ * stall the ports.
+ */
+static void accept_client(struct port_server *server){
+    struct share_client *client;
+    struct share_reply reply;
+    int fd, slot;
+
+    fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd == -1)
+        return;
+    for (slot = 0; slot < PORT_SERVER_MAX_CLIENTS && server->clients[slot] != NULL; slot++)
+        ;
+    client = slot < PORT_SERVER_MAX_CLIENTS ? calloc(1, sizeof(*client)) : NULL;
+    if (client == NULL){
+        bzero(&reply, sizeof(reply));
+        reply.status = slot < PORT_SERVER_MAX_CLIENTS ? ENOMEM : EBUSY;
+        send_reply(fd, &reply, NULL);
+        close(fd);
+        return;
+    }
+    client->fd = fd;
+    client->port_index = -1;
+    client->rx_event = client->tx_event = -1;
+    client->hello_deadline = now_nanos() + PORT_SERVER_HELLO_MILLIS * 1000000ULL;
+    pthread_mutex_lock(&server->lock);
+    server->clients[slot] = client;
+    pthread_mutex_unlock(&server->lock);
+}
+
+/*
+ * Reads what has arrived of a client's hello and, once it is all there,
+ * creates the client's shared region and eventfds and hands them over.
+ * Returns -1 if the client is to be dropped; a client that is refused is
+ * sent the reason first.
+ */
+static int greet_client(struct port_server *server, struct share_client *client){
+    struct share_reply reply;
+    int fds[SHARE_FD_COUNT];
+    ssize_t result;
+    int region;
+
+    result = recv(client->fd, (unsigned char*) &client->hello + client->hello_length,
+                    sizeof(client->hello) - client->hello_length, MSG_DONTWAIT);
+    if (result == -1)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    if (result == 0)
+        return -1;
+    client->hello_length += result;
+    if (client->hello_length < sizeof(client->hello))
+        return 0;
+    if (client->hello.magic != PORT_SHARE_MAGIC)
+        return -1;
+    bzero(&reply, sizeof(reply));
+    if (client->hello.port_index >= (uint32_t) server->port_count
+            || server->ports[client->hello.port_index].port == NULL){
+        reply.status = ENODEV;
+        send_reply(client->fd, &reply, NULL);
+        return -1;
+    }
+    client->map_length = share_region_size(server->ring_size);
+    client->rx_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    client->tx_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    region = memfd_create("j232-port-share", MFD_CLOEXEC);
+    if (client->rx_event == -1 || client->tx_event == -1 || region == -1
+            || ftruncate(region, client->map_length) == -1
+            || (client->share = mmap(NULL, client->map_length, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, region, 0)) == MAP_FAILED){
+        reply.status = errno;
+        client->share = NULL;
+        send_reply(client->fd, &reply, NULL);
+        if (region != -1)
+            close(region);
+        return -1;
+    }
+    client->share->magic = PORT_SHARE_MAGIC;
+    client->share->ring_size = server->ring_size;
+    reply.ring_size = server->ring_size;
+    fds[SHARE_FD_REGION] = region;
+    fds[SHARE_FD_RX_EVENT] = client->rx_event;
+    fds[SHARE_FD_TX_EVENT] = client->tx_event;
+    result = send_reply(client->fd, &reply, fds);
+    close(region);
+    if (result == -1)
+        return -1;
+    // From here on the client is sent data and has its ring drained.
+    pthread_mutex_lock(&server->lock);
+    client->port_index = client->hello.port_index;
+    pthread_mutex_unlock(&server->lock);
+    return 0;
+}
+
+/*
+ * Reads what a port has and copies it into the receive ring of each of its
+ * clients. Returns -1 if the port can no longer be read.
+ */
+static int serve_port(struct port_server *server, int index){
+    unsigned char buffer[PORT_SERVER_READ_SIZE];
+    struct share_client *client;
+    ssize_t result;
+    size_t copied, length = sizeof(buffer);
+    int slot, was_empty, available = 0;
+
+    // Never ask for more than is there, so VMIN cannot hold the thread.
+    if (ioctl(server->ports[index].port->fd, FIONREAD, &available) == 0
+            && available > 0 && (size_t) available < length)
+        length = available;
+    result = port_read(server->ports[index].port, buffer, length);
+    if (result == -1)
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    // Readable yet nothing read: the line has hung up.
+    if (result == 0)
+        return -1;
+    for (slot = 0; slot < PORT_SERVER_MAX_CLIENTS; slot++){
+        client = server->clients[slot];
+        if (client == NULL || client->port_index != index)
+            continue;
+        copied = share_ring_put(&client->share->rx, share_rx_data(client->share),
+                                server->ring_size, buffer, result, &was_empty);
+        client->rx_bytes += copied;
+        client->rx_dropped += result - copied;
+        if (was_empty && copied > 0)
+            eventfd_write(client->rx_event, 1);
+    }
+    return 0;
+}
+
+/*
+ * Makes sure a port has a chunk waiting to be written if any of its
+ * clients has queued data, taking from each client's transmit ring in turn
+ * and waking a client waiting for room. Returns 1 if there is a chunk.
+ */
+static int fill_pending(struct port_server *server, int index){
+    struct served_port *served = &server->ports[index];
+    struct share_client *client;
+    size_t length;
+    int i, slot;
+
+    if (served->pending_start < served->pending_end)
+        return 1;
+    for (i = 0; i < PORT_SERVER_MAX_CLIENTS; i++){
+        slot = (served->next_client + i) % PORT_SERVER_MAX_CLIENTS;
+        client = server->clients[slot];
+        if (client == NULL || client->port_index != index)
+            continue;
+        length = share_ring_get(&client->share->tx, share_tx_data(client->share),
+                                server->ring_size, served->pending, sizeof(served->pending));
+        if (length == 0)
+            continue;
+        served->pending_start = 0;
+        served->pending_end = length;
+        served->pending_client = slot;
+        served->next_client = (slot + 1) % PORT_SERVER_MAX_CLIENTS;
+        if (share_load(&client->share->tx.waiting)){
+            share_store(&client->share->tx.waiting, 0);
+            eventfd_write(client->tx_event, 1);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Writes a port's waiting chunk once poll() reports room for it. The port
+ * is non-blocking, so whatever the driver does not take stays waiting for
+ * the next POLLOUT.
+ */
+static void write_pending(struct port_server *server, int index){
+    struct served_port *served = &server->ports[index];
+    ssize_t result;
+
+    result = port_write(served->port, served->pending + served->pending_start,
+                        served->pending_end - served->pending_start);
+    if (result == -1){
+        if (errno == EINTR || errno == EAGAIN)
+            return;
+        // Data for a failed port is discarded like that of a closed one.
+        served->pending_start = served->pending_end = 0;
+        return;
+    }
+    served->pending_start += result;
+    if (served->pending_client != -1)
+        server->clients[served->pending_client]->tx_bytes += result;
+}
+
+/*
+ * Wakes the server thread to drain a client's transmit ring. Returns -1 if
+ * the client has gone.
+ */
+static int serve_client(struct port_server *server, struct share_client *client){
+    char wakeups[64];
+    ssize_t result;
+
+    if (client->port_index == -1)
+        return greet_client(server, client);
+    result = recv(client->fd, wakeups, sizeof(wakeups), MSG_DONTWAIT);
+    if (result == 0 || (result == -1 && errno != EAGAIN && errno != EINTR))
+        return -1;
+    return 0;
+}
+
+/*
+ * Makes a served port non-blocking, keeping its flags to be put back by
+ * release_port. Returns 0 or an errno value.
+ */
+static int set_nonblocking(struct served_port *served){
+    int flags = fcntl(served->port->fd, F_GETFL);
+    if (flags == -1 || fcntl(served->port->fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        return errno;
+    served->saved_flags = flags;
+    return 0;
+}
+
+/*
+ * Puts back the flags of a served port and drops the server's reference.
+ */
+static void release_port(struct served_port *served){
+    if (served->saved_flags != -1)
+        fcntl(served->port->fd, F_SETFL, served->saved_flags);
+    served->saved_flags = -1;
+    port_release(served->port);
+    served->port = NULL;
+}
+
+/*
+ * Drops a port that was closed, cancelled or failed, disconnecting its
+ * clients.
+ */
+static void drop_port(struct port_server *server, int index){
+    int slot;
+    for (slot = 0; slot < PORT_SERVER_MAX_CLIENTS; slot++){
+        if (server->clients[slot] != NULL && server->clients[slot]->port_index == index)
+            remove_client(server, slot);
+    }
+    release_port(&server->ports[index]);
+    server->ports[index].pending_start = server->ports[index].pending_end = 0;
+}
+
+/*
+ * Thread body. Polls the listening socket, the ports, their cancel
+ * eventfds and the clients, serving whichever are ready. A port is written
+ * a chunk at a time, and only when poll() says it has room, so that a slow
+ * port holds up nothing but its own clients' transmissions.
+ */
+static void* server_thread(void *arg){
+    struct port_server *server = (struct port_server*) arg;
+    struct pollfd pfds[2 + 2 * PORT_SERVER_MAX_PORTS + PORT_SERVER_MAX_CLIENTS];
+    int owners[2 + 2 * PORT_SERVER_MAX_PORTS + PORT_SERVER_MAX_CLIENTS];
+    struct share_client *client;
+    int count, first_client, i, slot, timeout;
+    uint64_t value, deadline, now;
+
+    thread_config_register();
+    pfds[0].fd = server->wake_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = server->listen_fd;
+    pfds[1].events = POLLIN;
+    while (!server->stopping){
+        count = 2;
+        for (i = 0; i < server->port_count; i++){
+            if (server->ports[i].port == NULL)
+                continue;
+            owners[count] = owners[count + 1] = i;
+            pfds[count].fd = server->ports[i].port->fd;
+            pfds[count++].events = POLLIN | (fill_pending(server, i) ? POLLOUT : 0);
+            pfds[count].fd = server->ports[i].port->cancel_fd;
+            pfds[count++].events = POLLIN;
+        }
+        first_client = count;
+        deadline = 0;
+        for (slot = 0; slot < PORT_SERVER_MAX_CLIENTS; slot++){
+            client = server->clients[slot];
+            if (client == NULL)
+                continue;
+            if (client->port_index == -1 && (deadline == 0 || client->hello_deadline < deadline))
+                deadline = client->hello_deadline;
+            owners[count] = slot;
+            pfds[count].fd = client->fd;
+            pfds[count++].events = POLLIN;
+        }
+        timeout = -1;
+        if (deadline != 0){
+            now = now_nanos();
+            timeout = deadline > now ? (deadline - now) / 1000000 + 1 : 0;
+        }
+        if (poll(pfds, count, timeout) == -1)
+            continue;
+        if (pfds[0].revents & POLLIN)
+            eventfd_read(server->wake_fd, &value);
+        if (server->stopping)
+            break;
+        for (i = 2; i < first_client; i += 2){
+            // Closing or cancelling a port drops it from the server.
+            if ((pfds[i + 1].revents & POLLIN) || (pfds[i].revents & (POLLERR | POLLNVAL)))
+                drop_port(server, owners[i]);
+            else if ((pfds[i].revents & (POLLIN | POLLHUP)) && serve_port(server, owners[i]) == -1)
+                drop_port(server, owners[i]);
+            else if (pfds[i].revents & POLLOUT)
+                write_pending(server, owners[i]);
+        }
+        now = now_nanos();
+        for (i = first_client; i < count; i++){
+            slot = owners[i];
+            client = server->clients[slot];
+            if (client == NULL)
+                continue;
+            if ((pfds[i].revents != 0 && serve_client(server, client) == -1)
+                    || (client->port_index == -1 && client->hello_deadline <= now))
+                remove_client(server, slot);
+        }
+        if (pfds[1].revents & POLLIN)
+            accept_client(server);
+    }
+    thread_config_unregister();
+    return NULL;
+}
+
+static void free_server(struct port_server *server){
+    int i;
+    for (i = 0; i < PORT_SERVER_MAX_CLIENTS; i++){
+        if (server->clients[i] != NULL)
+            free_client(server->clients[i]);
+    }
+    for (i = 0; i < server->port_count; i++){
+        if (server->ports[i].port != NULL)
+            release_port(&server->ports[i]);
+    }
+    if (server->listen_fd != -1){
+        close(server->listen_fd);
+        unlink(server->address.sun_path);
+    }
+    if (server->wake_fd != -1)
+        close(server->wake_fd);
+    pthread_mutex_destroy(&server->lock);
+    free(server->ports);
+    free(server);
+}
+
+/*
+ * Stores server in the first free slot of the table and returns its id, or
+ * -1.
+ */
+static int register_server(struct port_server *server){
+    int id = -1, i;
+    pthread_mutex_lock(&servers_lock);
+    for (i = 0; i < server_capacity && id == -1; i++){
+        if (servers[i] == NULL)
+            id = i;
+    }
+    if (id == -1){
+        int capacity = server_capacity == 0 ? 4 : server_capacity * 2;
+        struct port_server **table = realloc(servers, capacity * sizeof(*table));
+        if (table != NULL){
+            memset(table + server_capacity, 0, (capacity - server_capacity) * sizeof(*table));
+            id = server_capacity;
+            servers = table;
+            server_capacity = capacity;
+        }
+    }
+    if (id != -1)
+        servers[id] = server;
+    pthread_mutex_unlock(&servers_lock);
+    return id;
+}
+
+/**
+ * Starts a port server sharing a set of ports with local clients, which
+ * connect to a UNIX socket created at path with connectPortServer. Every
+ * client of a port receives everything read from it from the time it
+ * connects; what a client transmits is written to the port as the server
+ * drains it. Data for a client whose receive ring is full is dropped and
+ * counted. The server holds a reference to each port, drops a port that is
+ * closed, cancelled or fails and disconnects its clients. Ports are made
+ * non-blocking while served and should not otherwise be read.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param path the file system path of the socket, which must not exist.
+ * @param handles the handles of the ports, which clients select by index.
+ * @param ring_size the size of each client's rings, a power of two, or 0
+ * for PORT_SERVER_DEFAULT_RING.
+ * @return the server id, for getPortServerStatistics and stopPortServer.
+ * @throws IOException if the arguments are invalid, a handle is not that of
+ * an open port or the socket cannot be created.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_startPortServer (JNIEnv *env,
+                                                    jobject obj,
+                                                    jstring path,
+                                                    jlongArray handles,
+                                                    jint ring_size){
+    struct port_server *server;
+    const char *c_path;
+    jlong values[PORT_SERVER_MAX_PORTS];
+    jsize count, i;
+    int id, error = 0;
+
+    if (ring_size == 0)
+        ring_size = PORT_SERVER_DEFAULT_RING;
+    count = handles != NULL ? (*env)->GetArrayLength(env, handles) : 0;
+    if (path == NULL || count < 1 || count > PORT_SERVER_MAX_PORTS || ring_size < 4096
+            || ring_size > PORT_SERVER_MAX_RING || (ring_size & (ring_size - 1)) != 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    server = calloc(1, sizeof(*server));
+    if (server == NULL || (server->ports = calloc(count, sizeof(*server->ports))) == NULL){
+        free(server);
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    server->ring_size = ring_size;
+    server->listen_fd = server->wake_fd = -1;
+    (*env)->GetLongArrayRegion(env, handles, 0, count, values);
+    for (i = 0; i < count && error == 0; i++){
+        server->ports[i].pending_client = -1;
+        server->ports[i].saved_flags = -1;
+        server->ports[i].port = port_acquire(values[i]);
+        if (server->ports[i].port == NULL)
+            error = errno;
+        else
+            server->port_count = i + 1;
+        if (error == 0)
+            error = set_nonblocking(&server->ports[i]);
+    }
+    c_path = error == 0 ? (*env)->GetStringUTFChars(env, path, NULL) : NULL;
+    if (error == 0 && c_path == NULL){
+        free_server(server);
+        return -1;
+    }
+    if (error == 0){
+        server->address.sun_family = AF_UNIX;
+        if (strlen(c_path) >= sizeof(server->address.sun_path))
+            error = ENAMETOOLONG;
+        else
+            strcpy(server->address.sun_path, c_path);
+        (*env)->ReleaseStringUTFChars(env, path, c_path);
+    }
+    if (error == 0){
+        server->wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (server->wake_fd == -1)
+            error = errno;
+    }
+    if (error == 0){
+        server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (server->listen_fd == -1){
+            error = errno;
+        } else if (bind(server->listen_fd, (struct sockaddr*) &server->address,
+                        sizeof(server->address)) == -1){
+            error = errno;
+            // Do not unlink a socket that belongs to someone else.
+            close(server->listen_fd);
+            server->listen_fd = -1;
+        } else if (listen(server->listen_fd, 16) == -1){
+            error = errno;
+        }
+    }
+    if (error != 0){
+        free_server(server);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    id = register_server(server);
+    if (id == -1){
+        free_server(server);
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    if ((error = pthread_create(&server->thread, NULL, server_thread, server)) != 0){
+        pthread_mutex_lock(&servers_lock);
+        servers[id] = NULL;
+        pthread_mutex_unlock(&servers_lock);
+        free_server(server);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return id;
+}
+
+/**
+ * Returns the counters of the clients connected to a port server.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the server id returned by startPortServer.
+ * @return PORT_SERVER_CLIENT_FIELDS values for each connected client.
+ * @throws IOException if the id is not that of a running server.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getPortServerStatistics (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint id){
+    jlong values[PORT_SERVER_MAX_CLIENTS * PORT_SERVER_CLIENT_FIELDS];
+    jlongArray return_array;
+    struct port_server *server;
+    struct share_client *client;
+    int count = 0, slot;
+
+    pthread_mutex_lock(&servers_lock);
+    server = id >= 0 && id < server_capacity ? servers[id] : NULL;
+    if (server != NULL){
+        pthread_mutex_lock(&server->lock);
+        for (slot = 0; slot < PORT_SERVER_MAX_CLIENTS; slot++){
+            client = server->clients[slot];
+            if (client == NULL || client->port_index == -1)
+                continue;
+            values[count * PORT_SERVER_CLIENT_FIELDS] = client->port_index;
+            values[count * PORT_SERVER_CLIENT_FIELDS + 1] = client->rx_bytes;
+            values[count * PORT_SERVER_CLIENT_FIELDS + 2] = client->rx_dropped;
+            values[count * PORT_SERVER_CLIENT_FIELDS + 3] = client->tx_bytes;
+            count++;
+        }
+        pthread_mutex_unlock(&server->lock);
+    }
+    pthread_mutex_unlock(&servers_lock);
+    if (server == NULL){
+        throw_ioexception(env, EINVAL);
+        return NULL;
+    }
+    return_array = (*env)->NewLongArray(env, count * PORT_SERVER_CLIENT_FIELDS);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, count * PORT_SERVER_CLIENT_FIELDS, values);
+    return return_array;
+}
+
+/**
+ * Stops a port server, disconnecting its clients and removing its socket.
+ * The ports stay open.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the server id returned by startPortServer.
+ * @return 0 upon success or -1 if an error occurs and an exception not thrown.
+ * @throws IOException if the id is not that of a running server.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_stopPortServer (JNIEnv *env, jobject obj, jint id){
+    struct port_server *server = NULL;
+
+    pthread_mutex_lock(&servers_lock);
+    if (id >= 0 && id < server_capacity){
+        server = servers[id];
+        servers[id] = NULL;
+    }
+    pthread_mutex_unlock(&servers_lock);
+    if (server == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    server->stopping = 1;
+    eventfd_write(server->wake_fd, 1);
+    pthread_join(server->thread, NULL);
+    free_server(server);
+    return 0;
+}
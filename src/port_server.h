@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   port_server.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Port sharing between processes. A port server owns a set of ports and
+ * accepts local clients on a UNIX socket. Each client is handed a shared
+ * memory region holding a receive ring, which the server fills with
+ * everything read from the client's port, and a transmit ring, which the
+ * server drains to the port. Two eventfds wake the client when data
+ * arrives and when transmit space is freed; the client wakes the server by
+ * writing a byte to the socket.
+ */
+
+#ifndef PORT_SERVER_H
+#define	PORT_SERVER_H
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include "port.h"
+#include "thread_config.h"
+
+#define PORT_SHARE_MAGIC 0x6A323332
+
+#define PORT_SERVER_MAX_PORTS 64
+#define PORT_SERVER_MAX_CLIENTS 64
+#define PORT_SERVER_DEFAULT_RING (64 * 1024)
+#define PORT_SERVER_MAX_RING (16 * 1024 * 1024)
+#define PORT_SERVER_READ_SIZE 4096
+
+/*
+ The most written to a port at once. A tty reports POLLOUT once fewer than
+ 256 bytes are queued, so a write this size finds room on any usual driver
+ and the server thread, which serves every port, does not block in it.
+ */
+#define PORT_SERVER_WRITE_CHUNK 256
+
+/*
+ How long a client has to send its hello once connected.
+ */
+#define PORT_SERVER_HELLO_MILLIS 1000
+
+/*
+ The statistics handed to Java for each connected client: the index of its
+ port, bytes received, bytes dropped because its receive ring was full and
+ bytes transmitted.
+ */
+#define PORT_SERVER_CLIENT_FIELDS 4
+
+/*
+ One direction of a shared region. The producer alone moves head and the
+ consumer alone moves tail; both only ever increase. waiting is set by a
+ producer that found the ring full and wants to be woken when it drains.
+ Each side's fields have a cache line to themselves.
+ */
+struct share_ring {
+    uint64_t head;
+    unsigned char producer_pad[56];
+    uint64_t tail;
+    uint64_t waiting;
+    unsigned char consumer_pad[48];
+};
+
+/*
+ The start of a shared region. The receive ring's data follows the header
+ and the transmit ring's data follows that.
+ */
+struct share_header {
+    uint32_t magic;
+    uint32_t ring_size;
+    unsigned char pad[56];
+    struct share_ring rx;
+    struct share_ring tx;
+};
+
+/*
+ The messages of the handshake. The server's reply carries the region and
+ the two eventfds when status is 0 and is an errno value otherwise.
+ */
+struct share_hello {
+    uint32_t magic;
+    uint32_t port_index;
+};
+
+struct share_reply {
+    int32_t status;
+    uint32_t ring_size;
+};
+
+#define SHARE_FD_REGION     0
+#define SHARE_FD_RX_EVENT   1
+#define SHARE_FD_TX_EVENT   2
+#define SHARE_FD_COUNT      3
+
+struct share_client {
+    int fd;
+    /* -1 until the hello has been received. */
+    int port_index;
+    struct share_hello hello;
+    size_t hello_length;
+    /* When the client is dropped if it has not sent its hello. */
+    uint64_t hello_deadline;
+    int rx_event;
+    int tx_event;
+    struct share_header *share;
+    size_t map_length;
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;
+    uint64_t tx_bytes;
+};
+
+struct served_port {
+    /* NULL once the port is closed or cancelled and dropped. */
+    struct serial_port *port;
+    /*
+     The file status flags of the port before the server made it
+     non-blocking, or -1 if it has not.
+     */
+    int saved_flags;
+    /* A chunk taken from a client's transmit ring and not yet written. */
+    unsigned char pending[PORT_SERVER_WRITE_CHUNK];
+    size_t pending_start;
+    size_t pending_end;
+    /* The slot of the client the chunk came from, -1 once it has gone. */
+    int pending_client;
+    /* The client slot whose transmit ring is drained next. */
+    int next_client;
+};
+
+struct port_server {
+    struct sockaddr_un address;
+    int listen_fd;
+    int wake_fd;
+    int stopping;
+    pthread_t thread;
+    uint32_t ring_size;
+    int port_count;
+    struct served_port *ports;
+    /* Guards the client table against the statistics call. */
+    pthread_mutex_t lock;
+    struct share_client *clients[PORT_SERVER_MAX_CLIENTS];
+};
+
+size_t share_region_size(uint32_t ring_size);
+
+unsigned char* share_rx_data(struct share_header *share);
+
+unsigned char* share_tx_data(struct share_header *share);
+
+size_t share_ring_put(struct share_ring *ring, unsigned char *data, uint32_t size,
+                        const unsigned char *source, size_t length, int *was_empty);
+
+size_t share_ring_get(struct share_ring *ring, const unsigned char *data, uint32_t size,
+                        unsigned char *destination, size_t length);
+
+uint64_t share_load(const uint64_t *position);
+
+void share_store(uint64_t *position, uint64_t value);
+
+#endif	/* PORT_SERVER_H */
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "rs485.h"
+
+static const int java_rs485_flags[] = {RS485_FLAG_ENABLED,
+                                        RS485_FLAG_RTS_ON_SEND,
+                                        RS485_FLAG_RTS_AFTER_SEND,
+                                        RS485_FLAG_RX_DURING_TX};
+static const int native_rs485_flags[] = {SER_RS485_ENABLED,
+                                        SER_RS485_RTS_ON_SEND,
+                                        SER_RS485_RTS_AFTER_SEND,
+                                        SER_RS485_RX_DURING_TX};
+#define RS485_FLAG_COUNT (sizeof(java_rs485_flags) / sizeof(java_rs485_flags[0]))
+
+static int kernel_get_config(int fd, struct serial_rs485 *config){
+    return ioctl(fd, TIOCGRS485, config);
+}
+
+static int kernel_set_config(int fd, const struct serial_rs485 *config){
+    return ioctl(fd, TIOCSRS485, config);
+}
+
+static int kernel_set_rts(int fd, int level){
+    int bits = TIOCM_RTS;
+    return ioctl(fd, level ? TIOCMBIS : TIOCMBIC, &bits);
+}
+
+static const struct rs485_ops kernel_ops = {kernel_get_config,
+                                            kernel_set_config,
+                                            kernel_set_rts};
+
+/*
+ Emulated configurations, one per file descriptor configured while
+ emulation was selected; a port the driver configures has none. The RTS
+ level is kept so that ports without modem lines, such as ptys, can still
+ be driven. write_lock keeps the turnarounds of writers to the same port
+ apart without holding up other ports. references counts writers using an
+ entry, under rs485_lock; an entry forgotten while in use is freed by the
+ last of them.
+ */
+struct emulated_port {
+    int fd;
+    struct serial_rs485 config;
+    int rts_level;
+    pthread_mutex_t write_lock;
+    int references;
+    int forgotten;
+    struct emulated_port *next;
+};
+
+static struct emulated_port *emulated_ports = NULL;
+static const struct rs485_ops *driver_ops = &kernel_ops;
+static int rs485_mode = RS485_MODE_AUTO;
+static pthread_mutex_t rs485_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Returns the emulated state of a file descriptor, creating it if asked.
+ * Called with rs485_lock held.
+ */
+static struct emulated_port* find_emulated(int fd, int create){
+    struct emulated_port *entry;
+    for (entry = emulated_ports; entry != NULL && entry->fd != fd; entry = entry->next)
+        ;
+    if (entry == NULL && create){
+        entry = calloc(1, sizeof(*entry));
+        if (entry != NULL){
+            pthread_mutex_init(&entry->write_lock, NULL);
+            entry->fd = fd;
+            entry->next = emulated_ports;
+            emulated_ports = entry;
+        }
+    }
+    return entry;
+}
+
+static void free_emulated(struct emulated_port *entry){
+    pthread_mutex_destroy(&entry->write_lock);
+    free(entry);
+}
+
+/*
+ * Unlinks the emulated state of a file descriptor, freeing it unless a
+ * writer is using it. Called with rs485_lock held.
+ */
+static void unlink_emulated(int fd){
+    struct emulated_port **link, *entry;
+    for (link = &emulated_ports; *link != NULL; link = &(*link)->next){
+        if ((*link)->fd == fd){
+            entry = *link;
+            *link = entry->next;
+            if (entry->references > 0)
+                entry->forgotten = 1;
+            else
+                free_emulated(entry);
+            break;
+        }
+    }
+}
+
+/**
+ * Replaces the driver operations, e.g. with a fake driver for testing.
+ * @param ops the new operations or NULL to restore the ioctl() based ones.
+ * @return the operations previously installed.
+ */
+const struct rs485_ops* rs485_install_ops(const struct rs485_ops *ops){
+    const struct rs485_ops *previous;
+    pthread_mutex_lock(&rs485_lock);
+    previous = driver_ops;
+    driver_ops = ops != NULL ? ops : &kernel_ops;
+    pthread_mutex_unlock(&rs485_lock);
+    return previous;
+}
+
+/**
+ * Reads the RS-485 configuration of a port.
+ * @param fd the file descriptor of the port.
+ * @param config where to store the configuration.
+ * @param emulated set to 1 if the configuration is emulated, otherwise 0.
+ * @return 0 upon success or -1 with errno set.
+ */
+int rs485_get(int fd, struct serial_rs485 *config, int *emulated){
+    struct emulated_port *entry;
+    int result = 0;
+    pthread_mutex_lock(&rs485_lock);
+    entry = find_emulated(fd, 0);
+    *emulated = entry != NULL;
+    if (entry != NULL){
+        *config = entry->config;
+    } else if (rs485_mode == RS485_MODE_EMULATED){
+        // Not configured yet, i.e. disabled.
+        bzero(config, sizeof(*config));
+        *emulated = 1;
+    } else {
+        result = driver_ops->get_config(fd, config);
+        if (result == -1 && errno == ENOTTY && rs485_mode == RS485_MODE_AUTO){
+            bzero(config, sizeof(*config));
+            *emulated = 1;
+            result = 0;
+        }
+    }
+    pthread_mutex_unlock(&rs485_lock);
+    return result;
+}
+
+/**
+ * Applies an RS-485 configuration to a port, by the driver or emulated as
+ * the current mode selects. The port keeps that choice until it is next
+ * configured.
+ * @param fd the file descriptor of the port.
+ * @param config the configuration.
+ * @return 0 upon success or -1 with errno set.
+ */
+int rs485_set(int fd, const struct serial_rs485 *config){
+    struct emulated_port *entry = NULL;
+    int result = -1, emulate;
+    pthread_mutex_lock(&rs485_lock);
+    emulate = rs485_mode == RS485_MODE_EMULATED;
+    if (!emulate){
+        result = driver_ops->set_config(fd, config);
+        emulate = result == -1 && errno == ENOTTY && rs485_mode == RS485_MODE_AUTO;
+        if (result == 0)
+            unlink_emulated(fd);
+    }
+    if (emulate){
+        entry = find_emulated(fd, 1);
+        if (entry == NULL){
+            errno = ENOMEM;
+            result = -1;
+        } else {
+            entry->config = *config;
+            result = 0;
+            // Leave the bus in its receive state straight away.
+            if (config->flags & SER_RS485_ENABLED){
+                entry->rts_level = (config->flags & SER_RS485_RTS_AFTER_SEND) != 0;
+                driver_ops->set_rts(fd, entry->rts_level);
+            }
+        }
+    }
+    pthread_mutex_unlock(&rs485_lock);
+    return result;
+}
+
+static void sleep_millis(uint32_t millis){
+    struct timespec delay;
+    delay.tv_sec = millis / 1000;
+    delay.tv_nsec = (long) (millis % 1000) * 1000000L;
+    while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+        ;
+}
+
+static void switch_rts(struct emulated_port *entry, const struct rs485_ops *ops, int level){
+    pthread_mutex_lock(&rs485_lock);
+    entry->rts_level = level;
+    pthread_mutex_unlock(&rs485_lock);
+    ops->set_rts(entry->fd, level);
+}
+
+static ssize_t write_all(int fd, const unsigned char *buffer, size_t length){
+    size_t written = 0;
+    ssize_t result;
+    while (written < length){
+        result = write(fd, buffer + written, length - written);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            return written > 0 ? (ssize_t) written : -1;
+        }
+        written += result;
+    }
+    return written;
+}
+
+/**
+ * Writes to a port. Where RS-485 is emulated and enabled RTS is switched to
+ * its send level, the data written and drained and RTS switched back, with
+ * the configured delays; otherwise this is a plain write of all the data.
+ * @param fd the file descriptor of the port.
+ * @param buffer the data.
+ * @param length the number of bytes.
+ * @return the number of bytes written or -1 with errno set.
+ */
+ssize_t rs485_write(int fd, const void *buffer, size_t length){
+    struct emulated_port *entry;
+    struct serial_rs485 config;
+    const struct rs485_ops *ops;
+    ssize_t result;
+    int error;
+
+    pthread_mutex_lock(&rs485_lock);
+    entry = find_emulated(fd, 0);
+    if (entry == NULL || !(entry->config.flags & SER_RS485_ENABLED)){
+        pthread_mutex_unlock(&rs485_lock);
+        return write_all(fd, buffer, length);
+    }
+    entry->references++;
+    pthread_mutex_unlock(&rs485_lock);
+    // Writers to the same port take turns so that turnarounds cannot interleave.
+    pthread_mutex_lock(&entry->write_lock);
+    pthread_mutex_lock(&rs485_lock);
+    config = entry->config;
+    ops = driver_ops;
+    pthread_mutex_unlock(&rs485_lock);
+    switch_rts(entry, ops, (config.flags & SER_RS485_RTS_ON_SEND) != 0);
+    if (config.delay_rts_before_send > 0)
+        sleep_millis(config.delay_rts_before_send);
+    result = write_all(fd, buffer, length);
+    error = errno;
+    tcdrain(fd);
+    if (config.delay_rts_after_send > 0)
+        sleep_millis(config.delay_rts_after_send);
+    switch_rts(entry, ops, (config.flags & SER_RS485_RTS_AFTER_SEND) != 0);
+    pthread_mutex_unlock(&entry->write_lock);
+    pthread_mutex_lock(&rs485_lock);
+    if (--entry->references == 0 && entry->forgotten)
+        free_emulated(entry);
+    pthread_mutex_unlock(&rs485_lock);
+    errno = error;
+    return result;
+}
+
+/**
+ * Discards any emulated configuration of a file descriptor that is being
+ * closed.
+ * @param fd the file descriptor.
+ */
+void rs485_forget(int fd){
+    pthread_mutex_lock(&rs485_lock);
+    unlink_emulated(fd);
+    pthread_mutex_unlock(&rs485_lock);
+}
+
+/**
+ * Selects how RS-485 configurations are applied to ports configured after
+ * this call. Ports already configured keep the way theirs was applied.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param mode one of the RS485_MODE_* values.
+ * @return the previous mode.
+ * @throws IOException with EINVAL if the mode is not valid.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setRS485Mode (JNIEnv *env, jobject obj, jint mode){
+    jint previous;
+    if (mode < RS485_MODE_KERNEL || mode > RS485_MODE_AUTO){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    pthread_mutex_lock(&rs485_lock);
+    previous = rs485_mode;
+    rs485_mode = mode;
+    pthread_mutex_unlock(&rs485_lock);
+    return previous;
+}
+
+/**
+ * Gets the RS-485 configuration of a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @return an array of the RS485_FLAG_* flags, the RTS delay before send and
+ * the RTS delay after send in milliseconds.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_javatechnics_rs232_Serial_getRS485Config (JNIEnv *env,
+                                                jobject obj,
+                                                jint fileDescriptor){
+    struct serial_rs485 config;
+    jint values[RS485_CONFIG_FIELDS];
+    jintArray return_array;
+    size_t i;
+    int emulated;
+    if (rs485_get(fileDescriptor, &config, &emulated) == -1){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    values[0] = emulated ? RS485_FLAG_EMULATED : 0;
+    for (i = 0; i < RS485_FLAG_COUNT; i++){
+        if (config.flags & native_rs485_flags[i])
+            values[0] |= java_rs485_flags[i];
+    }
+    values[1] = config.delay_rts_before_send;
+    values[2] = config.delay_rts_after_send;
+    return_array = (*env)->NewIntArray(env, RS485_CONFIG_FIELDS);
+    if (return_array != NULL)
+        (*env)->SetIntArrayRegion(env, return_array, 0, RS485_CONFIG_FIELDS, values);
+    return return_array;
+}
+
+/**
+ * Sets the RS-485 configuration of a port, so that RTS is switched to its
+ * send level for each transmission and back afterwards.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param flags the RS485_FLAG_* flags.
+ * @param delay_before the delay between raising RTS and sending in
+ * milliseconds.
+ * @param delay_after the delay between the end of sending and dropping RTS
+ * in milliseconds.
+ * @return 0 upon success.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setRS485Config (JNIEnv *env,
+                                                jobject obj,
+                                                jint fileDescriptor,
+                                                jint flags,
+                                                jint delay_before,
+                                                jint delay_after){
+    struct serial_rs485 config;
+    size_t i;
+    if (delay_before < 0 || delay_after < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    bzero(&config, sizeof(config));
+    for (i = 0; i < RS485_FLAG_COUNT; i++){
+        if (flags & java_rs485_flags[i])
+            config.flags |= native_rs485_flags[i];
+    }
+    config.delay_rts_before_send = delay_before;
+    config.delay_rts_after_send = delay_after;
+    if (rs485_set(fileDescriptor, &config) == -1){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Writes to an RS-485 port, switching RTS natively around the write where
+ * direction control is emulated. With the driver in control this is the
+ * same as nativeWrite except that all the data is written.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param fileDescriptor file descriptor of the serial port.
+ * @param buffer the array holding the data.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the number of bytes.
+ * @return the number of bytes written.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_writeRS485 (JNIEnv *env,
+                                            jobject obj,
+                                            jint fileDescriptor,
+                                            jbyteArray buffer,
+                                            jint offset,
+                                            jint length){
+    unsigned char *data;
+    ssize_t result;
+    if (length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    data = malloc(length > 0 ? length : 1);
+    if (data == NULL){
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    (*env)->GetByteArrayRegion(env, buffer, offset, length, (jbyte*) data);
+    if ((*env)->ExceptionCheck(env)){
+        free(data);
+        return -1;
+    }
+    result = rs485_write(fileDescriptor, data, length);
+    free(data);
+    if (result == -1){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    return (jint) result;
+}
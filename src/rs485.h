@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   rs485.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * RS-485 direction control. Where the driver supports TIOCSRS485 the kernel
+ * switches RTS around each transmission; otherwise the same configuration
+ * can be emulated, with RTS switched natively around writeRS485. All driver
+ * access goes through a table of operations that can be replaced, e.g. by
+ * a fake driver under test.
+ */
+
+#ifndef RS485_H
+#define	RS485_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <linux/serial.h>
+#include <jni.h>
+#include "jni/com_javatechnics_rs232_Serial.h"
+
+/*
+ RS-485 flags as passed to and from Java.
+ */
+#define RS485_FLAG_ENABLED          0x01
+#define RS485_FLAG_RTS_ON_SEND      0x02
+#define RS485_FLAG_RTS_AFTER_SEND   0x04
+#define RS485_FLAG_RX_DURING_TX     0x08
+/* Reported only: the configuration is emulated rather than in the driver. */
+#define RS485_FLAG_EMULATED         0x100
+
+/*
+ How configurations are applied: always by the driver, always emulated, or
+ by the driver falling back to emulation when it has no RS-485 support.
+ */
+#define RS485_MODE_KERNEL   0
+#define RS485_MODE_EMULATED 1
+#define RS485_MODE_AUTO     2
+
+/*
+ The configuration handed to Java: flags and the delays before and after
+ sending in milliseconds.
+ */
+#define RS485_CONFIG_FIELDS 3
+
+/*
+ Driver access. Each function returns 0 or -1 with errno set, ENOTTY
+ meaning the driver has no RS-485 support.
+ */
+struct rs485_ops {
+    int (*get_config)(int fd, struct serial_rs485 *config);
+    int (*set_config)(int fd, const struct serial_rs485 *config);
+    int (*set_rts)(int fd, int level);
+};
+
+const struct rs485_ops* rs485_install_ops(const struct rs485_ops *ops);
+
+int rs485_get(int fd, struct serial_rs485 *config, int *emulated);
+
+int rs485_set(int fd, const struct serial_rs485 *config);
+
+ssize_t rs485_write(int fd, const void *buffer, size_t length);
+
+void rs485_forget(int fd);
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* RS485_H */
@@ -81,6 +81,8 @@ Java_com_javatechnics_rs232_Serial_openSerialPort (JNIEnv * env, jobject obj, js
 JNIEXPORT jint JNICALL 
 Java_com_javatechnics_rs232_Serial_closeSerialPort (JNIEnv *env, jobject obj, jint fd){
     jint return_value = -1;
+    rs485_forget(fd);
+    decoder_forget(fd);
     return_value = close(fd);
     if (return_value == -1){
         jint error = errno;
@@ -114,71 +116,87 @@ Java_com_javatechnics_rs232_Serial_setNativeTerminalAttributes (JNIEnv *env,
                                                                 jint term_action, 
                                                                 jobject termios){
     int return_value = -1;
-    jfieldID field_ids[5] = {0, 0, 0, 0, 0};
-    int i = 0;
     struct termios l_termios;
-    //Ensure the termios structure is zeroed.
-    bzero(&l_termios, sizeof(l_termios));
     //Get the terminal action flags
     int termattr = get_real_flags(java_terminal_settings_flags,
                                     terminal_settings_flags,
                                     term_action,
                                     number_terminal_settings_flags);
-    //Get the class of termios TODO: check termios is not null;
-    jclass cls = (*env)->GetObjectClass(env, termios);
-    //Now get all the field IDs for termios
-    for (; i < JAVA_TERMIOS_FIELD_COUNT; i++){
-        field_ids[i] = (*env)->GetFieldID(env,
-                                            cls,
-                                            java_termios_fields[i],
-                                            java_termios_field_descriptors[i]);
-        if (field_ids[i] == NULL){
-            //Exception is already thrown by the JVM if the call fails
-            return return_value;
+    if (get_native_termios(env, termios, &l_termios) != 0){
+        //Exception is already thrown by the JVM if the call fails
+        return return_value;
+    }
+    
+    return_value = tcsetattr(file_descriptor, termattr, &l_termios);
+    if (return_value == -1){
+        jint error = errno;
+        jclass newIOException = (*env)->FindClass(env, \
+                        "java/io/IOException");
+        if (newIOException != NULL){
+            (*env)->ThrowNew(env, newIOException, strerror(error));
         }
     }
+    return return_value;
+    
+}
+
+/**
+ * A helper function that converts a Java TermIOS object into a native termios
+ * structure.
+ * @param env pointer to the JNI environment.
+ * @param termios the Java TermIOS object to convert.
+ * @param l_termios the termios structure to fill in. It is zeroed first.
+ * @return 0 upon success or -1 if an exception has been thrown in the JVM.
+ */
+int get_native_termios(JNIEnv *env, jobject termios, struct termios *l_termios){
+    jfieldID field_ids[JAVA_TERMIOS_FIELD_COUNT];
+    jclass cls;
+    jbyteArray j_c_cc;
+    //Ensure the termios structure is zeroed.
+    bzero(l_termios, sizeof(*l_termios));
+    if (termios == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    //Get the class of termios and all the field IDs for it.
+    cls = (*env)->GetObjectClass(env, termios);
+    if (get_field_ids(env, cls, java_termios_fields, \
+                                java_termios_field_descriptors, \
+                                field_ids, \
+                                JAVA_TERMIOS_FIELD_COUNT) != 0){
+        return -1;
+    }
     
     syslog(LOG_USER | LOG_DEBUG, "Passed in flag values:: c_cflag: %d  c_iflag: %d   c_oflag: %d  c_lflag: %d", (*env)->GetIntField(env, termios, field_ids[2]), \
                                                                                                                 (*env)->GetIntField(env, termios, field_ids[0]), \
                                                                                                                 (*env)->GetIntField(env, termios, field_ids[1]), \
                                                                                                                 (*env)->GetIntField(env, termios, field_ids[3]));
     
-    l_termios.c_iflag = get_real_flags(java_input_flags, \
+    l_termios->c_iflag = get_real_flags(java_input_flags, \
                                         input_flags, \
                                         (*env)->GetIntField(env, termios, field_ids[0]), \
                                         number_input_flags);
-    l_termios.c_oflag = get_real_flags(java_output_flags, \
+    l_termios->c_oflag = get_real_flags(java_output_flags, \
                                         output_flags, \
                                         (*env)->GetIntField(env, termios, field_ids[1]), \
                                         number_output_flags);
-    l_termios.c_cflag = get_real_flags(java_control_flags, \
+    l_termios->c_cflag = get_real_flags(java_control_flags, \
                                         control_flags, \
                                         (*env)->GetIntField(env, termios, field_ids[2]), \
                                         number_control_flags);
-    l_termios.c_lflag = get_real_flags(java_local_flags, \
+    l_termios->c_lflag = get_real_flags(java_local_flags, \
                                         local_flags, \
                                         (*env)->GetIntField(env, termios, field_ids[3]), \
                                         number_local_flags);
     
 #ifdef DEBUG
-    syslog(LOG_USER | LOG_DEBUG, "c_cflag = %u", l_termios.c_cflag);
+    syslog(LOG_USER | LOG_DEBUG, "c_cflag = %u", l_termios->c_cflag);
 #endif
-    syslog(LOG_USER | LOG_DEBUG, "Setting c_cflag: 0x%x  c_iflag: 0x%x   c_oflag: 0x%x  c_lflag: 0x%x", l_termios.c_cflag, l_termios.c_iflag, l_termios.c_oflag, l_termios.c_lflag);
-    jbyteArray j_c_cc = (*env)->GetObjectField(env, termios, field_ids[4]);
+    syslog(LOG_USER | LOG_DEBUG, "Setting c_cflag: 0x%x  c_iflag: 0x%x   c_oflag: 0x%x  c_lflag: 0x%x", l_termios->c_cflag, l_termios->c_iflag, l_termios->c_oflag, l_termios->c_lflag);
+    j_c_cc = (*env)->GetObjectField(env, termios, field_ids[4]);
     (*env)->GetByteArrayRegion(env, j_c_cc, 0, number_control_character_flags, \
-                                                (jbyte*)(l_termios.c_cc));
-    
-    return_value = tcsetattr(file_descriptor, termattr, &l_termios);
-    if (return_value == -1){
-        jint error = errno;
-        jclass newIOException = (*env)->FindClass(env, \
-                        "java/io/IOException");
-        if (newIOException != NULL){
-            (*env)->ThrowNew(env, newIOException, strerror(error));
-        }
-    }
-    return return_value;
-    
+                                                (jbyte*)(l_termios->c_cc));
+    return (*env)->ExceptionCheck(env) ? -1 : 0;
 }
 
 /**
@@ -194,13 +212,35 @@ JNIEXPORT jobject JNICALL
 Java_com_javatechnics_rs232_Serial_getNativeTerminalAttributes (JNIEnv *env, 
                                                                 jobject obj,
                                                                 jint fileDescriptor){
+    struct termios l_termios;
+#ifdef DEBUG
+    syslog(LOG_USER | DEBUG, "Entered getNativeTerminalAttributes." );
+#endif
+    // Get the termios structure for the fileDescriptor
+    if (tcgetattr(fileDescriptor, &l_termios) == -1){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+#ifdef DEBUG
+    syslog(LOG_USER | LOG_DEBUG, "termios struct: c_iflag:%d c_oflag:%d c_cflag:%d c_lflag:%d", l_termios.c_iflag, l_termios.c_oflag, l_termios.c_cflag, l_termios.c_lflag);
+#endif
+    return new_java_termios(env, &l_termios);
+}
+
+/**
+ * A helper function that converts a native termios structure into a new Java
+ * TermIOS object.
+ * @param env pointer to the JNI environment.
+ * @param l_termios the terminal settings to convert.
+ * @return the TermIOS object or NULL if an exception has been thrown.
+ */
+jobject new_java_termios(JNIEnv *env, const struct termios *l_termios){
     jclass termiosClass;
     jmethodID cid;      //Constructor ID for TermIOS
     jfieldID field_ids[JAVA_TERMIOS_FIELD_COUNT];
     jobject returnObject = NULL;
-    struct termios l_termios;
-    tcflag_t* termios_flags[] = { &l_termios.c_iflag, &l_termios.c_oflag, \
-                                    &l_termios.c_cflag, &l_termios.c_lflag };
+    const tcflag_t* termios_flags[] = { &l_termios->c_iflag, &l_termios->c_oflag, \
+                                    &l_termios->c_cflag, &l_termios->c_lflag };
     // An array of pointers to the Java flags used in TermIOS
     const int* const java_flags_array[] = {java_input_flags, java_output_flags, java_control_flags, java_local_flags};
     // An array of pointers to native flags used in termios structure.
@@ -208,78 +248,51 @@ Java_com_javatechnics_rs232_Serial_getNativeTerminalAttributes (JNIEnv *env,
     //An array of sizes of each array in the above two.
     int flags_array_sizes[] = {number_input_flags, number_output_flags, number_control_flags, number_local_flags};
     int i;
-#ifdef DEBUG
-    syslog(LOG_USER | DEBUG, "Entered getNativeTerminalAttributes." );
-#endif
     termiosClass = (*env)->FindClass(env,TERMIOS_CLASS_STRING);
     if (termiosClass == NULL){
-        //Throw exception and return null
-        returnObject = NULL;
-        
-    }else{
-        //Try to get the default constructor
-        cid = (*env)->GetMethodID(env, termiosClass, "<init>", "()V");
-        if (cid == NULL){
-            returnObject = NULL;
-        } else {
-            returnObject = (*env)->NewObject(env, termiosClass, cid);
-            if (returnObject == NULL){
-                //Exception thrown. return NULL
-            } else {
-                // Get the termios structure for the fileDescriptor
-                int result = tcgetattr(fileDescriptor, &l_termios);
-#ifdef DEBUG
-                syslog(LOG_USER | LOG_DEBUG, "termios struct: c_iflag:%d c_oflag:%d c_cflag:%d c_lflag:%d", l_termios.c_iflag, l_termios.c_oflag, l_termios.c_cflag, l_termios.c_lflag);
-#endif
-                if (result == -1){
-                    // Throw exception.
-                    jint error = errno;
-                    jclass newIOException = (*env)->FindClass(env, \
-                        "java/io/IOException");
-                    if (newIOException != NULL){
-                        (*env)->ThrowNew(env, newIOException, strerror(error));
-                    } else {
-                        returnObject = NULL;
-                    }
-                } else {
-                     
-                    int result = get_field_ids(env, termiosClass, \
-                                                    java_termios_fields, \
-                                                    java_termios_field_descriptors, \
-                                                    field_ids, \
-                                                    JAVA_TERMIOS_FIELD_COUNT);
-                    if (result != 0){
-                        // Exception will automatically be thrown in the Java code.
-                        returnObject = NULL;
-                    } else {
-                        unsigned int flag = 0;
-                        for (i = 0; i < JAVA_TERMIOS_FIELD_COUNT - 1; i++){
+        //Exception thrown. return NULL
+        return NULL;
+    }
+    //Try to get the default constructor
+    cid = (*env)->GetMethodID(env, termiosClass, "<init>", "()V");
+    if (cid == NULL){
+        return NULL;
+    }
+    returnObject = (*env)->NewObject(env, termiosClass, cid);
+    if (returnObject == NULL){
+        //Exception thrown. return NULL
+        return NULL;
+    }
+    if (get_field_ids(env, termiosClass, \
+                        java_termios_fields, \
+                        java_termios_field_descriptors, \
+                        field_ids, \
+                        JAVA_TERMIOS_FIELD_COUNT) != 0){
+        // Exception will automatically be thrown in the Java code.
+        return NULL;
+    }
+    unsigned int flag = 0;
+    for (i = 0; i < JAVA_TERMIOS_FIELD_COUNT - 1; i++){
 #ifdef DEBUG
-                            syslog(LOG_USER | LOG_DEBUG, "termios.%s = %u", java_termios_fields[i], (unsigned int) *termios_flags[i]);
+        syslog(LOG_USER | LOG_DEBUG, "termios.%s = %u", java_termios_fields[i], (unsigned int) *termios_flags[i]);
 #endif
-                            flag = get_java_flags(java_flags_array[i], \
-                                                   native_flags_array[i],     \
-                                                    (int) *termios_flags[i], \
-                                                    flags_array_sizes[i]);
+        flag = get_java_flags(java_flags_array[i], \
+                               native_flags_array[i],     \
+                                (int) *termios_flags[i], \
+                                flags_array_sizes[i]);
 #ifdef DEBUG
-                            syslog(LOG_USER | LOG_DEBUG, "Returned flag value: %d", flag);
+        syslog(LOG_USER | LOG_DEBUG, "Returned flag value: %d", flag);
 #endif
-                            (*env)->SetIntField(env, returnObject, field_ids[i], (int) flag);
-                        }
-                        //Set the control characters
-                        jbyteArray j_c_cc = (*env)->GetObjectField(env, returnObject, field_ids[4]);
-                        (*env)->SetByteArrayRegion(env, j_c_cc, 0, \
-                                                number_control_character_flags,\
-                                                l_termios.c_cc);
-                    }
-                }
-            }
-        }
+        (*env)->SetIntField(env, returnObject, field_ids[i], (int) flag);
     }
-    
+    //Set the control characters
+    jbyteArray j_c_cc = (*env)->GetObjectField(env, returnObject, field_ids[4]);
+    (*env)->SetByteArrayRegion(env, j_c_cc, 0, \
+                            number_control_character_flags,\
+                            (const jbyte*) l_termios->c_cc);
     return returnObject;
-    
 }
+
 /**
  * This function is a wrapper around ioctl() and gets the serial port control
  * bits.
@@ -370,21 +383,303 @@ Java_com_javatechnics_rs232_Serial_nativeTCFlush (JNIEnv * env,
                                             jobject jobj, 
                                             jint fileDescriptor,
                                             jint queue_selector){
-    int return_value = 0, native_queue_selector = 0, i = 0;
+    int return_value = 0, native_queue_selector = 0;
     native_queue_selector = get_native_value(java_flush_queue_selector,
                                                 flush_queue_selector,
                                                 queue_selector,
                                                 number_flush_queue_selectors);
+    return_value = flush_queue(fileDescriptor, native_queue_selector);
+    if (return_value == -1){
+        throw_ioexception(env, errno);
+    }
+    return return_value;
+    
+}
+
+/**
+ * A helper function that flushes the given queue(s) of a serial port. The
+ * flush is repeated a few times with a short pause in between to catch bytes
+ * still in flight from the UART.
+ * @param fd file descriptor of the serial port.
+ * @param native_queue_selector native tcflush() queue selector.
+ * @return 0 upon success or -1 with errno set.
+ */
+int flush_queue(int fd, int native_queue_selector){
+    int return_value = 0, i = 0;
     for (; i < 3; i++){
-        return_value = tcflush(fileDescriptor, native_queue_selector);
+        return_value = tcflush(fd, native_queue_selector);
         if (return_value == -1){
-            throw_ioexception(env, errno);
             break;
         }
         usleep(150);
     }
     return return_value;
-    
+}
+
+/**
+ * Opens a serial port and returns a handle to its native state rather than
+ * its file descriptor. The handle is used with the other *Port natives.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param path the file system path to the serial port, e.g. "/dev/ttyS0".
+ * @param flags the Java open flags, as for openSerialPort.
+ * @return the handle of the port.
+ * @throws IOException if the port cannot be opened.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_javatechnics_rs232_Serial_openPort (JNIEnv *env,
+                                            jobject obj,
+                                            jstring path,
+                                            jint flags){
+    jlong return_value = -1;
+    int native_flags = get_real_flags(java_open_flags, open_flags, \
+                                        flags, number_open_flags);
+    const char *c_path;
+    if (path == NULL){
+        throw_ioexception(env, EINVAL);
+        return return_value;
+    }
+    c_path = (*env)->GetStringUTFChars(env, path, NULL);
+    if (c_path != NULL){
+        return_value = port_open(c_path, native_flags);
+        if (return_value == -1){
+            throw_ioexception(env, errno);
+        }
+        (*env)->ReleaseStringUTFChars(env, path, c_path);
+    }
+    return return_value;
+}
+
+/**
+ * Closes a port opened with openPort. The handle must not be used again.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return 0 upon success or -1 if an error occurs and an exception not thrown.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_closePort (JNIEnv *env,
+                                            jobject obj,
+                                            jlong handle){
+    int return_value = port_close(handle);
+    if (return_value == -1){
+        throw_ioexception(env, errno);
+    }
+    return return_value;
+}
+
+/**
+ * Sets the terminal attributes of a port, as setNativeTerminalAttributes,
+ * except that tcsetattr() is skipped when the attributes are those last set.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param term_action terminal action flags. See tcsetattr() docs.
+ * @param termios the Java TermIOS settings.
+ * @return 0 upon success or -1 if an error occurs and an exception not thrown.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setPortAttributes (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle,
+                                                    jint term_action,
+                                                    jobject termios){
+    struct serial_port *port;
+    struct termios l_termios;
+    int return_value = -1;
+    int termattr = get_real_flags(java_terminal_settings_flags,
+                                    terminal_settings_flags,
+                                    term_action,
+                                    number_terminal_settings_flags);
+    if (get_native_termios(env, termios, &l_termios) != 0){
+        return return_value;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return return_value;
+    }
+    return_value = port_set_termios(port, termattr, &l_termios);
+    if (return_value == -1){
+        throw_ioexception(env, errno);
+    }
+    port_release(port);
+    return return_value;
+}
+
+/**
+ * Gets the terminal attributes of a port, as getNativeTerminalAttributes,
+ * from the cache kept for the port when it is valid.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return TermIOS Java object representing the terminal settings.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_javatechnics_rs232_Serial_getPortAttributes (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct termios l_termios;
+    int result;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    result = port_get_termios(port, &l_termios);
+    port_release(port);
+    if (result == -1){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    return new_java_termios(env, &l_termios);
+}
+
+/*
+ * Shared state for a batch of ports being opened by openSerialPorts. Every
+ * port gets the same, already translated, configuration; only the path and
+ * the result differ.
+ */
+struct open_batch {
+    char **paths;
+    int native_flags;
+    int termattr;
+    struct termios l_termios;
+    int native_queue_selector;
+    jint *results;
+};
+
+/*
+ * Opens, locks, configures and flushes a single port of an open_batch. The
+ * result is the file descriptor or the negated errno of the step that failed,
+ * in which case the port is closed again.
+ */
+static void open_batch_port(int index, void *context){
+    struct open_batch *batch = (struct open_batch*) context;
+    int fd, error = 0;
+
+    if (batch->paths[index] == NULL){
+        batch->results[index] = -EINVAL;
+        return;
+    }
+    fd = open(batch->paths[index], batch->native_flags);
+    if (fd == -1){
+        batch->results[index] = -errno;
+        return;
+    }
+    if (ioctl(fd, TIOCEXCL) == -1
+            || tcsetattr(fd, batch->termattr, &batch->l_termios) == -1
+            || (batch->native_queue_selector != -1
+                && flush_queue(fd, batch->native_queue_selector) == -1)){
+        error = errno;
+        close(fd);
+        syslog(LOG_USER | LOG_DEBUG, "Failed to open %s: %s", batch->paths[index], strerror(error));
+        batch->results[index] = -error;
+        return;
+    }
+    batch->results[index] = fd;
+}
+
+/**
+ * Opens a number of serial ports in parallel, each with the same settings.
+ * Each port is opened with the given flags, made exclusive (TIOCEXCL),
+ * configured with tcsetattr() and then has its queues flushed. The work is
+ * spread over several native threads so that slow opens (e.g. USB adapters)
+ * overlap rather than add up.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param paths the file system paths of the serial ports.
+ * @param flags the Java open flags, as for openSerialPort.
+ * @param term_action the Java terminal action flags, as for
+ * setNativeTerminalAttributes.
+ * @param termios the TermIOS settings applied to every port.
+ * @param queue_selector the queue(s) to flush once configured, as for
+ * nativeTCFlush. An unknown selector skips the flush.
+ * @return an array with one entry per path: the file descriptor if the port
+ * was opened and configured or the negated errno value if it was not.
+ * @throws IOException if the arguments are invalid or memory cannot be
+ * allocated.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_javatechnics_rs232_Serial_openSerialPorts (JNIEnv *env,
+                                                    jobject obj,
+                                                    jobjectArray paths,
+                                                    jint flags,
+                                                    jint term_action,
+                                                    jobject termios,
+                                                    jint queue_selector){
+    struct open_batch batch;
+    jintArray return_array = NULL;
+    jsize count, i;
+
+    if (paths == NULL){
+        throw_ioexception(env, EINVAL);
+        return NULL;
+    }
+    count = (*env)->GetArrayLength(env, paths);
+    // Translate the shared settings once for the whole batch.
+    batch.native_flags = get_real_flags(java_open_flags, open_flags, \
+                                            flags, number_open_flags);
+    batch.termattr = get_real_flags(java_terminal_settings_flags,
+                                    terminal_settings_flags,
+                                    term_action,
+                                    number_terminal_settings_flags);
+    batch.native_queue_selector = get_native_value(java_flush_queue_selector,
+                                                flush_queue_selector,
+                                                queue_selector,
+                                                number_flush_queue_selectors);
+    if (get_native_termios(env, termios, &batch.l_termios) != 0){
+        return NULL;
+    }
+    batch.paths = calloc(count + 1, sizeof(char*));
+    batch.results = calloc(count + 1, sizeof(jint));
+    if (batch.paths == NULL || batch.results == NULL){
+        throw_ioexception(env, ENOMEM);
+        goto cleanup;
+    }
+    // Paths are copied out of the JVM as the worker threads cannot use env.
+    for (i = 0; i < count; i++){
+        jstring path = (*env)->GetObjectArrayElement(env, paths, i);
+        if (path != NULL){
+            const char *c_path = (*env)->GetStringUTFChars(env, path, NULL);
+            if (c_path == NULL){
+                goto cleanup;
+            }
+            batch.paths[i] = strdup(c_path);
+            (*env)->ReleaseStringUTFChars(env, path, c_path);
+            (*env)->DeleteLocalRef(env, path);
+            if (batch.paths[i] == NULL){
+                throw_ioexception(env, ENOMEM);
+                goto cleanup;
+            }
+        }
+    }
+
+    run_parallel(count, PARALLEL_MAX_THREADS, open_batch_port, &batch);
+
+    return_array = (*env)->NewIntArray(env, count);
+    if (return_array != NULL){
+        (*env)->SetIntArrayRegion(env, return_array, 0, count, batch.results);
+    } else {
+        // The ports cannot be handed back so do not leak them.
+        for (i = 0; i < count; i++){
+            if (batch.results[i] >= 0)
+                close(batch.results[i]);
+        }
+    }
+
+cleanup:
+    if (batch.paths != NULL){
+        for (i = 0; i < count; i++){
+            free(batch.paths[i]);
+        }
+    }
+    free(batch.paths);
+    free(batch.results);
+    return return_array;
 }
 
 /**
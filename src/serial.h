@@ -30,6 +30,10 @@
 #include <string.h>
 #include <jni.h>
 #include "jni/com_javatechnics_rs232_Serial.h"
+#include "parallel.h"
+#include "port.h"
+#include "rs485.h"
+#include "input_stream.h"
 #ifdef DEBUG
 #include <syslog.h>
 #endif
@@ -297,4 +301,12 @@ int get_field_ids(JNIEnv* env, jclass cls, const char* const field_names[], \
 
 int get_native_value(const int const java_values[], const int const native_flags[],
                             const int java_value, const int size);
+
+int get_native_termios(JNIEnv *env, jobject termios, struct termios *l_termios);
+
+jobject new_java_termios(JNIEnv *env, const struct termios *l_termios);
+
+int flush_queue(int fd, int native_queue_selector);
+
+int throw_ioexception(JNIEnv *env, int error_number);
 #endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "stuffing.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Returns a pointer to the first byte in [data, end) equal to a or b, or end.
+ * Sixteen bytes are compared at a time where SSE2 is available; memchr()
+ * covers the case where both bytes are the same.
+ */
+static const unsigned char* find_either(const unsigned char *data,
+                                        const unsigned char *end,
+                                        unsigned char a, unsigned char b){
+    if (a == b){
+        const unsigned char *found = memchr(data, a, end - data);
+        return found != NULL ? found : end;
+    }
+#ifdef __SSE2__
+    {
+        const __m128i va = _mm_set1_epi8((char) a);
+        const __m128i vb = _mm_set1_epi8((char) b);
+        while (end - data >= 16){
+            __m128i block = _mm_loadu_si128((const __m128i*) data);
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, va),
+                                                        _mm_cmpeq_epi8(block, vb)));
+            if (mask != 0)
+                return data + __builtin_ctz(mask);
+            data += 16;
+        }
+    }
+#endif
+    while (data < end && *data != a && *data != b)
+        data++;
+    return data;
+}
+
+static unsigned char frame_delimiter(int encoding){
+    switch (encoding){
+        case STUFFING_SLIP: return SLIP_END;
+        case STUFFING_HDLC: return HDLC_FLAG;
+    }
+    return COBS_DELIMITER;
+}
+
+/**
+ * Checks that an encoding selector is one this module knows about.
+ * @param encoding the encoding selector.
+ * @return non-zero if the encoding is valid.
+ */
+int stuffing_valid_encoding(int encoding){
+    return encoding >= 0 && encoding < NUMBER_STUFFING_ENCODINGS;
+}
+
+/**
+ * Returns the largest number of bytes a frame of the given length can
+ * encode to, under any of the encodings, including its delimiters.
+ * @param length the unencoded frame length.
+ * @return the worst case encoded length.
+ */
+size_t stuffing_max_encoded(size_t length){
+    return 2 * length + 2;
+}
+
+/*
+ * SLIP and HDLC both replace two special bytes with an escape sequence; the
+ * runs of ordinary bytes between them are copied as a block.
+ */
+static size_t escape_encode(const unsigned char *data, size_t length,
+                            unsigned char *encoded, unsigned char delimiter,
+                            unsigned char escape, unsigned char escaped_delimiter,
+                            unsigned char escaped_escape){
+    const unsigned char *end = data + length, *special;
+    unsigned char *out = encoded;
+    *out++ = delimiter;
+    while (data < end){
+        special = find_either(data, end, delimiter, escape);
+        memcpy(out, data, special - data);
+        out += special - data;
+        if (special == end)
+            break;
+        *out++ = escape;
+        *out++ = *special == delimiter ? escaped_delimiter : escaped_escape;
+        data = special + 1;
+    }
+    *out++ = delimiter;
+    return out - encoded;
+}
+
+static int escape_decode(const unsigned char *encoded, size_t length,
+                            unsigned char *data, unsigned char delimiter,
+                            unsigned char escape, unsigned char escaped_delimiter,
+                            unsigned char escaped_escape, int hdlc){
+    const unsigned char *end = encoded + length, *special;
+    unsigned char *out = data;
+    while (encoded < end){
+        special = memchr(encoded, escape, end - encoded);
+        if (special == NULL)
+            special = end;
+        memmove(out, encoded, special - encoded);
+        out += special - encoded;
+        if (special == end)
+            break;
+        if (special + 1 == end)
+            return -1;
+        if (hdlc)
+            *out++ = special[1] ^ HDLC_XOR;
+        else if (special[1] == escaped_delimiter)
+            *out++ = delimiter;
+        else if (special[1] == escaped_escape)
+            *out++ = escape;
+        else
+            return -1;
+        encoded = special + 2;
+    }
+    return out - data;
+}
+
+static size_t cobs_encode(const unsigned char *data, size_t length, unsigned char *encoded){
+    const unsigned char *end = data + length, *zero;
+    unsigned char *out = encoded;
+    size_t run;
+    for (;;){
+        zero = memchr(data, 0, end - data);
+        if (zero == NULL)
+            zero = end;
+        run = zero - data;
+        // A code byte covers at most 254 data bytes.
+        while (run >= 254){
+            *out++ = 0xFF;
+            memcpy(out, data, 254);
+            out += 254;
+            data += 254;
+            run -= 254;
+        }
+        *out++ = (unsigned char) (run + 1);
+        memcpy(out, data, run);
+        out += run;
+        if (zero == end)
+            break;
+        data = zero + 1;
+    }
+    *out++ = COBS_DELIMITER;
+    return out - encoded;
+}
+
+static int cobs_decode(const unsigned char *encoded, size_t length, unsigned char *data){
+    const unsigned char *end = encoded + length;
+    unsigned char *out = data;
+    unsigned int code;
+    while (encoded < end){
+        code = *encoded++;
+        if (code == 0 || (size_t) (end - encoded) < code - 1)
+            return -1;
+        memmove(out, encoded, code - 1);
+        out += code - 1;
+        encoded += code - 1;
+        if (code < 0xFF && encoded < end)
+            *out++ = 0;
+    }
+    return out - data;
+}
+
+/**
+ * Encodes a frame, including its delimiters.
+ * @param encoding the encoding selector.
+ * @param data the frame to encode.
+ * @param length the length of the frame.
+ * @param encoded where to store the encoded frame; it must have room for
+ * stuffing_max_encoded(length) bytes.
+ * @return the length of the encoded frame.
+ */
+size_t stuffing_encode(int encoding, const unsigned char *data, size_t length,
+                        unsigned char *encoded){
+    switch (encoding){
+        case STUFFING_SLIP:
+            return escape_encode(data, length, encoded, SLIP_END, SLIP_ESC,
+                                    SLIP_ESC_END, SLIP_ESC_ESC);
+        case STUFFING_HDLC:
+            return escape_encode(data, length, encoded, HDLC_FLAG, HDLC_ESCAPE,
+                                    HDLC_FLAG ^ HDLC_XOR, HDLC_ESCAPE ^ HDLC_XOR);
+    }
+    return cobs_encode(data, length, encoded);
+}
+
+/**
+ * Decodes a single frame received without its delimiters.
+ * @param encoding the encoding selector.
+ * @param encoded the encoded frame.
+ * @param length the length of the encoded frame.
+ * @param data where to store the decoded frame; it needs no more room than
+ * length bytes. It may be the same buffer as encoded.
+ * @return the length of the decoded frame or -1 if the frame is malformed.
+ */
+int stuffing_decode(int encoding, const unsigned char *encoded, size_t length,
+                        unsigned char *data){
+    switch (encoding){
+        case STUFFING_SLIP:
+            return escape_decode(encoded, length, data, SLIP_END, SLIP_ESC,
+                                    SLIP_ESC_END, SLIP_ESC_ESC, 0);
+        case STUFFING_HDLC:
+            return escape_decode(encoded, length, data, HDLC_FLAG, HDLC_ESCAPE,
+                                    0, 0, 1);
+    }
+    return cobs_decode(encoded, length, data);
+}
+
+/**
+ * Prepares a decoder for a new byte stream.
+ * @param decoder the decoder.
+ * @param encoding the encoding selector.
+ */
+void stuffing_decoder_init(struct stuffing_decoder *decoder, int encoding){
+    decoder->encoding = encoding;
+    decoder->overflow = 0;
+    decoder->length = 0;
+}
+
+/**
+ * Feeds received bytes to a decoder, stopping at the end of the first
+ * complete frame. Empty, oversized and malformed frames are dropped.
+ * @param decoder the decoder.
+ * @param input the received bytes.
+ * @param length the number of received bytes.
+ * @param consumed set to the number of bytes of input used; any remaining
+ * bytes must be fed in again.
+ * @param data where to store a completed frame; it must have room for
+ * STUFFING_MAX_FRAME bytes.
+ * @return the length of the completed frame or -1 if input ran out first.
+ */
+int stuffing_decoder_feed(struct stuffing_decoder *decoder,
+                            const unsigned char *input, size_t length,
+                            size_t *consumed, unsigned char *data){
+    const unsigned char delimiter = frame_delimiter(decoder->encoding);
+    const unsigned char *position = input, *end = input + length, *found;
+    size_t run;
+    int result;
+
+    while (position < end){
+        found = memchr(position, delimiter, end - position);
+        run = (found != NULL ? found : end) - position;
+        if (decoder->length + run > sizeof(decoder->frame)){
+            decoder->overflow = 1;
+            decoder->length = 0;
+        } else {
+            memcpy(decoder->frame + decoder->length, position, run);
+            decoder->length += run;
+        }
+        if (found == NULL){
+            position = end;
+            break;
+        }
+        position = found + 1;
+        result = -1;
+        if (!decoder->overflow && decoder->length > 0)
+            result = stuffing_decode(decoder->encoding, decoder->frame,
+                                        decoder->length, decoder->frame);
+        if (result > STUFFING_MAX_FRAME)
+            result = -1;
+        decoder->overflow = 0;
+        decoder->length = 0;
+        if (result > 0){
+            memcpy(data, decoder->frame, result);
+            *consumed = position - input;
+            return result;
+        }
+    }
+    *consumed = position - input;
+    return -1;
+}
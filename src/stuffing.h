@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   stuffing.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Byte stuffing frame encodings: SLIP (RFC 1055), COBS and HDLC-like
+ * asynchronous octet stuffing (RFC 1662).
+ */
+
+#ifndef STUFFING_H
+#define	STUFFING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <jni.h>
+
+/*
+ Encoding selectors. These match the constants in the Java stream classes.
+ */
+#define STUFFING_SLIP   0
+#define STUFFING_COBS   1
+#define STUFFING_HDLC   2
+
+#define NUMBER_STUFFING_ENCODINGS 3
+
+#define SLIP_END        0xC0
+#define SLIP_ESC        0xDB
+#define SLIP_ESC_END    0xDC
+#define SLIP_ESC_ESC    0xDD
+
+#define HDLC_FLAG       0x7E
+#define HDLC_ESCAPE     0x7D
+#define HDLC_XOR        0x20
+
+#define COBS_DELIMITER  0x00
+
+/*
+ The largest frame, before encoding, that a decoder will accept. Longer
+ frames are discarded.
+ */
+#define STUFFING_MAX_FRAME 4096
+
+/*
+ The state of a decoder working through a byte stream: the still encoded
+ bytes of the frame received so far.
+ */
+struct stuffing_decoder {
+    int encoding;
+    int overflow;
+    size_t length;
+    unsigned char frame[2 * STUFFING_MAX_FRAME + 2];
+};
+
+int stuffing_valid_encoding(int encoding);
+
+size_t stuffing_max_encoded(size_t length);
+
+size_t stuffing_encode(int encoding, const unsigned char *data, size_t length,
+                        unsigned char *encoded);
+
+int stuffing_decode(int encoding, const unsigned char *encoded, size_t length,
+                        unsigned char *data);
+
+void stuffing_decoder_init(struct stuffing_decoder *decoder, int encoding);
+
+int stuffing_decoder_feed(struct stuffing_decoder *decoder,
+                            const unsigned char *input, size_t length,
+                            size_t *consumed, unsigned char *data);
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* STUFFING_H */
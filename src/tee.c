@@ -0,0 +1,535 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "tee.h"
+
+static struct tee *tees = NULL;
+static int next_tee_id = 1;
+static pthread_mutex_t tees_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ Ring positions are shared between the thread and the consumers without a
+ lock, so they are read and written with full barriers.
+ */
+static uint64_t load_position(const uint64_t *position){
+    uint64_t value = *(volatile const uint64_t*) position;
+    __sync_synchronize();
+    return value;
+}
+
+static void store_position(uint64_t *position, uint64_t value){
+    __sync_synchronize();
+    *(volatile uint64_t*) position = value;
+    __sync_synchronize();
+}
+
+/*
+ * Returns how much may be read into the ring without overwriting data a
+ * consumer has not read yet under TEE_POLICY_BLOCK.
+ */
+static uint64_t ring_room(struct tee *tee){
+    uint64_t head = tee->head, oldest = head, cursor;
+    int i;
+    if (tee->policy == TEE_POLICY_DROP)
+        return tee->capacity;
+    for (i = 0; i < TEE_MAX_CONSUMERS; i++){
+        if (tee->consumers[i].active){
+            cursor = load_position(&tee->consumers[i].cursor);
+            if (cursor < oldest)
+                oldest = cursor;
+        }
+    }
+    return tee->capacity - (head - oldest);
+}
+
+/*
+ * Thread body. Reads the port straight into the ring and publishes each
+ * block by moving the head.
+ */
+static void* tee_thread(void *arg){
+    struct tee *tee = (struct tee*) arg;
+    struct pollfd pfds[2];
+    uint64_t room, offset, length, value;
+    ssize_t result;
+
+    thread_config_register();
+    pfds[0].fd = tee->port->fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = tee->wake_fd;
+    pfds[1].events = POLLIN;
+    while (!tee->stopping){
+        room = ring_room(tee);
+        if (room == 0){
+            pthread_mutex_lock(&tee->lock);
+            tee->space_waiters++;
+            __sync_synchronize();
+            while (!tee->stopping && ring_room(tee) == 0)
+                pthread_cond_wait(&tee->space_ready, &tee->lock);
+            tee->space_waiters--;
+            pthread_mutex_unlock(&tee->lock);
+            continue;
+        }
+        if (poll(pfds, 2, -1) == -1){
+            if (errno == EINTR)
+                continue;
+            tee->error = errno;
+            break;
+        }
+        if (pfds[1].revents & POLLIN){
+            eventfd_read(tee->wake_fd, &value);
+            continue;
+        }
+        offset = tee->head & (tee->capacity - 1);
+        length = tee->capacity - offset;
+        if (length > room)
+            length = room;
+        if (length > tee->chunk)
+            length = tee->chunk;
+        result = port_read(tee->port, tee->ring + offset, length);
+        if (result == -1){
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            tee->error = errno;
+            break;
+        }
+        if (result == 0){
+            // Readable with nothing to read means the other end hung up.
+            if (pfds[0].revents & (POLLHUP | POLLERR)){
+                tee->error = EIO;
+                break;
+            }
+            continue;
+        }
+        store_position(&tee->head, tee->head + result);
+        if (tee->data_waiters > 0){
+            pthread_mutex_lock(&tee->lock);
+            pthread_cond_broadcast(&tee->data_ready);
+            pthread_mutex_unlock(&tee->lock);
+        }
+    }
+    pthread_mutex_lock(&tee->lock);
+    tee->finished = 1;
+    pthread_cond_broadcast(&tee->data_ready);
+    pthread_mutex_unlock(&tee->lock);
+    thread_config_unregister();
+    return NULL;
+}
+
+/*
+ * Stops the thread and drops the tee's reference to its port. Called once
+ * the tee is closed or, with the port lock held, when the port is closed.
+ */
+static void stop_tee(struct tee *tee){
+    if (tee->joined)
+        return;
+    pthread_mutex_lock(&tee->lock);
+    tee->stopping = 1;
+    pthread_cond_broadcast(&tee->space_ready);
+    pthread_mutex_unlock(&tee->lock);
+    eventfd_write(tee->wake_fd, 1);
+    pthread_join(tee->thread, NULL);
+    tee->joined = 1;
+    port_release(tee->port);
+}
+
+static void stop_tee_helper(struct port_helper *helper){
+    stop_tee((struct tee*) ((char*) helper - offsetof(struct tee, helper)));
+}
+
+static void free_tee(struct tee *tee){
+    if (tee->wake_fd != -1)
+        close(tee->wake_fd);
+    pthread_cond_destroy(&tee->space_ready);
+    pthread_cond_destroy(&tee->data_ready);
+    pthread_mutex_destroy(&tee->lock);
+    free(tee->ring);
+    free(tee);
+}
+
+static struct tee* acquire_tee(int id){
+    struct tee *tee;
+    pthread_mutex_lock(&tees_lock);
+    for (tee = tees; tee != NULL && tee->id != id; tee = tee->next)
+        ;
+    if (tee != NULL)
+        tee->references++;
+    pthread_mutex_unlock(&tees_lock);
+    if (tee == NULL)
+        errno = EBADF;
+    return tee;
+}
+
+static void release_tee(struct tee *tee){
+    int references;
+    pthread_mutex_lock(&tees_lock);
+    references = --tee->references;
+    pthread_mutex_unlock(&tees_lock);
+    if (references == 0)
+        free_tee(tee);
+}
+
+/*
+ * Returns the consumer of a tee with the given index or NULL if it is not
+ * in use.
+ */
+static struct tee_consumer* get_consumer(struct tee *tee, jint consumer){
+    if (consumer < 0 || consumer >= TEE_MAX_CONSUMERS || !tee->consumers[consumer].active)
+        return NULL;
+    return &tee->consumers[consumer];
+}
+
+/**
+ * Starts a tee on a port: a native thread that reads everything the port
+ * receives into a ring from which any number of consumers, added with
+ * addTeeConsumer, each read the whole stream. Nothing else should read the
+ * port while the tee is open. The tee stops if the port is closed.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param capacity the size of the ring in bytes, rounded up to a power of
+ * two between TEE_MIN_CAPACITY and TEE_MAX_CAPACITY.
+ * @param policy TEE_POLICY_DROP or TEE_POLICY_BLOCK.
+ * @return the id of the tee.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_openTee (JNIEnv *env,
+                                        jobject obj,
+                                        jlong handle,
+                                        jint capacity,
+                                        jint policy){
+    struct tee *tee;
+    uint64_t size = TEE_MIN_CAPACITY;
+    int error;
+
+    if (policy != TEE_POLICY_DROP && policy != TEE_POLICY_BLOCK){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    while (size < (uint64_t) capacity && size < TEE_MAX_CAPACITY)
+        size <<= 1;
+    tee = calloc(1, sizeof(*tee));
+    if (tee == NULL){
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    pthread_mutex_init(&tee->lock, NULL);
+    pthread_cond_init(&tee->data_ready, NULL);
+    pthread_cond_init(&tee->space_ready, NULL);
+    tee->policy = policy;
+    tee->capacity = size;
+    tee->chunk = size / 4;
+    tee->ring = malloc(size);
+    tee->wake_fd = eventfd(0, EFD_CLOEXEC);
+    tee->references = 1;
+    tee->helper.stop = stop_tee_helper;
+    error = tee->ring == NULL ? ENOMEM : 0;
+    if (error == 0 && tee->wake_fd == -1)
+        error = errno;
+    if (error == 0 && (tee->port = port_acquire(handle)) == NULL)
+        error = errno;
+    if (error != 0){
+        free_tee(tee);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    pthread_mutex_lock(&tee->port->lock);
+    if (tee->port->shutdown)
+        error = EBADF;
+    else if ((error = pthread_create(&tee->thread, NULL, tee_thread, tee)) == 0)
+        port_add_helper(tee->port, &tee->helper);
+    pthread_mutex_unlock(&tee->port->lock);
+    if (error != 0){
+        port_release(tee->port);
+        free_tee(tee);
+        throw_ioexception(env, error);
+        return -1;
+    }
+    pthread_mutex_lock(&tees_lock);
+    tee->id = next_tee_id++;
+    tee->next = tees;
+    tees = tee;
+    pthread_mutex_unlock(&tees_lock);
+    return tee->id;
+}
+
+/**
+ * Adds a consumer to a tee. The consumer sees the data received from this
+ * point on.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param tee_id the id of the tee.
+ * @return the index of the consumer, for readTee.
+ * @throws IOException if the tee is not open or has TEE_MAX_CONSUMERS
+ * consumers already.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_addTeeConsumer (JNIEnv *env, jobject obj, jint tee_id){
+    struct tee *tee = acquire_tee(tee_id);
+    struct tee_consumer *consumer;
+    int i;
+    if (tee == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    pthread_mutex_lock(&tee->lock);
+    for (i = 0; i < TEE_MAX_CONSUMERS && tee->consumers[i].active; i++)
+        ;
+    if (i < TEE_MAX_CONSUMERS){
+        consumer = &tee->consumers[i];
+        consumer->delivered = 0;
+        consumer->dropped = 0;
+        store_position(&consumer->cursor, load_position(&tee->head));
+        consumer->active = 1;
+    }
+    pthread_mutex_unlock(&tee->lock);
+    release_tee(tee);
+    if (i == TEE_MAX_CONSUMERS){
+        throw_ioexception(env, EUSERS);
+        return -1;
+    }
+    return i;
+}
+
+/**
+ * Removes a consumer from a tee. Under TEE_POLICY_BLOCK the tee no longer
+ * waits for it.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param tee_id the id of the tee.
+ * @param consumer the index of the consumer.
+ * @return 0 upon success.
+ * @throws IOException if the tee is not open or the consumer not in use.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_removeTeeConsumer (JNIEnv *env,
+                                                    jobject obj,
+                                                    jint tee_id,
+                                                    jint consumer){
+    struct tee *tee = acquire_tee(tee_id);
+    int error = 0;
+    if (tee == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    pthread_mutex_lock(&tee->lock);
+    if (get_consumer(tee, consumer) == NULL)
+        error = EINVAL;
+    else
+        tee->consumers[consumer].active = 0;
+    pthread_cond_broadcast(&tee->space_ready);
+    pthread_mutex_unlock(&tee->lock);
+    release_tee(tee);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads the next data for a consumer of a tee. Each consumer must only be
+ * read by one thread at a time; different consumers need no coordination.
+ * Under TEE_POLICY_DROP a consumer that has fallen too far behind skips to
+ * the oldest data still held and the skipped bytes are counted as dropped.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param tee_id the id of the tee.
+ * @param consumer the index of the consumer.
+ * @param buffer the array to store the data in.
+ * @param offset the offset into buffer to store the data.
+ * @param length the maximum number of bytes to read.
+ * @param timeout_millis how long to wait for data, 0 not to wait and a
+ * negative value to wait indefinitely.
+ * @return the number of bytes read, 0 if the timeout expired or -1 once the
+ * tee has been stopped and the consumer has read everything.
+ * @throws IOException if the tee is not open, the consumer not in use or
+ * reading the port failed.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_readTee (JNIEnv *env,
+                                        jobject obj,
+                                        jint tee_id,
+                                        jint consumer_index,
+                                        jbyteArray buffer,
+                                        jint offset,
+                                        jint length,
+                                        jint timeout_millis){
+    struct tee *tee = acquire_tee(tee_id);
+    struct tee_consumer *consumer;
+    struct timespec deadline;
+    uint64_t head, cursor, held, start, first, count, usable;
+    int result = 0, error = 0, timed_out = 0;
+
+    if (tee == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    consumer = get_consumer(tee, consumer_index);
+    if (consumer == NULL || length < 0){
+        release_tee(tee);
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    if (timeout_millis > 0){
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_millis / 1000;
+        deadline.tv_nsec += (long) (timeout_millis % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L){
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    // Under TEE_POLICY_DROP the thread may be overwriting one chunk past the head.
+    usable = tee->policy == TEE_POLICY_DROP ? tee->capacity - tee->chunk : tee->capacity;
+    for (;;){
+        head = load_position(&tee->head);
+        cursor = consumer->cursor;
+        if (head == cursor){
+            if (tee->finished){
+                error = tee->error;
+                result = -1;
+                break;
+            }
+            if (timeout_millis == 0 || timed_out || length == 0)
+                break;
+            pthread_mutex_lock(&tee->lock);
+            tee->data_waiters++;
+            __sync_synchronize();
+            while (load_position(&tee->head) == cursor && !tee->finished && !timed_out){
+                if (timeout_millis < 0)
+                    pthread_cond_wait(&tee->data_ready, &tee->lock);
+                else
+                    timed_out = pthread_cond_timedwait(&tee->data_ready, &tee->lock,
+                                                        &deadline) == ETIMEDOUT;
+            }
+            tee->data_waiters--;
+            pthread_mutex_unlock(&tee->lock);
+            continue;
+        }
+        if (head - cursor > usable){
+            consumer->dropped += head - cursor - usable;
+            cursor = head - usable;
+        }
+        held = head - cursor;
+        count = held < (uint64_t) length ? held : (uint64_t) length;
+        start = cursor & (tee->capacity - 1);
+        first = tee->capacity - start < count ? tee->capacity - start : count;
+        (*env)->SetByteArrayRegion(env, buffer, offset, first, (jbyte*) tee->ring + start);
+        if (count > first)
+            (*env)->SetByteArrayRegion(env, buffer, offset + first, count - first,
+                                        (jbyte*) tee->ring);
+        if ((*env)->ExceptionCheck(env)){
+            release_tee(tee);
+            return -1;
+        }
+        if (tee->policy == TEE_POLICY_DROP
+                && load_position(&tee->head) - cursor > usable){
+            // Overwritten while being copied, so start again further on.
+            store_position(&consumer->cursor, cursor);
+            continue;
+        }
+        store_position(&consumer->cursor, cursor + count);
+        consumer->delivered += count;
+        if (tee->space_waiters > 0){
+            pthread_mutex_lock(&tee->lock);
+            pthread_cond_signal(&tee->space_ready);
+            pthread_mutex_unlock(&tee->lock);
+        }
+        result = (int) count;
+        break;
+    }
+    release_tee(tee);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return result;
+}
+
+/**
+ * Returns the counters of a tee consumer.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param tee_id the id of the tee.
+ * @param consumer the index of the consumer.
+ * @return an array of bytes delivered, bytes dropped and bytes waiting.
+ * @throws IOException if the tee is not open or the consumer not in use.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getTeeStatistics (JNIEnv *env,
+                                                jobject obj,
+                                                jint tee_id,
+                                                jint consumer_index){
+    struct tee *tee = acquire_tee(tee_id);
+    struct tee_consumer *consumer;
+    jlong values[TEE_STATISTICS_COUNT];
+    jlongArray return_array;
+    uint64_t waiting;
+    if (tee == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    consumer = get_consumer(tee, consumer_index);
+    if (consumer == NULL){
+        release_tee(tee);
+        throw_ioexception(env, EINVAL);
+        return NULL;
+    }
+    waiting = load_position(&tee->head) - load_position(&consumer->cursor);
+    values[0] = consumer->delivered;
+    values[1] = consumer->dropped;
+    values[2] = waiting < tee->capacity ? waiting : tee->capacity;
+    release_tee(tee);
+    return_array = (*env)->NewLongArray(env, TEE_STATISTICS_COUNT);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, TEE_STATISTICS_COUNT, values);
+    return return_array;
+}
+
+/**
+ * Stops a tee and frees it once no consumer is reading from it. Consumers
+ * blocked in readTee return what is left and then -1.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param tee_id the id of the tee.
+ * @return 0 upon success.
+ * @throws IOException if the tee is not open.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_closeTee (JNIEnv *env, jobject obj, jint tee_id){
+    struct tee **link, *tee = NULL;
+    pthread_mutex_lock(&tees_lock);
+    for (link = &tees; *link != NULL; link = &(*link)->next){
+        if ((*link)->id == tee_id){
+            tee = *link;
+            *link = tee->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&tees_lock);
+    if (tee == NULL){
+        throw_ioexception(env, EBADF);
+        return -1;
+    }
+    port_remove_helper(tee->port, &tee->helper);
+    stop_tee(tee);
+    release_tee(tee);
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   tee.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Fan-out of the data received on one port to several consumers. A native
+ * thread reads the port into a ring once; each consumer has its own cursor
+ * into the ring and reads without taking a lock.
+ */
+
+#ifndef TEE_H
+#define	TEE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include "port.h"
+#include "thread_config.h"
+
+/*
+ What happens when a consumer falls a full ring behind: its oldest unread
+ data is overwritten and counted as dropped, or the port is not read until
+ the consumer catches up.
+ */
+#define TEE_POLICY_DROP     0
+#define TEE_POLICY_BLOCK    1
+
+#define TEE_MAX_CONSUMERS   16
+#define TEE_MIN_CAPACITY    4096
+#define TEE_MAX_CAPACITY    (64 * 1024 * 1024)
+
+/*
+ The statistics handed to Java for a consumer: bytes delivered, bytes
+ dropped and bytes waiting to be read.
+ */
+#define TEE_STATISTICS_COUNT 3
+
+struct tee_consumer {
+    int active;
+    /* Ring position of the next byte to read, only moved by the consumer. */
+    uint64_t cursor;
+    uint64_t delivered;
+    uint64_t dropped;
+};
+
+struct tee {
+    int id;
+    int references;
+    struct port_helper helper;
+    struct serial_port *port;
+    int policy;
+    unsigned char *ring;
+    /* A power of two. */
+    uint64_t capacity;
+    /* The most the thread reads into the ring at once. */
+    uint64_t chunk;
+    /* Ring position after the last byte written, only moved by the thread. */
+    uint64_t head;
+    struct tee_consumer consumers[TEE_MAX_CONSUMERS];
+    pthread_t thread;
+    int wake_fd;
+    int stopping;
+    int joined;
+    /* Set when the thread has exited, with the errno value that ended it. */
+    int finished;
+    int error;
+    /* Only for sleeping and waking: readers wait for data, the thread for room. */
+    pthread_mutex_t lock;
+    pthread_cond_t data_ready;
+    pthread_cond_t space_ready;
+    int data_waiters;
+    int space_waiters;
+    struct tee *next;
+};
+
+#endif	/* TEE_H */
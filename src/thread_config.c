@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "thread_config.h"
+
+struct native_thread {
+    pthread_t thread;
+    struct native_thread *next;
+};
+
+/*
+ The configuration, the registry of running threads and the outcome of the
+ last attempt to apply the configuration, all guarded by config_lock.
+ */
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct native_thread *threads = NULL;
+static int thread_count = 0;
+static int configured = 0;
+static int policy = SCHED_OTHER;
+static int priority = 0;
+static int use_affinity = 0;
+static cpu_set_t cpus;
+static int memory_locked = 0;
+static int scheduling_error = 0;
+static int affinity_error = 0;
+static int memory_error = 0;
+
+/*
+ * Applies the scheduling and affinity settings to one thread, recording the
+ * first failure of each. Called with config_lock held.
+ */
+static void apply_to_thread(pthread_t thread){
+    struct sched_param param;
+    int error;
+    bzero(&param, sizeof(param));
+    param.sched_priority = priority;
+    if ((error = pthread_setschedparam(thread, policy, &param)) != 0 && scheduling_error == 0)
+        scheduling_error = error;
+    if (use_affinity
+            && (error = pthread_setaffinity_np(thread, sizeof(cpus), &cpus)) != 0
+            && affinity_error == 0)
+        affinity_error = error;
+}
+
+/*
+ * Thread body used to find out what the process may do when no native
+ * thread is running to try the settings on.
+ */
+static void* probe_thread(void *arg){
+    apply_to_thread(pthread_self());
+    return NULL;
+}
+
+static int applied_mask(void){
+    int mask = 0;
+    if (scheduling_error == 0)
+        mask |= THREAD_APPLIED_SCHEDULING;
+    if (use_affinity && affinity_error == 0)
+        mask |= THREAD_APPLIED_AFFINITY;
+    if (memory_locked)
+        mask |= THREAD_APPLIED_MEMORY_LOCK;
+    return mask;
+}
+
+/**
+ * Registers the calling thread as a native thread of the library and applies
+ * the current configuration to it. Must be called first thing by every
+ * thread the library starts, and paired with thread_config_unregister().
+ */
+void thread_config_register(void){
+    struct native_thread *entry = malloc(sizeof(*entry));
+    pthread_mutex_lock(&config_lock);
+    if (configured)
+        apply_to_thread(pthread_self());
+    if (entry != NULL){
+        entry->thread = pthread_self();
+        entry->next = threads;
+        threads = entry;
+        thread_count++;
+    }
+    pthread_mutex_unlock(&config_lock);
+}
+
+/**
+ * Removes the calling thread from the registry before it exits.
+ */
+void thread_config_unregister(void){
+    struct native_thread **link, *entry;
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&config_lock);
+    for (link = &threads; *link != NULL; link = &(*link)->next){
+        if (pthread_equal((*link)->thread, self)){
+            entry = *link;
+            *link = entry->next;
+            free(entry);
+            thread_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&config_lock);
+}
+
+/**
+ * Sets the scheduling policy, CPU affinity and memory locking of the native
+ * threads the library runs: the transmit schedulers, virtual port relays and
+ * batch workers. The settings are applied at once to the threads already
+ * running and to every thread started later. Settings the process lacks the
+ * capabilities for (typically CAP_SYS_NICE and CAP_IPC_LOCK or the matching
+ * rlimits) are left out of the returned mask; getNativeThreadStatus reports
+ * why.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param java_policy one of the THREAD_POLICY_* values.
+ * @param java_priority the real time priority, 0 for THREAD_POLICY_NORMAL.
+ * @param cpu_list the CPUs the threads may run on or null to leave affinity
+ * as inherited from the process.
+ * @param lock_memory JNI_TRUE to lock all current and future pages of the
+ * process into memory, JNI_FALSE to unlock them again.
+ * @return the mask of THREAD_APPLIED_* settings that took effect.
+ * @throws IOException with EINVAL if the policy, priority or a CPU number is
+ * out of range.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setNativeThreadConfig (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint java_policy,
+                                                        jint java_priority,
+                                                        jintArray cpu_list,
+                                                        jboolean lock_memory){
+    int native_policy, cpu_count = 0, i, mask;
+    jint *cpu_numbers = NULL;
+    struct native_thread *entry;
+    pthread_t probe;
+    cpu_set_t new_cpus;
+
+    switch (java_policy){
+        case THREAD_POLICY_NORMAL: native_policy = SCHED_OTHER; break;
+        case THREAD_POLICY_FIFO: native_policy = SCHED_FIFO; break;
+        case THREAD_POLICY_RR: native_policy = SCHED_RR; break;
+        default:
+            throw_ioexception(env, EINVAL);
+            return -1;
+    }
+    if (java_priority < sched_get_priority_min(native_policy)
+            || java_priority > sched_get_priority_max(native_policy)){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    CPU_ZERO(&new_cpus);
+    if (cpu_list != NULL){
+        cpu_count = (*env)->GetArrayLength(env, cpu_list);
+        cpu_numbers = malloc((cpu_count + 1) * sizeof(jint));
+        if (cpu_numbers == NULL){
+            throw_ioexception(env, ENOMEM);
+            return -1;
+        }
+        (*env)->GetIntArrayRegion(env, cpu_list, 0, cpu_count, cpu_numbers);
+        for (i = 0; i < cpu_count; i++){
+            if (cpu_numbers[i] < 0 || cpu_numbers[i] >= CPU_SETSIZE)
+                break;
+            CPU_SET(cpu_numbers[i], &new_cpus);
+        }
+        free(cpu_numbers);
+        if (i < cpu_count || cpu_count == 0){
+            throw_ioexception(env, EINVAL);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&config_lock);
+    configured = 1;
+    policy = native_policy;
+    priority = java_priority;
+    use_affinity = cpu_list != NULL;
+    cpus = new_cpus;
+    scheduling_error = 0;
+    affinity_error = 0;
+    if (lock_memory && !memory_locked){
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0){
+            memory_locked = 1;
+            memory_error = 0;
+        } else {
+            memory_error = errno;
+        }
+    } else if (!lock_memory){
+        if (memory_locked)
+            munlockall();
+        memory_locked = 0;
+        memory_error = 0;
+    }
+    for (entry = threads; entry != NULL; entry = entry->next){
+        apply_to_thread(entry->thread);
+    }
+    if (threads == NULL && pthread_create(&probe, NULL, probe_thread, NULL) == 0){
+        // The probe writes the outcome while config_lock is still held here.
+        pthread_join(probe, NULL);
+    }
+    mask = applied_mask();
+    pthread_mutex_unlock(&config_lock);
+    return mask;
+}
+
+/**
+ * Reports the outcome of applying the native thread configuration.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @return an array of THREAD_STATUS_COUNT values: the mask of applied
+ * settings, the errno values that stopped scheduling, affinity and memory
+ * locking taking effect and the number of native threads running.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_javatechnics_rs232_Serial_getNativeThreadStatus (JNIEnv *env, jobject obj){
+    jint values[THREAD_STATUS_COUNT];
+    jintArray return_array;
+    pthread_mutex_lock(&config_lock);
+    values[0] = configured ? applied_mask() : 0;
+    values[1] = scheduling_error;
+    values[2] = affinity_error;
+    values[3] = memory_error;
+    values[4] = thread_count;
+    pthread_mutex_unlock(&config_lock);
+    return_array = (*env)->NewIntArray(env, THREAD_STATUS_COUNT);
+    if (return_array != NULL)
+        (*env)->SetIntArrayRegion(env, return_array, 0, THREAD_STATUS_COUNT, values);
+    return return_array;
+}
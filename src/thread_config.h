@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   thread_config.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Scheduling policy, CPU affinity and memory locking for the native threads
+ * the library starts. Every such thread registers itself on start so that a
+ * configuration change reaches the threads already running as well as those
+ * started later.
+ */
+
+#ifndef THREAD_CONFIG_H
+#define	THREAD_CONFIG_H
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <jni.h>
+#include "jni/com_javatechnics_rs232_Serial.h"
+
+/*
+ Scheduling policies as passed from Java.
+ */
+#define THREAD_POLICY_NORMAL    0
+#define THREAD_POLICY_FIFO      1
+#define THREAD_POLICY_RR        2
+
+/*
+ Bits of the mask reporting which settings took effect.
+ */
+#define THREAD_APPLIED_SCHEDULING   0x01
+#define THREAD_APPLIED_AFFINITY     0x02
+#define THREAD_APPLIED_MEMORY_LOCK  0x04
+
+/*
+ The status array handed to Java: the applied mask, the errno values that
+ stopped scheduling, affinity and memory locking taking effect (0 if none)
+ and the number of native threads currently running.
+ */
+#define THREAD_STATUS_COUNT 5
+
+void thread_config_register(void);
+
+void thread_config_unregister(void);
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* THREAD_CONFIG_H */
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "tuner.h"
+
+static uint64_t now_nanos(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * Picks the VMIN for the next window from the one just gathered. Called
+ * with the tuner lock held.
+ */
+static int choose_vmin(const struct read_tuner *tuner, uint64_t mean_gap){
+    uint64_t bound = (uint64_t) tuner->max_vtime * 100000000ULL;
+    int vmin = tuner->vmin < 1 ? 1 : tuner->vmin;
+    if (tuner->max_vtime == 0){
+        // Without an inter-byte timer a partial burst could wait forever.
+        vmin = 1;
+    } else if (vmin > 1 && (tuner->short_reads * 4 > tuner->reads || mean_gap >= bound)){
+        /*
+         Reads are ending on the timer, each costing up to VTIME, or data
+         trickles in too slowly for VTIME, which only times the gap between
+         bytes, to keep a read within the bound.
+         */
+        vmin /= 2;
+    } else if (tuner->bytes >= 2 * (uint64_t) vmin * tuner->reads && tuner->gaps > 0
+            && mean_gap < bound){
+        // Data arrives in bursts faster than the timer would fire.
+        vmin *= 2;
+    }
+    if (vmin > tuner->max_vmin)
+        vmin = tuner->max_vmin;
+    return vmin;
+}
+
+/*
+ * Sets VMIN and VTIME through the port's attribute cache so that it stays
+ * coherent. Ports in canonical mode are left alone.
+ */
+static void apply(struct serial_port *port, int vmin, int vtime){
+    struct termios termios;
+    if (port_get_termios(port, &termios) == -1 || (termios.c_lflag & ICANON))
+        return;
+    termios.c_cc[VMIN] = vmin;
+    termios.c_cc[VTIME] = vtime;
+    if (port_set_termios(port, TCSANOW, &termios) == -1)
+        syslog(LOG_USER | LOG_DEBUG, "Read tuning could not set VMIN %d VTIME %d: %d", vmin, vtime, errno);
+}
+
+/**
+ * Records a read() made on a port and, at the end of each window, chooses
+ * and applies new VMIN and VTIME values. Called by the read path only when
+ * the port has a tuner.
+ * @param port the port.
+ * @param length the number of bytes asked for.
+ * @param result what read() returned.
+ */
+void tuner_observe(struct serial_port *port, size_t length, ssize_t result){
+    struct read_tuner *tuner = port->tuner;
+    struct tuner_evaluation *evaluation;
+    uint64_t now, mean_gap;
+    int vmin, vtime, changed;
+
+    if (result < 0)
+        return;
+    now = now_nanos();
+    pthread_mutex_lock(&tuner->lock);
+    if (!tuner->enabled){
+        pthread_mutex_unlock(&tuner->lock);
+        return;
+    }
+    tuner->reads++;
+    tuner->bytes += result;
+    if (result < tuner->vmin && (size_t) result < length)
+        tuner->short_reads++;
+    if (result > 0){
+        if (tuner->last_arrival != 0){
+            tuner->gaps++;
+            tuner->gap_total += now - tuner->last_arrival;
+        }
+        tuner->last_arrival = now;
+    }
+    if (tuner->reads < (uint64_t) tuner->window){
+        pthread_mutex_unlock(&tuner->lock);
+        return;
+    }
+    mean_gap = tuner->gaps > 0 ? tuner->gap_total / tuner->gaps : 0;
+    vmin = choose_vmin(tuner, mean_gap);
+    vtime = vmin > 1 ? tuner->max_vtime : 0;
+    changed = vmin != tuner->vmin || vtime != tuner->vtime;
+    evaluation = &tuner->history[tuner->history_next];
+    evaluation->time = now;
+    evaluation->vmin = vmin;
+    evaluation->vtime = vtime;
+    evaluation->reads = tuner->reads;
+    evaluation->bytes = tuner->bytes;
+    evaluation->mean_gap = mean_gap / 1000;
+    tuner->history_next = (tuner->history_next + 1) % TUNER_HISTORY;
+    if (tuner->history_count < TUNER_HISTORY)
+        tuner->history_count++;
+    tuner->reads = tuner->bytes = tuner->short_reads = 0;
+    tuner->gaps = tuner->gap_total = 0;
+    if (changed){
+        tuner->vmin = vmin;
+        tuner->vtime = vtime;
+        tuner->adjustments++;
+    }
+    pthread_mutex_unlock(&tuner->lock);
+    if (changed)
+        apply(port, vmin, vtime);
+}
+
+/**
+ * Frees a tuner once its port can no longer be read.
+ * @param tuner the tuner, may be NULL.
+ */
+void tuner_free(struct read_tuner *tuner){
+    if (tuner == NULL)
+        return;
+    pthread_mutex_destroy(&tuner->lock);
+    free(tuner);
+}
+
+/**
+ * Turns adaptive VMIN/VTIME tuning of a port on or off. Only reads made
+ * through the port's handle are observed. While tuning, VMIN moves between 1
+ * and max_vmin and VTIME is either 0 or max_latency_millis in tenths of a
+ * second, so that a read never waits longer than that for the rest of a
+ * burst; a bound under 100ms therefore keeps VMIN at 1. VMIN is also lowered
+ * while reads take longer than the bound on average. Values set with
+ * setPortAttributes are starting points that the tuner may change. Turning
+ * tuning off leaves the attributes as last chosen.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param max_latency_millis the longest a read may wait for the rest of a
+ * burst.
+ * @param max_vmin the largest VMIN to use, 0 to turn tuning off.
+ * @param window the number of reads between adjustments.
+ * @return 0 upon success.
+ * @throws IOException if the handle is not that of an open port, the bounds
+ * are invalid or the port is in canonical mode.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setReadTuning (JNIEnv *env,
+                                                jobject obj,
+                                                jlong handle,
+                                                jint max_latency_millis,
+                                                jint max_vmin,
+                                                jint window){
+    struct serial_port *port;
+    struct read_tuner *tuner;
+    struct termios termios;
+    int error = 0;
+
+    if (max_vmin < 0 || max_vmin > TUNER_MAX_CC || max_latency_millis < 0
+            || (max_vmin > 0 && window < 1)){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    if (max_vmin > 0){
+        if (port_get_termios(port, &termios) == -1)
+            error = errno;
+        else if (termios.c_lflag & ICANON)
+            error = EINVAL;
+    }
+    pthread_mutex_lock(&port->lock);
+    tuner = port->tuner;
+    if (error == 0 && tuner == NULL && max_vmin > 0){
+        tuner = calloc(1, sizeof(struct read_tuner));
+        if (tuner == NULL){
+            error = ENOMEM;
+        } else {
+            pthread_mutex_init(&tuner->lock, NULL);
+            // The read path looks at the pointer without the port lock.
+            __sync_synchronize();
+            port->tuner = tuner;
+        }
+    }
+    pthread_mutex_unlock(&port->lock);
+    if (error == 0 && tuner != NULL){
+        pthread_mutex_lock(&tuner->lock);
+        tuner->enabled = max_vmin > 0;
+        if (tuner->enabled){
+            tuner->max_vmin = max_vmin;
+            tuner->max_vtime = max_latency_millis / 100 > TUNER_MAX_CC
+                                ? TUNER_MAX_CC : max_latency_millis / 100;
+            tuner->window = window;
+            tuner->vmin = termios.c_cc[VMIN];
+            tuner->vtime = termios.c_cc[VTIME];
+            tuner->reads = tuner->bytes = tuner->short_reads = 0;
+            tuner->gaps = tuner->gap_total = 0;
+            tuner->last_arrival = 0;
+        }
+        pthread_mutex_unlock(&tuner->lock);
+    }
+    port_release(port);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the current state of the read tuning of a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return an array of whether tuning is on, the VMIN and VTIME last chosen
+ * and the number of times they were changed, all 0 if tuning was never
+ * turned on.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_javatechnics_rs232_Serial_getReadTuning (JNIEnv *env,
+                                                jobject obj,
+                                                jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    jint values[4];
+    jintArray return_array;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    bzero(values, sizeof(values));
+    if (port->tuner != NULL){
+        pthread_mutex_lock(&port->tuner->lock);
+        values[0] = port->tuner->enabled;
+        values[1] = port->tuner->vmin;
+        values[2] = port->tuner->vtime;
+        values[3] = port->tuner->adjustments;
+        pthread_mutex_unlock(&port->tuner->lock);
+    }
+    port_release(port);
+    return_array = (*env)->NewIntArray(env, 4);
+    if (return_array != NULL)
+        (*env)->SetIntArrayRegion(env, return_array, 0, 4, values);
+    return return_array;
+}
+
+/**
+ * Returns the most recent evaluations made by the read tuning of a port,
+ * oldest first.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return TUNER_HISTORY_FIELDS values for each evaluation: its monotonic
+ * time in nanoseconds, the VMIN and VTIME chosen, the reads and bytes seen
+ * and the mean gap between reads returning data in microseconds.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getReadTuningHistory (JNIEnv *env,
+                                                        jobject obj,
+                                                        jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct read_tuner *tuner;
+    struct tuner_evaluation *evaluation;
+    jlong values[TUNER_HISTORY * TUNER_HISTORY_FIELDS];
+    jlongArray return_array;
+    size_t count = 0, i, first;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    tuner = port->tuner;
+    if (tuner != NULL){
+        pthread_mutex_lock(&tuner->lock);
+        count = tuner->history_count;
+        first = (tuner->history_next + TUNER_HISTORY - count) % TUNER_HISTORY;
+        for (i = 0; i < count; i++){
+            evaluation = &tuner->history[(first + i) % TUNER_HISTORY];
+            values[i * TUNER_HISTORY_FIELDS] = evaluation->time;
+            values[i * TUNER_HISTORY_FIELDS + 1] = evaluation->vmin;
+            values[i * TUNER_HISTORY_FIELDS + 2] = evaluation->vtime;
+            values[i * TUNER_HISTORY_FIELDS + 3] = evaluation->reads;
+            values[i * TUNER_HISTORY_FIELDS + 4] = evaluation->bytes;
+            values[i * TUNER_HISTORY_FIELDS + 5] = evaluation->mean_gap;
+        }
+        pthread_mutex_unlock(&tuner->lock);
+    }
+    port_release(port);
+    return_array = (*env)->NewLongArray(env, count * TUNER_HISTORY_FIELDS);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, count * TUNER_HISTORY_FIELDS, values);
+    return return_array;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   tuner.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Adaptive VMIN/VTIME. The tuner watches the reads made through a port and,
+ * every window of reads, raises VMIN while the port delivers full bursts and
+ * lowers it while reads end on the VTIME timer or take longer than the
+ * caller's latency bound to fill. VTIME is held at that bound so that the
+ * tail of a burst is never held for longer.
+ */
+
+#ifndef TUNER_H
+#define	TUNER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <termios.h>
+#include <pthread.h>
+#include <syslog.h>
+#include "port.h"
+
+/*
+ The number of evaluations the tuner remembers.
+ */
+#define TUNER_HISTORY 64
+
+/*
+ Each evaluation is handed to Java as its time, the VMIN and VTIME chosen,
+ the reads and bytes seen in the window and the mean gap in microseconds
+ between reads that returned data.
+ */
+#define TUNER_HISTORY_FIELDS 6
+
+/*
+ The largest value VMIN and VTIME can hold.
+ */
+#define TUNER_MAX_CC 255
+
+struct tuner_evaluation {
+    uint64_t time;
+    int vmin;
+    int vtime;
+    uint64_t reads;
+    uint64_t bytes;
+    uint64_t mean_gap;
+};
+
+struct read_tuner {
+    pthread_mutex_t lock;
+    int enabled;
+    /* The caller's bounds. */
+    int max_vtime;
+    int max_vmin;
+    int window;
+    /* What the tuner last chose. */
+    int vmin;
+    int vtime;
+    uint64_t adjustments;
+    /* The window being gathered. */
+    uint64_t reads;
+    uint64_t bytes;
+    uint64_t short_reads;
+    uint64_t gaps;
+    uint64_t gap_total;
+    uint64_t last_arrival;
+    struct tuner_evaluation history[TUNER_HISTORY];
+    size_t history_next;
+    size_t history_count;
+};
+
+void tuner_observe(struct serial_port *port, size_t length, ssize_t result);
+
+void tuner_free(struct read_tuner *tuner);
+
+#endif	/* TUNER_H */
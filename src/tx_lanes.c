@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "tx_lanes.h"
+
+/*
+ What send_frame() returns, besides 0 and errno values, when a more urgent
+ lane has a frame: the frame was put aside before any of it was written or
+ after what was written was flushed.
+ */
+#define TX_LANE_YIELDED     -1
+#define TX_LANE_PREEMPTED   -2
+
+/*
+ The shortest a lower lane waits for the driver's queue to drain.
+ */
+#define TX_LANE_MIN_WAIT_NANOS 100000L
+
+/*
+ How long a lane waits for the driver to have room before it looks again
+ for a more urgent frame or a stop.
+ */
+#define TX_LANE_WRITE_WAIT_MILLIS 10
+
+static int urgent_waiting(const struct tx_lanes *lanes, int lane){
+    int i;
+    for (i = 0; i < lane; i++){
+        if (lanes->lanes[i].head != NULL)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Waits on the wake condition for at most nanos. Called with the lock held.
+ */
+static void wait_nanos(struct tx_lanes *lanes, long nanos){
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += nanos / 1000000000L;
+    deadline.tv_nsec += nanos % 1000000000L;
+    if (deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&lanes->wake, &lanes->lock, &deadline);
+}
+
+/*
+ * Sends one frame. Frames of lower lanes are written only while the
+ * driver's output queue is under the queue limit, a chunk at a time, and
+ * give way between chunks to frames of more urgent lanes: if none of the
+ * frame was written, or preemption is on, it is put back to be sent again
+ * whole. With preemption on, a lower lane frame is not started until the
+ * driver's output queue is empty, so that the flush that preempts it can
+ * only discard its own bytes and never the tail of an urgent frame or of
+ * a frame already counted as sent. Writes do not block, so a port held by
+ * flow control cannot keep the lanes from being stopped. Called with the
+ * lock held, which is dropped around each write.
+ * Returns 0, an errno value, TX_LANE_YIELDED or TX_LANE_PREEMPTED.
+ */
+static int send_frame(struct tx_lanes *lanes, int lane, const struct tx_frame *frame,
+                        long character_time){
+    int fd = lanes->port->fd;
+    size_t written = 0, chunk;
+    ssize_t result;
+    long wait;
+    int queued, error;
+
+    for (;;){
+        if (lanes->stopping)
+            return ECANCELED;
+        if (lane > 0 && urgent_waiting(lanes, lane)){
+            if (written == 0)
+                return TX_LANE_YIELDED;
+            if ((lanes->flags & TX_LANES_PREEMPT) && (written < frame->length
+                    || (ioctl(fd, TIOCOUTQ, &queued) == 0 && queued > 0))){
+                tcflush(fd, TCOFLUSH);
+                return TX_LANE_PREEMPTED;
+            }
+        }
+        if (written == frame->length)
+            return 0;
+        if (lane > 0 && written == 0 && (lanes->flags & TX_LANES_PREEMPT)){
+            if (ioctl(fd, TIOCOUTQ, &queued) == -1)
+                return errno;
+            if (queued > 0){
+                // Drain, waking early for an urgent frame or to stop.
+                wait = character_time * (long) queued;
+                wait_nanos(lanes, wait > TX_LANE_MIN_WAIT_NANOS ? wait : TX_LANE_MIN_WAIT_NANOS);
+                continue;
+            }
+        }
+        chunk = frame->length - written;
+        if (lane > 0 && lanes->queue_limit > 0){
+            if (ioctl(fd, TIOCOUTQ, &queued) == -1)
+                return errno;
+            if ((size_t) queued >= lanes->queue_limit){
+                // Sleep for about as long as the excess takes to leave.
+                wait = character_time * (long) (queued - lanes->queue_limit + 1);
+                wait_nanos(lanes, wait > TX_LANE_MIN_WAIT_NANOS ? wait : TX_LANE_MIN_WAIT_NANOS);
+                continue;
+            }
+            if (chunk > lanes->queue_limit - queued)
+                chunk = lanes->queue_limit - queued;
+        }
+        pthread_mutex_unlock(&lanes->lock);
+        result = port_write_nonblocking(lanes->port, frame->data + written, chunk);
+        error = result == -1 ? errno : 0;
+        if (error == EAGAIN && port_wait_writable(lanes->port, -1, TX_LANE_WRITE_WAIT_MILLIS) == -1)
+            error = errno;
+        pthread_mutex_lock(&lanes->lock);
+        if (error == EINTR || error == EAGAIN)
+            continue;
+        if (error != 0)
+            return error;
+        written += result;
+    }
+}
+
+/*
+ * Thread body. Sends the head frame of the most urgent lane with one
+ * waiting, sleeping while all lanes are empty.
+ */
+static void* lanes_thread(void *arg){
+    struct tx_lanes *lanes = (struct tx_lanes*) arg;
+    struct tx_frame *frame;
+    struct tx_lane *lane;
+    struct termios termios;
+    long character_time;
+    int index, status;
+
+    thread_config_register();
+    pthread_mutex_lock(&lanes->lock);
+    while (!lanes->stopping){
+        for (index = 0; index < TX_LANE_COUNT && lanes->lanes[index].head == NULL; index++)
+            ;
+        if (index == TX_LANE_COUNT){
+            pthread_cond_wait(&lanes->wake, &lanes->lock);
+            continue;
+        }
+        lane = &lanes->lanes[index];
+        frame = lane->head;
+        lane->head = frame->next;
+        if (lane->head == NULL)
+            lane->tail = NULL;
+        character_time = 0;
+        if (port_get_termios(lanes->port, &termios) == 0)
+            character_time = character_time_nanos(&termios);
+        status = send_frame(lanes, index, frame, character_time);
+        if (status == TX_LANE_YIELDED || status == TX_LANE_PREEMPTED){
+            frame->next = lane->head;
+            lane->head = frame;
+            if (lane->tail == NULL)
+                lane->tail = frame;
+            if (status == TX_LANE_PREEMPTED)
+                lane->frames_preempted++;
+            continue;
+        }
+        lane->pending_frames--;
+        lane->pending_bytes -= frame->length;
+        if (status == 0){
+            lane->frames_sent++;
+            lane->bytes_sent += frame->length;
+        } else {
+            lane->frames_failed++;
+            syslog(LOG_USER | LOG_DEBUG, "Lane %d frame of %zu bytes failed: %s", index, frame->length, strerror(status));
+        }
+        free(frame);
+        pthread_cond_broadcast(&lanes->space);
+    }
+    pthread_mutex_unlock(&lanes->lock);
+    port_release(lanes->port);
+    thread_config_unregister();
+    return NULL;
+}
+
+static void free_lanes(struct tx_lanes *lanes){
+    struct tx_frame *frame;
+    int i;
+    for (i = 0; i < TX_LANE_COUNT; i++){
+        while ((frame = lanes->lanes[i].head) != NULL){
+            lanes->lanes[i].head = frame->next;
+            free(frame);
+        }
+    }
+    pthread_cond_destroy(&lanes->wake);
+    pthread_cond_destroy(&lanes->space);
+    pthread_mutex_destroy(&lanes->lock);
+    free(lanes);
+}
+
+/*
+ * Stops the thread of a port's lanes, discarding anything still queued,
+ * and frees them once no caller is waiting for room. Called when the port
+ * is closed.
+ */
+static void stop_lanes(struct port_helper *helper){
+    struct tx_lanes *lanes = (struct tx_lanes*) helper;
+    lanes->port->lanes = NULL;
+    pthread_mutex_lock(&lanes->lock);
+    lanes->stopping = 1;
+    pthread_cond_broadcast(&lanes->wake);
+    pthread_cond_broadcast(&lanes->space);
+    pthread_mutex_unlock(&lanes->lock);
+    pthread_join(lanes->thread, NULL);
+    pthread_mutex_lock(&lanes->lock);
+    while (lanes->waiters > 0)
+        pthread_cond_wait(&lanes->space, &lanes->lock);
+    pthread_mutex_unlock(&lanes->lock);
+    free_lanes(lanes);
+}
+
+/*
+ * Returns the locked lanes of a port, starting them on first use if create
+ * is set, or NULL with errno set. The lanes' thread holds its own reference
+ * to the port until it is stopped.
+ */
+static struct tx_lanes* lock_lanes(struct serial_port *port, jlong handle, int create){
+    pthread_condattr_t attributes;
+    struct tx_lanes *lanes;
+    int error = 0;
+
+    pthread_mutex_lock(&port->lock);
+    lanes = port->lanes;
+    if (lanes != NULL || !create || port->shutdown){
+        if (lanes != NULL)
+            pthread_mutex_lock(&lanes->lock);
+        pthread_mutex_unlock(&port->lock);
+        errno = port->shutdown ? EBADF : ENOENT;
+        return lanes;
+    }
+    lanes = calloc(1, sizeof(*lanes));
+    if (lanes == NULL){
+        pthread_mutex_unlock(&port->lock);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&lanes->lock, NULL);
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&lanes->wake, &attributes);
+    pthread_cond_init(&lanes->space, &attributes);
+    pthread_condattr_destroy(&attributes);
+    lanes->queue_limit = TX_LANES_DEFAULT_QUEUE_LIMIT;
+    lanes->port = port_acquire(handle);
+    if (lanes->port == NULL)
+        error = errno;
+    else if ((error = pthread_create(&lanes->thread, NULL, lanes_thread, lanes)) != 0)
+        port_release(lanes->port);
+    if (error != 0){
+        pthread_mutex_unlock(&port->lock);
+        free_lanes(lanes);
+        errno = error;
+        return NULL;
+    }
+    lanes->helper.stop = stop_lanes;
+    port_add_helper(port, &lanes->helper);
+    port->lanes = lanes;
+    pthread_mutex_lock(&lanes->lock);
+    pthread_mutex_unlock(&port->lock);
+    return lanes;
+}
+
+/**
+ * Configures the prioritised transmit lanes of a port, starting their
+ * thread if need be. Frames on lane 0 are always sent first, then those on
+ * lane 1. Lane 1 frames are written no faster than keeps at most
+ * queue_limit bytes in the driver's output queue (TIOCOUTQ), so a lane 0
+ * frame waits for at most that much to drain plus the chunk being written;
+ * a lane 1 frame that has started is otherwise finished first. With
+ * TX_LANES_PREEMPT the driver's queue is flushed (TCOFLUSH) instead and the
+ * interrupted frame is sent again whole afterwards. So that the flush drops
+ * nothing else, each lane 1 frame then waits for the driver's queue to
+ * empty before it starts.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param queue_limit the most bytes lower lanes may have queued in the
+ * driver, 0 to write their frames whole.
+ * @param flags TX_LANES_PREEMPT or 0.
+ * @return 0 upon success.
+ * @throws IOException if the arguments are invalid, the handle is not that
+ * of an open port or the thread cannot be started.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setTransmitLanes (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle,
+                                                    jint queue_limit,
+                                                    jint flags){
+    struct serial_port *port;
+    struct tx_lanes *lanes;
+    if (queue_limit < 0 || queue_limit > TX_LANE_MAX_FRAME){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    lanes = lock_lanes(port, handle, 1);
+    port_release(port);
+    if (lanes == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    lanes->queue_limit = queue_limit;
+    lanes->flags = flags;
+    pthread_cond_broadcast(&lanes->wake);
+    pthread_mutex_unlock(&lanes->lock);
+    return 0;
+}
+
+/**
+ * Queues a frame on one of the transmit lanes of a port, starting the lanes
+ * with their default settings if need be. Frames on a lane are sent in the
+ * order queued. Blocks while the lane holds TX_LANE_MAX_PENDING bytes or
+ * more, so that bulk transfers are paced by the line.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array holding the frame.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the length of the frame.
+ * @param lane the lane, 0 being the most urgent.
+ * @return 0 upon success.
+ * @throws IOException if the arguments are invalid, the handle is not that
+ * of an open port or the port is closed while waiting.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_queueLaneTransmit (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle,
+                                                    jbyteArray buffer,
+                                                    jint offset,
+                                                    jint length,
+                                                    jint lane){
+    struct serial_port *port;
+    struct tx_lanes *lanes;
+    struct tx_lane *queue;
+    struct tx_frame *frame;
+    if (lane < 0 || lane >= TX_LANE_COUNT || length < 1 || length > TX_LANE_MAX_FRAME){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    frame = malloc(sizeof(*frame) + length);
+    if (frame == NULL){
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    frame->next = NULL;
+    frame->length = length;
+    (*env)->GetByteArrayRegion(env, buffer, offset, length, (jbyte*) frame->data);
+    if ((*env)->ExceptionCheck(env)){
+        free(frame);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        free(frame);
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    lanes = lock_lanes(port, handle, 1);
+    port_release(port);
+    if (lanes == NULL){
+        free(frame);
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    queue = &lanes->lanes[lane];
+    while (!lanes->stopping && queue->pending_bytes > 0
+            && queue->pending_bytes + length > TX_LANE_MAX_PENDING){
+        lanes->waiters++;
+        pthread_cond_wait(&lanes->space, &lanes->lock);
+        lanes->waiters--;
+    }
+    if (lanes->stopping){
+        // The port was closed; let it finish freeing the lanes.
+        if (lanes->waiters == 0)
+            pthread_cond_broadcast(&lanes->space);
+        pthread_mutex_unlock(&lanes->lock);
+        free(frame);
+        throw_ioexception(env, EBADF);
+        return -1;
+    }
+    if (queue->tail != NULL)
+        queue->tail->next = frame;
+    else
+        queue->head = frame;
+    queue->tail = frame;
+    queue->pending_frames++;
+    queue->pending_bytes += length;
+    pthread_cond_signal(&lanes->wake);
+    pthread_mutex_unlock(&lanes->lock);
+    return 0;
+}
+
+/**
+ * Returns the counters of the transmit lanes of a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return TX_LANE_STATISTICS_FIELDS values for each lane, most urgent
+ * first, all 0 if the lanes were never started.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getTransmitLaneStatistics (JNIEnv *env,
+                                                            jobject obj,
+                                                            jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct tx_lanes *lanes;
+    struct tx_lane *lane;
+    jlong values[TX_LANE_COUNT * TX_LANE_STATISTICS_FIELDS];
+    jlongArray return_array;
+    int i;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    bzero(values, sizeof(values));
+    lanes = lock_lanes(port, handle, 0);
+    port_release(port);
+    if (lanes != NULL){
+        for (i = 0; i < TX_LANE_COUNT; i++){
+            lane = &lanes->lanes[i];
+            values[i * TX_LANE_STATISTICS_FIELDS] = lane->pending_frames;
+            values[i * TX_LANE_STATISTICS_FIELDS + 1] = lane->pending_bytes;
+            values[i * TX_LANE_STATISTICS_FIELDS + 2] = lane->frames_sent;
+            values[i * TX_LANE_STATISTICS_FIELDS + 3] = lane->bytes_sent;
+            values[i * TX_LANE_STATISTICS_FIELDS + 4] = lane->frames_failed;
+            values[i * TX_LANE_STATISTICS_FIELDS + 5] = lane->frames_preempted;
+        }
+        pthread_mutex_unlock(&lanes->lock);
+    }
+    return_array = (*env)->NewLongArray(env, TX_LANE_COUNT * TX_LANE_STATISTICS_FIELDS);
+    if (return_array != NULL)
+        (*env)->SetLongArrayRegion(env, return_array, 0, TX_LANE_COUNT * TX_LANE_STATISTICS_FIELDS, values);
+    return return_array;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   tx_lanes.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Prioritised transmission: frames are queued on lanes and sent by a native
+ * thread, always from the most urgent lane that has a frame waiting. Lower
+ * lanes are fed to the driver a little at a time so that an urgent frame
+ * never waits behind more than a small amount of bulk data, and may also
+ * flush what the driver holds to go out at once.
+ */
+
+#ifndef TX_LANES_H
+#define	TX_LANES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <syslog.h>
+#include "port.h"
+#include "baud.h"
+#include "thread_config.h"
+
+/*
+ Lane 0 is the most urgent.
+ */
+#define TX_LANE_COUNT 2
+
+/*
+ Flags for setTransmitLanes. These match the constants in Serial.
+ */
+#define TX_LANES_PREEMPT 1
+
+#define TX_LANE_MAX_FRAME (64 * 1024)
+
+/*
+ The most data a lane holds before queueing on it blocks.
+ */
+#define TX_LANE_MAX_PENDING (1024 * 1024)
+
+/*
+ The most bytes lower lanes may leave in the driver's output queue unless
+ set otherwise. 0 writes lower lane frames whole.
+ */
+#define TX_LANES_DEFAULT_QUEUE_LIMIT 64
+
+/*
+ The statistics handed to Java for each lane: frames waiting, bytes
+ waiting, frames sent, bytes sent, frames that failed and frames restarted
+ after being preempted.
+ */
+#define TX_LANE_STATISTICS_FIELDS 6
+
+struct tx_frame {
+    struct tx_frame *next;
+    size_t length;
+    unsigned char data[];
+};
+
+struct tx_lane {
+    struct tx_frame *head;
+    struct tx_frame *tail;
+    uint64_t pending_frames;
+    uint64_t pending_bytes;
+    uint64_t frames_sent;
+    uint64_t bytes_sent;
+    uint64_t frames_failed;
+    uint64_t frames_preempted;
+};
+
+struct tx_lanes {
+    struct port_helper helper;
+    struct serial_port *port;
+    pthread_t thread;
+    /* Guards everything below. */
+    pthread_mutex_t lock;
+    /* Signalled when a frame is queued or the lanes are stopped. */
+    pthread_cond_t wake;
+    /* Signalled when a lane has room or a waiting caller leaves. */
+    pthread_cond_t space;
+    int stopping;
+    int waiters;
+    int flags;
+    size_t queue_limit;
+    struct tx_lane lanes[TX_LANE_COUNT];
+};
+
+#endif	/* TX_LANES_H */
@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "tx_scheduler.h"
+
+#define NANOS_PER_SECOND 1000000000ULL
+
+static uint64_t now_nanos(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * NANOS_PER_SECOND + now.tv_nsec;
+}
+
+static void nanos_to_timespec(uint64_t nanos, struct timespec *time){
+    time->tv_sec = nanos / NANOS_PER_SECOND;
+    time->tv_nsec = nanos % NANOS_PER_SECOND;
+}
+
+/*
+ * Heap order: earliest target first, items with the same target in the order
+ * they were queued.
+ */
+static int item_before(const struct tx_item *a, const struct tx_item *b){
+    if (a->target != b->target)
+        return a->target < b->target;
+    return (int32_t) (a->id - b->id) < 0;
+}
+
+static int push_item(struct tx_scheduler *scheduler, const struct tx_item *item){
+    size_t child, parent;
+    if (scheduler->count == scheduler->capacity){
+        size_t capacity = scheduler->capacity == 0 ? 64 : scheduler->capacity * 2;
+        struct tx_item *items = realloc(scheduler->items, capacity * sizeof(*items));
+        if (items == NULL)
+            return -1;
+        scheduler->items = items;
+        scheduler->capacity = capacity;
+    }
+    child = scheduler->count++;
+    while (child > 0){
+        parent = (child - 1) / 2;
+        if (!item_before(item, &scheduler->items[parent]))
+            break;
+        scheduler->items[child] = scheduler->items[parent];
+        child = parent;
+    }
+    scheduler->items[child] = *item;
+    return 0;
+}
+
+static void pop_item(struct tx_scheduler *scheduler, struct tx_item *item){
+    struct tx_item last;
+    size_t parent = 0, child;
+    *item = scheduler->items[0];
+    last = scheduler->items[--scheduler->count];
+    while ((child = 2 * parent + 1) < scheduler->count){
+        if (child + 1 < scheduler->count
+                && item_before(&scheduler->items[child + 1], &scheduler->items[child]))
+            child++;
+        if (!item_before(&scheduler->items[child], &last))
+            break;
+        scheduler->items[parent] = scheduler->items[child];
+        parent = child;
+    }
+    scheduler->items[parent] = last;
+}
+
+static void record_timing(struct tx_scheduler *scheduler, const struct tx_item *item,
+                            uint64_t actual, int status){
+    struct tx_timing *timing;
+    if (scheduler->timing_count == TX_MAX_TIMINGS){
+        scheduler->timing_start = (scheduler->timing_start + 1) % TX_MAX_TIMINGS;
+        scheduler->timing_count--;
+    }
+    timing = &scheduler->timings[(scheduler->timing_start + scheduler->timing_count) % TX_MAX_TIMINGS];
+    timing->id = item->id;
+    timing->target = item->target;
+    timing->actual = actual;
+    timing->status = status;
+    scheduler->timing_count++;
+}
+
+/*
+ * Called when the wakeup eventfd is readable during a send. Returns 1 if the
+ * scheduler is stopping; any other wakeup is for a change to the queue,
+ * which the thread looks at once the send is done. The eventfd is cleared
+ * before stopping is looked at so that a stop cannot be missed.
+ */
+static int woken_to_stop(struct tx_scheduler *scheduler){
+    eventfd_t value;
+    int stopping;
+    eventfd_read(scheduler->wake_fd, &value);
+    pthread_mutex_lock(&scheduler->lock);
+    stopping = scheduler->stopping;
+    pthread_mutex_unlock(&scheduler->lock);
+    return stopping;
+}
+
+/*
+ * Sends one item. Frames are written without blocking and a break waits
+ * for the output to drain with TIOCOUTQ, so that the thread can be stopped
+ * while flow control holds the port. Returns 0 or an errno value; actual is
+ * set to the time the transmission started.
+ */
+static int send_item(struct tx_scheduler *scheduler, const struct tx_item *item,
+                        uint64_t *actual){
+    int fd = scheduler->port->fd;
+    size_t written = 0;
+    ssize_t result;
+    struct timespec end;
+    int events;
+
+    if (item->type == TX_ITEM_BREAK){
+        // Let the previous frame leave the UART before the line is held low.
+        while (port_drain(scheduler->port, scheduler->wake_fd) == 1){
+            if (woken_to_stop(scheduler))
+                return ECANCELED;
+        }
+        *actual = now_nanos();
+        if (item->duration == 0)
+            return tcsendbreak(fd, 0) == -1 ? errno : 0;
+        if (ioctl(fd, TIOCSBRK) == -1)
+            return errno;
+        nanos_to_timespec(*actual + item->duration, &end);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL) == EINTR)
+            ;
+        return ioctl(fd, TIOCCBRK) == -1 ? errno : 0;
+    }
+    *actual = now_nanos();
+    while (written < item->length){
+        result = port_write_nonblocking(scheduler->port, item->data + written,
+                                        item->length - written);
+        if (result >= 0){
+            written += result;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN)
+            return errno;
+        events = port_wait_writable(scheduler->port, scheduler->wake_fd, -1);
+        if (events == -1)
+            return errno;
+        if (events == 0 && woken_to_stop(scheduler))
+            return ECANCELED;
+    }
+    return 0;
+}
+
+/*
+ * Thread body. Sleeps on a timerfd armed for the earliest item and an
+ * eventfd that is signalled whenever the queue changes.
+ */
+static void* scheduler_thread(void *arg){
+    struct tx_scheduler *scheduler = (struct tx_scheduler*) arg;
+    struct itimerspec timer;
+    struct pollfd pfds[2];
+    struct tx_item item;
+    uint64_t actual, value;
+    int status;
+
+    thread_config_register();
+    // Ask for timer wakeups without the default 50us slack.
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    pfds[0].fd = scheduler->timer_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = scheduler->wake_fd;
+    pfds[1].events = POLLIN;
+    bzero(&timer, sizeof(timer));
+
+    pthread_mutex_lock(&scheduler->lock);
+    while (!scheduler->stopping){
+        if (scheduler->count > 0 && scheduler->items[0].target <= now_nanos()){
+            pop_item(scheduler, &item);
+            pthread_mutex_unlock(&scheduler->lock);
+            status = send_item(scheduler, &item, &actual);
+            free(item.data);
+            pthread_mutex_lock(&scheduler->lock);
+            record_timing(scheduler, &item, actual, status);
+            continue;
+        }
+        if (scheduler->count > 0)
+            nanos_to_timespec(scheduler->items[0].target, &timer.it_value);
+        else
+            bzero(&timer.it_value, sizeof(timer.it_value));
+        timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+        pthread_mutex_unlock(&scheduler->lock);
+        if (poll(pfds, 2, -1) > 0){
+            if (pfds[0].revents & POLLIN)
+                read(scheduler->timer_fd, &value, sizeof(value));
+            if (pfds[1].revents & POLLIN)
+                eventfd_read(scheduler->wake_fd, &value);
+        }
+        pthread_mutex_lock(&scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    port_release(scheduler->port);
+    thread_config_unregister();
+    return NULL;
+}
+
+static void free_scheduler(struct tx_scheduler *scheduler){
+    size_t i;
+    for (i = 0; i < scheduler->count; i++){
+        free(scheduler->items[i].data);
+    }
+    free(scheduler->items);
+    if (scheduler->timer_fd != -1)
+        close(scheduler->timer_fd);
+    if (scheduler->wake_fd != -1)
+        close(scheduler->wake_fd);
+    pthread_mutex_destroy(&scheduler->lock);
+    free(scheduler);
+}
+
+/*
+ * Stops a scheduler's thread, discarding anything still queued, and frees
+ * it. Called when the port is closed.
+ */
+static void stop_scheduler(struct port_helper *helper){
+    struct tx_scheduler *scheduler = (struct tx_scheduler*) helper;
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = 1;
+    pthread_mutex_unlock(&scheduler->lock);
+    eventfd_write(scheduler->wake_fd, 1);
+    pthread_join(scheduler->thread, NULL);
+    free_scheduler(scheduler);
+}
+
+/*
+ * Returns the scheduler of a port, starting it on first use. The scheduler
+ * thread holds its own reference to the port until it is stopped.
+ */
+static struct tx_scheduler* get_scheduler(struct serial_port *port, jlong handle){
+    struct tx_scheduler *scheduler;
+    int error;
+
+    pthread_mutex_lock(&port->lock);
+    scheduler = port->scheduler;
+    if (scheduler != NULL || port->shutdown){
+        pthread_mutex_unlock(&port->lock);
+        if (scheduler == NULL)
+            errno = EBADF;
+        return scheduler;
+    }
+    scheduler = calloc(1, sizeof(*scheduler));
+    if (scheduler == NULL){
+        pthread_mutex_unlock(&port->lock);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&scheduler->lock, NULL);
+    scheduler->next_id = 1;
+    scheduler->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    scheduler->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    scheduler->port = port_acquire(handle);
+    if (scheduler->timer_fd == -1 || scheduler->wake_fd == -1 || scheduler->port == NULL){
+        error = errno;
+        goto fail;
+    }
+    if ((error = pthread_create(&scheduler->thread, NULL, scheduler_thread, scheduler)) != 0)
+        goto fail;
+    scheduler->helper.stop = stop_scheduler;
+    port_add_helper(port, &scheduler->helper);
+    port->scheduler = scheduler;
+    pthread_mutex_unlock(&port->lock);
+    return scheduler;
+
+fail:
+    pthread_mutex_unlock(&port->lock);
+    if (scheduler->port != NULL)
+        port_release(scheduler->port);
+    free_scheduler(scheduler);
+    errno = error;
+    return NULL;
+}
+
+/*
+ * Queues an item, taking ownership of its data. Returns the item id or -1
+ * with errno set.
+ */
+static jint queue_item(jlong handle, struct tx_item *item){
+    struct serial_port *port = port_acquire(handle);
+    struct tx_scheduler *scheduler;
+    jint id = -1;
+    if (port == NULL)
+        return -1;
+    scheduler = get_scheduler(port, handle);
+    if (scheduler != NULL){
+        pthread_mutex_lock(&scheduler->lock);
+        item->id = scheduler->next_id++;
+        if (push_item(scheduler, item) == 0)
+            id = (jint) item->id;
+        else
+            errno = ENOMEM;
+        pthread_mutex_unlock(&scheduler->lock);
+        if (id != -1)
+            eventfd_write(scheduler->wake_fd, 1);
+    }
+    port_release(port);
+    return id;
+}
+
+/**
+ * Returns the current CLOCK_MONOTONIC time, the clock that transmission
+ * targets are given in.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @return the time in nanoseconds.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_javatechnics_rs232_Serial_getMonotonicTime (JNIEnv *env, jobject obj){
+    return (jlong) now_nanos();
+}
+
+/**
+ * Queues a buffer to be written at a given time by the port's transmit
+ * thread. Items are sent in target time order; those with the same target
+ * in the order they were queued. A target in the past is sent at once.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param buffer the array holding the data.
+ * @param offset the offset into buffer of the first byte.
+ * @param length the number of bytes.
+ * @param target the CLOCK_MONOTONIC time, in nanoseconds, to send at.
+ * @return the id of the item, as reported by getTransmitTimings.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_scheduleTransmit (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle,
+                                                    jbyteArray buffer,
+                                                    jint offset,
+                                                    jint length,
+                                                    jlong target){
+    struct tx_item item;
+    jint id;
+    if (length < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    bzero(&item, sizeof(item));
+    item.type = TX_ITEM_DATA;
+    item.target = (uint64_t) target;
+    item.length = length;
+    item.data = malloc(length > 0 ? length : 1);
+    if (item.data == NULL){
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    (*env)->GetByteArrayRegion(env, buffer, offset, length, (jbyte*) item.data);
+    if ((*env)->ExceptionCheck(env)){
+        free(item.data);
+        return -1;
+    }
+    id = queue_item(handle, &item);
+    if (id == -1){
+        free(item.data);
+        throw_ioexception(env, errno);
+    }
+    return id;
+}
+
+/**
+ * Queues a break on the line at a given time. Output already queued is
+ * drained first. With a duration of 0 a standard tcsendbreak() is sent;
+ * otherwise the line is held in break (TIOCSBRK) for the given time, e.g.
+ * the DMX512 break.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param duration_micros the length of the break in microseconds.
+ * @param target the CLOCK_MONOTONIC time, in nanoseconds, to start at.
+ * @return the id of the item, as reported by getTransmitTimings.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_scheduleBreak (JNIEnv *env,
+                                                jobject obj,
+                                                jlong handle,
+                                                jint duration_micros,
+                                                jlong target){
+    struct tx_item item;
+    jint id;
+    if (duration_micros < 0){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    bzero(&item, sizeof(item));
+    item.type = TX_ITEM_BREAK;
+    item.target = (uint64_t) target;
+    item.duration = (uint64_t) duration_micros * 1000;
+    id = queue_item(handle, &item);
+    if (id == -1)
+        throw_ioexception(env, errno);
+    return id;
+}
+
+/**
+ * Collects the timing of items sent since the last call: for each, its id,
+ * target time, actual start time and 0 or the errno value it failed with.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param records the array to fill with TX_TIMING_FIELDS values per item.
+ * @return the number of items reported.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_getTransmitTimings (JNIEnv *env,
+                                                    jobject obj,
+                                                    jlong handle,
+                                                    jlongArray records){
+    struct serial_port *port = port_acquire(handle);
+    struct tx_scheduler *scheduler;
+    jlong *values;
+    jint count = 0, capacity;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    capacity = (*env)->GetArrayLength(env, records) / TX_TIMING_FIELDS;
+    values = malloc((capacity + 1) * TX_TIMING_FIELDS * sizeof(jlong));
+    if (values == NULL){
+        port_release(port);
+        throw_ioexception(env, ENOMEM);
+        return -1;
+    }
+    pthread_mutex_lock(&port->lock);
+    scheduler = port->scheduler;
+    if (scheduler != NULL){
+        pthread_mutex_lock(&scheduler->lock);
+        while (count < capacity && scheduler->timing_count > 0){
+            const struct tx_timing *timing = &scheduler->timings[scheduler->timing_start];
+            values[count * TX_TIMING_FIELDS] = timing->id;
+            values[count * TX_TIMING_FIELDS + 1] = (jlong) timing->target;
+            values[count * TX_TIMING_FIELDS + 2] = (jlong) timing->actual;
+            values[count * TX_TIMING_FIELDS + 3] = timing->status;
+            scheduler->timing_start = (scheduler->timing_start + 1) % TX_MAX_TIMINGS;
+            scheduler->timing_count--;
+            count++;
+        }
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+    pthread_mutex_unlock(&port->lock);
+    port_release(port);
+    (*env)->SetLongArrayRegion(env, records, 0, count * TX_TIMING_FIELDS, values);
+    free(values);
+    return count;
+}
+
+/**
+ * Discards every item still waiting to be sent.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return the number of items discarded.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_cancelScheduledTransmits (JNIEnv *env,
+                                                            jobject obj,
+                                                            jlong handle){
+    struct serial_port *port = port_acquire(handle);
+    struct tx_scheduler *scheduler;
+    jint count = 0;
+    size_t i;
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    pthread_mutex_lock(&port->lock);
+    scheduler = port->scheduler;
+    if (scheduler != NULL){
+        pthread_mutex_lock(&scheduler->lock);
+        for (i = 0; i < scheduler->count; i++){
+            free(scheduler->items[i].data);
+        }
+        count = (jint) scheduler->count;
+        scheduler->count = 0;
+        pthread_mutex_unlock(&scheduler->lock);
+        eventfd_write(scheduler->wake_fd, 1);
+    }
+    pthread_mutex_unlock(&port->lock);
+    port_release(port);
+    return count;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   tx_scheduler.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Timed transmission: buffers and line breaks queued against absolute
+ * CLOCK_MONOTONIC times and sent from a dedicated native thread.
+ */
+
+#ifndef TX_SCHEDULER_H
+#define	TX_SCHEDULER_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include "port.h"
+#include "thread_config.h"
+
+#define TX_ITEM_DATA    0
+#define TX_ITEM_BREAK   1
+
+/*
+ The number of completed transmissions whose timing is remembered until
+ collected. The oldest records are dropped first.
+ */
+#define TX_MAX_TIMINGS 1024
+
+/*
+ Each timing record handed to Java is the id, the target time, the time the
+ transmission actually started and 0 or an errno value.
+ */
+#define TX_TIMING_FIELDS 4
+
+struct tx_item {
+    uint64_t target;
+    uint32_t id;
+    int type;
+    uint64_t duration;
+    size_t length;
+    unsigned char *data;
+};
+
+struct tx_timing {
+    uint32_t id;
+    uint64_t target;
+    uint64_t actual;
+    int status;
+};
+
+struct tx_scheduler {
+    struct port_helper helper;
+    struct serial_port *port;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int timer_fd;
+    int wake_fd;
+    int stopping;
+    /* Items waiting to be sent, a binary heap ordered by target time. */
+    struct tx_item *items;
+    size_t count;
+    size_t capacity;
+    uint32_t next_id;
+    struct tx_timing timings[TX_MAX_TIMINGS];
+    size_t timing_start;
+    size_t timing_count;
+};
+
+#endif	/* TX_SCHEDULER_H */
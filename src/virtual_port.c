@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "virtual_port.h"
+
+#define NANOS_PER_SECOND 1000000000ULL
+/*
+ After an idle period the shaped line may catch up by at most this much so
+ that bursts stay close to the configured rate.
+ */
+#define VIRTUAL_MAX_BURST 2000000ULL
+
+static pthread_mutex_t pairs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct virtual_pair **pairs = NULL;
+static int pair_capacity = 0;
+
+static uint64_t now_nanos(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * NANOS_PER_SECOND + now.tv_nsec;
+}
+
+/*
+ * Reads whatever is waiting on the link's source into a new chunk, flipping
+ * a random bit in each byte selected for error injection.
+ */
+static void fill_link(struct virtual_pair *pair, struct virtual_link *link){
+    struct virtual_chunk *chunk;
+    int result, i;
+
+    if (link->count == VIRTUAL_CHUNK_COUNT)
+        return;
+    chunk = &link->chunks[(link->head + link->count) % VIRTUAL_CHUNK_COUNT];
+    result = read(link->from_fd, chunk->data, VIRTUAL_CHUNK_SIZE);
+    if (result <= 0)
+        return;
+    if (pair->error_rate != 0){
+        for (i = 0; i < result; i++){
+            if ((unsigned int) rand_r(&pair->seed) % 1000000 < pair->error_rate)
+                chunk->data[i] ^= 1 << (rand_r(&pair->seed) % 8);
+        }
+    }
+    chunk->due = now_nanos() + pair->latency;
+    chunk->offset = 0;
+    chunk->length = result;
+    link->count++;
+}
+
+/*
+ * Writes out as much of the link's due data as the line rate allows.
+ * Returns the time at which the link next needs attention, 0 if it has
+ * nothing queued or UINT64_MAX if it is waiting for its destination to
+ * become writable.
+ */
+static uint64_t drain_link(struct virtual_pair *pair, struct virtual_link *link){
+    struct virtual_chunk *chunk;
+    uint64_t now;
+    int length, result;
+
+    while (link->count > 0){
+        chunk = &link->chunks[link->head];
+        now = now_nanos();
+        if (now < chunk->due)
+            return chunk->due;
+        length = chunk->length - chunk->offset;
+        if (pair->byte_time != 0){
+            uint64_t burst = pair->byte_time > VIRTUAL_MAX_BURST ? pair->byte_time : VIRTUAL_MAX_BURST;
+            uint64_t allowed;
+            if (link->line_free + burst < now)
+                link->line_free = now - burst;
+            allowed = now > link->line_free ? (now - link->line_free) / pair->byte_time : 0;
+            if (allowed == 0)
+                return link->line_free + pair->byte_time;
+            if ((uint64_t) length > allowed)
+                length = (int) allowed;
+        }
+        result = write(link->to_fd, chunk->data + chunk->offset, length);
+        if (result == -1){
+            if (errno == EAGAIN || errno == EINTR)
+                return UINT64_MAX;
+            // Nobody can receive this; drop it rather than spin on it.
+            syslog(LOG_USER | LOG_DEBUG, "Virtual port write failed: %s", strerror(errno));
+            result = chunk->length - chunk->offset;
+        }
+        chunk->offset += result;
+        link->line_free += (uint64_t) result * pair->byte_time;
+        if (chunk->offset == chunk->length){
+            link->head = (link->head + 1) % VIRTUAL_CHUNK_COUNT;
+            link->count--;
+        }
+        if (result < length)
+            return UINT64_MAX;
+    }
+    return 0;
+}
+
+/*
+ * Thread body of the relay between the two pty masters.
+ */
+static void* virtual_relay(void *arg){
+    struct virtual_pair *pair = (struct virtual_pair*) arg;
+    struct pollfd pfds[3];
+    uint64_t wake[2] = {0, 0}, next, now;
+    struct timespec timeout;
+    int i, timed;
+
+    thread_config_register();
+    while (!pair->stopping){
+        pfds[0].fd = pair->wake_fd;
+        pfds[0].events = POLLIN;
+        next = 0;
+        for (i = 0; i < 2; i++){
+            // Master i is the source of link i and the destination of the other.
+            pfds[i + 1].fd = pair->master_fds[i];
+            pfds[i + 1].events = 0;
+            if (pair->links[i].count < VIRTUAL_CHUNK_COUNT)
+                pfds[i + 1].events |= POLLIN;
+            if (wake[1 - i] == UINT64_MAX)
+                pfds[i + 1].events |= POLLOUT;
+            if (wake[i] != 0 && wake[i] != UINT64_MAX && (next == 0 || wake[i] < next))
+                next = wake[i];
+        }
+        timed = next != 0;
+        if (timed){
+            now = now_nanos();
+            next = next > now ? next - now : 0;
+            timeout.tv_sec = next / NANOS_PER_SECOND;
+            timeout.tv_nsec = next % NANOS_PER_SECOND;
+        }
+        if (ppoll(pfds, 3, timed ? &timeout : NULL, NULL) == -1 && errno != EINTR)
+            break;
+        if (pfds[0].revents & POLLIN)
+            break;
+        for (i = 0; i < 2; i++){
+            if (pfds[i + 1].revents & POLLIN)
+                fill_link(pair, &pair->links[i]);
+        }
+        for (i = 0; i < 2; i++){
+            wake[i] = drain_link(pair, &pair->links[i]);
+        }
+    }
+    thread_config_unregister();
+    return NULL;
+}
+
+static void free_pair(struct virtual_pair *pair){
+    int i;
+    for (i = 0; i < 2; i++){
+        if (pair->master_fds[i] != -1)
+            close(pair->master_fds[i]);
+        if (pair->slave_fds[i] != -1)
+            close(pair->slave_fds[i]);
+    }
+    if (pair->wake_fd != -1)
+        close(pair->wake_fd);
+    free(pair);
+}
+
+/*
+ * Stores pair in the first free slot of the table and returns its id, or -1.
+ */
+static int register_pair(struct virtual_pair *pair){
+    int id = -1, i;
+    pthread_mutex_lock(&pairs_lock);
+    for (i = 0; i < pair_capacity && id == -1; i++){
+        if (pairs[i] == NULL)
+            id = i;
+    }
+    if (id == -1){
+        int capacity = pair_capacity == 0 ? 16 : pair_capacity * 2;
+        struct virtual_pair **table = realloc(pairs, capacity * sizeof(*table));
+        if (table != NULL){
+            memset(table + pair_capacity, 0, (capacity - pair_capacity) * sizeof(*table));
+            id = pair_capacity;
+            pairs = table;
+            pair_capacity = capacity;
+        }
+    }
+    if (id != -1)
+        pairs[id] = pair;
+    pthread_mutex_unlock(&pairs_lock);
+    return id;
+}
+
+/**
+ * Creates a virtual null-modem: two pseudo-terminals whose data is relayed
+ * to each other by a native thread. The returned file descriptors are ttys
+ * and may be used with all the Serial natives. Both start in raw mode.
+ * The relay can optionally emulate a slow or unreliable line.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param bytes_per_second the bandwidth of each direction, 0 for unlimited.
+ * @param latency_micros the delay added to every byte, in microseconds.
+ * @param error_rate the probability, in parts per million, that any given
+ * byte has one bit flipped. 0 disables error injection.
+ * @return an array of the pair id and the file descriptors of the two ends.
+ * @throws IOException if the pair cannot be created.
+ */
+JNIEXPORT jintArray JNICALL
+Java_com_javatechnics_rs232_Serial_openVirtualPortPair (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint bytes_per_second,
+                                                        jint latency_micros,
+                                                        jint error_rate){
+    struct virtual_pair *pair;
+    struct termios l_termios;
+    jintArray return_array;
+    jint values[3] = {-1, -1, -1};
+    int i, error, id;
+
+    if (bytes_per_second < 0 || latency_micros < 0 || error_rate < 0){
+        throw_ioexception(env, EINVAL);
+        return NULL;
+    }
+    pair = calloc(1, sizeof(*pair));
+    if (pair == NULL){
+        throw_ioexception(env, ENOMEM);
+        return NULL;
+    }
+    pair->master_fds[0] = pair->master_fds[1] = -1;
+    pair->slave_fds[0] = pair->slave_fds[1] = -1;
+    pair->byte_time = bytes_per_second != 0 ? NANOS_PER_SECOND / bytes_per_second : 0;
+    pair->latency = (uint64_t) latency_micros * 1000;
+    pair->error_rate = error_rate;
+    pair->seed = (unsigned int) now_nanos();
+    pair->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (pair->wake_fd == -1)
+        goto fail;
+
+    for (i = 0; i < 2; i++){
+        if (openpty(&pair->master_fds[i], &pair->slave_fds[i], pair->names[i], NULL, NULL) == -1)
+            goto fail;
+        // The default line discipline would echo data back into the relay.
+        if (tcgetattr(pair->slave_fds[i], &l_termios) == -1)
+            goto fail;
+        cfmakeraw(&l_termios);
+        if (tcsetattr(pair->slave_fds[i], TCSANOW, &l_termios) == -1)
+            goto fail;
+        fcntl(pair->master_fds[i], F_SETFL, fcntl(pair->master_fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(pair->master_fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(pair->slave_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    pair->links[0].from_fd = pair->master_fds[0];
+    pair->links[0].to_fd = pair->master_fds[1];
+    pair->links[1].from_fd = pair->master_fds[1];
+    pair->links[1].to_fd = pair->master_fds[0];
+
+    // Java gets its own descriptors; the relay keeps the originals open so
+    // that closing one end from Java does not hang up the master.
+    for (i = 0; i < 2; i++){
+        values[i + 1] = dup(pair->slave_fds[i]);
+        if (values[i + 1] == -1)
+            goto fail;
+    }
+    if ((error = pthread_create(&pair->relay_thread, NULL, virtual_relay, pair)) != 0){
+        errno = error;
+        goto fail;
+    }
+    id = register_pair(pair);
+    if (id == -1){
+        pair->stopping = 1;
+        eventfd_write(pair->wake_fd, 1);
+        pthread_join(pair->relay_thread, NULL);
+        errno = ENOMEM;
+        goto fail;
+    }
+    values[0] = id;
+    return_array = (*env)->NewIntArray(env, 3);
+    if (return_array != NULL)
+        (*env)->SetIntArrayRegion(env, return_array, 0, 3, values);
+    return return_array;
+
+fail:
+    error = errno;
+    for (i = 1; i < 3; i++){
+        if (values[i] != -1)
+            close(values[i]);
+    }
+    free_pair(pair);
+    throw_ioexception(env, error);
+    return NULL;
+}
+
+/**
+ * Returns the device paths of both ends of a virtual port pair so that they
+ * can also be opened with openSerialPort.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the pair id returned by openVirtualPortPair.
+ * @return a two element array of paths.
+ * @throws IOException if the id is not that of an open pair.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_javatechnics_rs232_Serial_getVirtualPortNames (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint id){
+    jobjectArray return_array = NULL;
+    jclass string_class;
+    int i;
+
+    pthread_mutex_lock(&pairs_lock);
+    if (id < 0 || id >= pair_capacity || pairs[id] == NULL){
+        throw_ioexception(env, EINVAL);
+    } else {
+        string_class = (*env)->FindClass(env, "java/lang/String");
+        if (string_class != NULL)
+            return_array = (*env)->NewObjectArray(env, 2, string_class, NULL);
+        for (i = 0; return_array != NULL && i < 2; i++){
+            jstring name = (*env)->NewStringUTF(env, pairs[id]->names[i]);
+            if (name == NULL){
+                return_array = NULL;
+                break;
+            }
+            (*env)->SetObjectArrayElement(env, return_array, i, name);
+        }
+    }
+    pthread_mutex_unlock(&pairs_lock);
+    return return_array;
+}
+
+/**
+ * Stops the relay of a virtual port pair. Any data still in flight is
+ * discarded. The file descriptors returned by openVirtualPortPair remain
+ * open and must be closed with closeSerialPort; reads on them will then
+ * report the hang up.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param id the pair id returned by openVirtualPortPair.
+ * @return 0 upon success or -1 if an error occurs and an exception not thrown.
+ * @throws IOException if the id is not that of an open pair.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_closeVirtualPortPair (JNIEnv *env,
+                                                        jobject obj,
+                                                        jint id){
+    struct virtual_pair *pair = NULL;
+
+    pthread_mutex_lock(&pairs_lock);
+    if (id >= 0 && id < pair_capacity){
+        pair = pairs[id];
+        pairs[id] = NULL;
+    }
+    pthread_mutex_unlock(&pairs_lock);
+    if (pair == NULL){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+
+    pair->stopping = 1;
+    eventfd_write(pair->wake_fd, 1);
+    pthread_join(pair->relay_thread, NULL);
+    free_pair(pair);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   virtual_port.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Pairs of pseudo-terminals connected back to back, i.e. a virtual null-modem
+ * cable, for use when no serial hardware is available.
+ */
+
+#ifndef VIRTUAL_PORT_H
+#define	VIRTUAL_PORT_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <poll.h>
+#include <pty.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include "jni/com_javatechnics_rs232_Serial.h"
+#include "thread_config.h"
+
+/*
+ Data in flight through the relay is held in fixed size chunks, each of
+ which is released once its latency has elapsed.
+ */
+#define VIRTUAL_CHUNK_SIZE 256
+#define VIRTUAL_CHUNK_COUNT 64
+
+#define VIRTUAL_PORT_NAME_LENGTH 64
+
+struct virtual_chunk {
+    uint64_t due;
+    int offset;
+    int length;
+    unsigned char data[VIRTUAL_CHUNK_SIZE];
+};
+
+/*
+ One direction of the null-modem: bytes read from the master of one pty are
+ written to the master of the other.
+ */
+struct virtual_link {
+    int from_fd;
+    int to_fd;
+    struct virtual_chunk chunks[VIRTUAL_CHUNK_COUNT];
+    int head;
+    int count;
+    uint64_t line_free;
+};
+
+struct virtual_pair {
+    int master_fds[2];
+    int slave_fds[2];
+    char names[2][VIRTUAL_PORT_NAME_LENGTH];
+    int wake_fd;
+    int stopping;
+    pthread_t relay_thread;
+    uint64_t byte_time;
+    uint64_t latency;
+    unsigned int error_rate;
+    unsigned int seed;
+    struct virtual_link links[2];
+};
+
+extern int throw_ioexception(JNIEnv *env, int error_number);
+
+#endif	/* VIRTUAL_PORT_H */
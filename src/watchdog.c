@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+#include "watchdog.h"
+
+/*
+ A single thread serves the watchdogs of every port. It runs while any port
+ is watched; the timer and its wakeup eventfd are kept for the life of the
+ library.
+ */
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_done;
+static pthread_cond_t events_ready;
+static pthread_once_t watchdog_once = PTHREAD_ONCE_INIT;
+static struct port_watchdog *watchdogs = NULL;
+static int watchdog_running = 0;
+static int timer_fd = -1;
+static int wake_fd = -1;
+static int setup_error = 0;
+
+static struct watchdog_event events[WATCHDOG_EVENT_QUEUE];
+static size_t event_start = 0;
+static size_t event_count = 0;
+
+static uint64_t now_nanos(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void init_watchdog(void){
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&watchdog_done, &attributes);
+    pthread_cond_init(&events_ready, &attributes);
+    pthread_condattr_destroy(&attributes);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer_fd != -1)
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (timer_fd == -1 || wake_fd == -1)
+        setup_error = errno;
+}
+
+/*
+ * Queues an event for Java, dropping the oldest if the queue is full.
+ * Called with the watchdog lock held.
+ */
+static void queue_event(struct port_watchdog *watchdog, int event, uint64_t value){
+    struct watchdog_event *slot;
+    if (event_count == WATCHDOG_EVENT_QUEUE){
+        event_start = (event_start + 1) % WATCHDOG_EVENT_QUEUE;
+        event_count--;
+    }
+    slot = &events[(event_start + event_count) % WATCHDOG_EVENT_QUEUE];
+    slot->handle = watchdog->handle;
+    slot->event = event;
+    slot->value = value;
+    event_count++;
+    pthread_cond_broadcast(&events_ready);
+}
+
+/*
+ * Notes that data was received. A stale port becomes active again. The
+ * watchdog may have just been turned off but is not freed before close.
+ */
+void watchdog_received(struct port_watchdog *watchdog){
+    uint64_t now = now_nanos(), previous = watchdog->last_rx;
+
+    watchdog->last_rx = now;
+    if (watchdog->stale && __sync_bool_compare_and_swap(&watchdog->stale, 1, 0)){
+        pthread_mutex_lock(&watchdog_lock);
+        if (watchdog->active){
+            queue_event(watchdog, WATCHDOG_EVENT_ACTIVE, (now - previous) / 1000000);
+            // The idle deadline runs again from now.
+            eventfd_write(wake_fd, 1);
+        }
+        pthread_mutex_unlock(&watchdog_lock);
+    }
+}
+
+/*
+ * Notes that data was sent, which puts off the next keepalive.
+ */
+void watchdog_sent(struct port_watchdog *watchdog){
+    watchdog->last_tx = now_nanos();
+}
+
+/*
+ * Writes a keepalive frame if the port can take it now. The watchdog thread
+ * serves every port, so it never waits on a port that is flow controlled.
+ * Returns 0 or an errno value.
+ */
+static int send_keepalive(struct serial_port *port, const unsigned char *frame, size_t length){
+    size_t written = 0;
+    ssize_t result;
+    int events = port_wait(port, POLLOUT, 0);
+
+    if (events == -1)
+        return errno;
+    if (!(events & POLLOUT))
+        return EAGAIN;
+    while (written < length){
+        result = port_write(port, frame + written, length - written);
+        if (result == -1){
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        written += result;
+    }
+    return 0;
+}
+
+static uint64_t earlier(uint64_t earliest, uint64_t deadline){
+    return earliest == 0 || deadline < earliest ? deadline : earliest;
+}
+
+/*
+ * Thread body. Marks ports stale and finds the first keepalive due, then
+ * sleeps on the timer armed for the next deadline of any port and an
+ * eventfd signalled whenever a watchdog is added, changed or removed.
+ */
+static void* watchdog_thread(void *arg){
+    unsigned char frame[WATCHDOG_MAX_KEEPALIVE];
+    struct port_watchdog *watchdog, *due;
+    struct itimerspec timer;
+    struct pollfd pfds[2];
+    uint64_t now, earliest, value;
+    size_t length;
+    int error;
+
+    thread_config_register();
+    pfds[0].fd = timer_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = wake_fd;
+    pfds[1].events = POLLIN;
+    bzero(&timer, sizeof(timer));
+
+    pthread_mutex_lock(&watchdog_lock);
+    while (watchdogs != NULL){
+        now = now_nanos();
+        due = NULL;
+        earliest = 0;
+        for (watchdog = watchdogs; watchdog != NULL && due == NULL; watchdog = watchdog->next){
+            if (watchdog->idle > 0 && !watchdog->stale){
+                if (watchdog->last_rx + watchdog->idle <= now){
+                    if (__sync_bool_compare_and_swap(&watchdog->stale, 0, 1)){
+                        watchdog->stale_count++;
+                        queue_event(watchdog, WATCHDOG_EVENT_STALE,
+                                    (now - watchdog->last_rx) / 1000000);
+                    }
+                } else {
+                    earliest = earlier(earliest, watchdog->last_rx + watchdog->idle);
+                }
+            }
+            if (watchdog->keepalive > 0){
+                if (watchdog->last_tx + watchdog->keepalive <= now)
+                    due = watchdog;
+                else
+                    earliest = earlier(earliest, watchdog->last_tx + watchdog->keepalive);
+            }
+        }
+        if (due != NULL){
+            // Pin the watchdog so its port is not closed while it is written.
+            length = due->frame_length;
+            memcpy(frame, due->frame, length);
+            due->busy++;
+            pthread_mutex_unlock(&watchdog_lock);
+            error = send_keepalive(due->port, frame, length);
+            pthread_mutex_lock(&watchdog_lock);
+            if (error == 0){
+                due->keepalives++;
+            } else {
+                // Try again a full period on rather than straight away.
+                due->last_tx = now_nanos();
+                due->keepalive_failures++;
+                queue_event(due, WATCHDOG_EVENT_KEEPALIVE_FAILED, error);
+            }
+            due->busy--;
+            pthread_cond_broadcast(&watchdog_done);
+            continue;
+        }
+        timer.it_value.tv_sec = earliest / 1000000000ULL;
+        timer.it_value.tv_nsec = earliest % 1000000000ULL;
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+        pthread_mutex_unlock(&watchdog_lock);
+        if (poll(pfds, 2, -1) > 0){
+            if (pfds[0].revents & POLLIN)
+                read(timer_fd, &value, sizeof(value));
+            if (pfds[1].revents & POLLIN)
+                eventfd_read(wake_fd, &value);
+        }
+        pthread_mutex_lock(&watchdog_lock);
+    }
+    watchdog_running = 0;
+    pthread_mutex_unlock(&watchdog_lock);
+    thread_config_unregister();
+    return NULL;
+}
+
+/*
+ * Links a watchdog in, starting the thread if need be. Called with the
+ * watchdog lock held.
+ */
+static int add_watchdog(struct port_watchdog *watchdog){
+    pthread_t thread;
+    int error = 0;
+    if (!watchdog_running){
+        error = pthread_create(&thread, NULL, watchdog_thread, NULL);
+        if (error == 0){
+            pthread_detach(thread);
+            watchdog_running = 1;
+        }
+    }
+    if (error == 0){
+        watchdog->next = watchdogs;
+        watchdogs = watchdog;
+        watchdog->active = 1;
+    }
+    return error;
+}
+
+/*
+ * Unlinks a watchdog and waits until the thread is done with it, and stops
+ * the read and write paths noting traffic for it. Called with the port lock
+ * and the watchdog lock held.
+ */
+static void remove_watchdog(struct port_watchdog *watchdog){
+    struct port_watchdog **link;
+    watchdog->port->watching = NULL;
+    for (link = &watchdogs; *link != NULL; link = &(*link)->next){
+        if (*link == watchdog){
+            *link = watchdog->next;
+            break;
+        }
+    }
+    watchdog->active = 0;
+    watchdog->stale = 0;
+    while (watchdog->busy > 0)
+        pthread_cond_wait(&watchdog_done, &watchdog_lock);
+    eventfd_write(wake_fd, 1);
+}
+
+static void stop_watchdog(struct port_helper *helper){
+    struct port_watchdog *watchdog = (struct port_watchdog*) helper;
+    pthread_mutex_lock(&watchdog_lock);
+    if (watchdog->active)
+        remove_watchdog(watchdog);
+    pthread_mutex_unlock(&watchdog_lock);
+}
+
+/*
+ * Frees a watchdog once its port has no more users.
+ */
+void watchdog_free(struct port_watchdog *watchdog){
+    free(watchdog);
+}
+
+/**
+ * Watches a port for silence, or changes or stops watching it. A port from
+ * which nothing has been received for idle_millis is marked stale and a
+ * STALE event queued; when data arrives again an ACTIVE event is queued. A
+ * port to which nothing has been sent for keepalive_millis has the
+ * keepalive frame written to it. The frame is written whole but may fall
+ * between the pieces of a write made at the same time on another thread.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @param idle_millis how long the port may receive nothing before it is
+ * stale, 0 for no limit.
+ * @param keepalive_millis how long the port may send nothing before the
+ * keepalive frame is sent, 0 for no keepalive.
+ * @param keepalive the keepalive frame of up to WATCHDOG_MAX_KEEPALIVE
+ * bytes, which may be null if keepalive_millis is 0.
+ * @return 0 upon success.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jint JNICALL
+Java_com_javatechnics_rs232_Serial_setPortWatchdog (JNIEnv *env,
+                                                jobject obj,
+                                                jlong handle,
+                                                jint idle_millis,
+                                                jint keepalive_millis,
+                                                jbyteArray keepalive){
+    struct serial_port *port;
+    struct port_watchdog *watchdog;
+    jsize frame_length = 0;
+    int error = 0, created = 0;
+    uint64_t now;
+
+    if (keepalive != NULL)
+        frame_length = (*env)->GetArrayLength(env, keepalive);
+    if (idle_millis < 0 || keepalive_millis < 0 || frame_length > WATCHDOG_MAX_KEEPALIVE
+            || (keepalive_millis > 0 && frame_length == 0)){
+        throw_ioexception(env, EINVAL);
+        return -1;
+    }
+    pthread_once(&watchdog_once, init_watchdog);
+    if (setup_error != 0){
+        throw_ioexception(env, setup_error);
+        return -1;
+    }
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return -1;
+    }
+    pthread_mutex_lock(&port->lock);
+    watchdog = port->watchdog;
+    if (watchdog == NULL && (idle_millis > 0 || keepalive_millis > 0)){
+        watchdog = calloc(1, sizeof(struct port_watchdog));
+        if (watchdog == NULL){
+            error = ENOMEM;
+        } else {
+            watchdog->helper.stop = stop_watchdog;
+            watchdog->port = port;
+            watchdog->handle = handle;
+            watchdog->last_rx = watchdog->last_tx = now_nanos();
+            if (port_add_helper(port, &watchdog->helper) == -1){
+                error = errno;
+                free(watchdog);
+                watchdog = NULL;
+            } else {
+                created = 1;
+                port->watchdog = watchdog;
+            }
+        }
+    }
+    if (error == 0 && watchdog != NULL){
+        pthread_mutex_lock(&watchdog_lock);
+        if (watchdog->active && idle_millis == 0 && keepalive_millis == 0){
+            remove_watchdog(watchdog);
+        } else if (idle_millis > 0 || keepalive_millis > 0){
+            if (!watchdog->active && !created){
+                // Time silence from now, not from when the port was last watched.
+                now = now_nanos();
+                watchdog->last_rx = watchdog->last_tx = now;
+            }
+            watchdog->idle = (uint64_t) idle_millis * 1000000ULL;
+            watchdog->keepalive = (uint64_t) keepalive_millis * 1000000ULL;
+            watchdog->frame_length = frame_length;
+            if (frame_length > 0)
+                (*env)->GetByteArrayRegion(env, keepalive, 0, frame_length,
+                                            (jbyte*) watchdog->frame);
+            if (!watchdog->active){
+                error = add_watchdog(watchdog);
+                if (error == 0){
+                    // The read and write paths look at the pointer without the port lock.
+                    __sync_synchronize();
+                    port->watching = watchdog;
+                }
+            } else
+                eventfd_write(wake_fd, 1);
+        }
+        pthread_mutex_unlock(&watchdog_lock);
+    }
+    pthread_mutex_unlock(&port->lock);
+    port_release(port);
+    if (error != 0){
+        throw_ioexception(env, error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the watchdog status of a port.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param handle the handle of the port.
+ * @return an array of WATCHDOG_STATUS_FIELDS values: 1 if the port is stale
+ * and 0 if not, milliseconds since data was last received and last sent,
+ * the number of times the port has gone stale and the number of keepalives
+ * sent and failed. The times are -1 if the port has never been watched.
+ * @throws IOException if the handle is not that of an open port.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_getPortWatchdogStatus (JNIEnv *env,
+                                                        jobject obj,
+                                                        jlong handle){
+    jlong values[WATCHDOG_STATUS_FIELDS] = {0, -1, -1, 0, 0, 0};
+    struct serial_port *port;
+    struct port_watchdog *watchdog;
+    jlongArray result;
+    uint64_t now;
+
+    port = port_acquire(handle);
+    if (port == NULL){
+        throw_ioexception(env, errno);
+        return NULL;
+    }
+    pthread_mutex_lock(&port->lock);
+    watchdog = port->watchdog;
+    if (watchdog != NULL){
+        now = now_nanos();
+        pthread_mutex_lock(&watchdog_lock);
+        values[0] = watchdog->stale;
+        values[1] = (now - watchdog->last_rx) / 1000000;
+        values[2] = (now - watchdog->last_tx) / 1000000;
+        values[3] = watchdog->stale_count;
+        values[4] = watchdog->keepalives;
+        values[5] = watchdog->keepalive_failures;
+        pthread_mutex_unlock(&watchdog_lock);
+    }
+    pthread_mutex_unlock(&port->lock);
+    port_release(port);
+    result = (*env)->NewLongArray(env, WATCHDOG_STATUS_FIELDS);
+    if (result == NULL)
+        return NULL;
+    (*env)->SetLongArrayRegion(env, result, 0, WATCHDOG_STATUS_FIELDS, values);
+    return result;
+}
+
+/**
+ * Collects the watchdog events of every port, waiting for one if there are
+ * none.
+ * @param env pointer to the JNI environment.
+ * @param obj the calling Java object.
+ * @param timeout_millis how long to wait for an event, negative to wait
+ * indefinitely.
+ * @return an array of WATCHDOG_EVENT_FIELDS values per event, oldest first:
+ * the handle of the port, the event and its value. The array is empty if
+ * the timeout expired.
+ * @throws IOException if an error occurs.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_javatechnics_rs232_Serial_pollWatchdogEvents (JNIEnv *env,
+                                                    jobject obj,
+                                                    jint timeout_millis){
+    struct watchdog_event *collected = NULL;
+    struct timespec deadline;
+    jlongArray result;
+    size_t count, i;
+    uint64_t until;
+
+    pthread_once(&watchdog_once, init_watchdog);
+    until = now_nanos() + (uint64_t) (timeout_millis > 0 ? timeout_millis : 0) * 1000000ULL;
+    deadline.tv_sec = until / 1000000000ULL;
+    deadline.tv_nsec = until % 1000000000ULL;
+    pthread_mutex_lock(&watchdog_lock);
+    while (event_count == 0 && timeout_millis != 0){
+        if (timeout_millis < 0)
+            pthread_cond_wait(&events_ready, &watchdog_lock);
+        else if (pthread_cond_timedwait(&events_ready, &watchdog_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    count = event_count;
+    if (count > 0){
+        collected = malloc(count * sizeof(struct watchdog_event));
+        if (collected == NULL){
+            pthread_mutex_unlock(&watchdog_lock);
+            throw_ioexception(env, ENOMEM);
+            return NULL;
+        }
+        for (i = 0; i < count; i++){
+            collected[i] = events[(event_start + i) % WATCHDOG_EVENT_QUEUE];
+        }
+        event_start = event_count = 0;
+    }
+    pthread_mutex_unlock(&watchdog_lock);
+    result = (*env)->NewLongArray(env, count * WATCHDOG_EVENT_FIELDS);
+    if (result != NULL && count > 0)
+        (*env)->SetLongArrayRegion(env, result, 0, count * WATCHDOG_EVENT_FIELDS,
+                                    (jlong*) collected);
+    free(collected);
+    return result;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014-2015 Kerry Billingham <contact@AvionicEngineers.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ */
+
+/* 
+ * File:   watchdog.h
+ * Author: Kerry Billingham <contact@AvionicEngineers.com>
+ *
+ * Idle watchdogs. The read and write paths of a watched port note when data
+ * last moved; a single native thread, woken by a timerfd armed for the
+ * earliest deadline of any port, marks ports stale once nothing has been
+ * received for their idle period and sends a keepalive frame to ports that
+ * have sent nothing for their keepalive period.
+ */
+
+#ifndef WATCHDOG_H
+#define	WATCHDOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "port.h"
+#include "thread_config.h"
+
+#define WATCHDOG_MAX_KEEPALIVE 256
+
+/*
+ Events are queued for Java as the handle of the port, the event and a
+ value: for STALE and ACTIVE the milliseconds since data was last received,
+ for KEEPALIVE_FAILED the errno value of the failure.
+ */
+#define WATCHDOG_EVENT_FIELDS 3
+#define WATCHDOG_EVENT_STALE 1
+#define WATCHDOG_EVENT_ACTIVE 2
+#define WATCHDOG_EVENT_KEEPALIVE_FAILED 3
+
+/*
+ The events held until Java collects them. Beyond this the oldest are
+ dropped.
+ */
+#define WATCHDOG_EVENT_QUEUE 1024
+
+/*
+ The status handed to Java: whether the port is stale, milliseconds since
+ data was last received and last sent, the number of times the port went
+ stale and keepalives sent and failed.
+ */
+#define WATCHDOG_STATUS_FIELDS 6
+
+struct watchdog_event {
+    jlong handle;
+    jlong event;
+    jlong value;
+};
+
+struct port_watchdog {
+    struct port_helper helper;
+    struct serial_port *port;
+    jlong handle;
+    /* Set without a lock by the read and write paths. */
+    uint64_t last_rx;
+    uint64_t last_tx;
+    int stale;
+    /* The rest is guarded by the watchdog lock. */
+    int active;
+    int busy;
+    uint64_t idle;
+    uint64_t keepalive;
+    unsigned char frame[WATCHDOG_MAX_KEEPALIVE];
+    size_t frame_length;
+    uint64_t stale_count;
+    uint64_t keepalives;
+    uint64_t keepalive_failures;
+    struct port_watchdog *next;
+};
+
+void watchdog_received(struct port_watchdog *watchdog);
+
+void watchdog_sent(struct port_watchdog *watchdog);
+
+void watchdog_free(struct port_watchdog *watchdog);
+
+#endif	/* WATCHDOG_H */